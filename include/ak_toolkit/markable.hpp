@@ -12,6 +12,17 @@
 #include <limits>
 #include <new>
 #include <type_traits>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <cstddef>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <compare>
+#include <concepts>
+#include <functional>
+#include <memory>
 
 # if defined AK_TOOLKIT_WITH_CONCEPTS
 #include <concepts>
@@ -23,12 +34,14 @@
 #  define AK_TOOLKIT_CONSTEXPR
 #  define AK_TOOLKIT_EXPLICIT_CONV
 #  define AK_TOOLKIT_NOEXCEPT_AS(E)
+#  define AK_TOOLKIT_NOEXCEPT_IF(B)
 #else
 #  define AK_TOOLKIT_NOEXCEPT noexcept
 #  define AK_TOOLKIT_IS_NOEXCEPT(E) noexcept(E)
 #  define AK_TOOLKIT_CONSTEXPR constexpr
 #  define AK_TOOLKIT_EXPLICIT_CONV explicit
 #  define AK_TOOLKIT_NOEXCEPT_AS(E) noexcept(noexcept(E))
+#  define AK_TOOLKIT_NOEXCEPT_IF(B) noexcept(B)
 #  define AK_TOOLKIT_CONSTEXPR_NOCONST // fix in the future
 #endif
 
@@ -95,6 +108,61 @@ concept mark_policy =
 
 struct default_tag{};
 
+template <AK_TOOLKIT_MARK_POLICY MP> class markable;
+
+// Where marked values go in an ordering of markable objects.
+enum class null_order { first, last };
+
+// Three-way comparison of markable objects: values compare as value_type, marked values
+// are equivalent to each other and order before (or after) every value.
+template <null_order Order = null_order::first>
+struct markable_compare
+{
+  template <typename MP>
+  AK_TOOLKIT_CONSTEXPR auto operator()(const markable<MP>& l, const markable<MP>& r) const
+    -> std::compare_three_way_result_t<typename MP::value_type>
+  {
+    if (l.has_value() && r.has_value())
+      return l.value() <=> r.value();
+    std::strong_ordering o = l.has_value() <=> r.has_value(); // the marked one is less
+    return Order == null_order::first ? o : 0 <=> o;
+  }
+};
+
+template <null_order Order = null_order::first>
+struct markable_less
+{
+  template <typename MP>
+  AK_TOOLKIT_CONSTEXPR bool operator()(const markable<MP>& l, const markable<MP>& r) const
+  {
+    return markable_compare<Order>{}(l, r) < 0;
+  }
+};
+
+// Tags that describe how a policy encodes the marked state in its representation_type.
+// A policy exposes one as nested typedef `marking`; bulk algorithms use it to test many
+// values at once. Policies without it are tested one value at a time via is_marked_value().
+struct bit_pattern_marking {}; // exactly the bit pattern of marked_value() is marked
+struct nan_marking {};         // every NaN is marked
+struct sign_bit_marking {};    // every negative value of a signed integer is marked
+struct int_range_marking {};   // every value from marked_value() to last_marked_value() is marked
+
+namespace detail_ {
+
+template <typename MP, typename = void>
+struct marking_of
+{
+  typedef void type;
+};
+
+template <typename MP>
+struct marking_of<MP, typename std::conditional<true, void, typename MP::marking>::type>
+{
+  typedef typename MP::marking type;
+};
+
+} // namespace detail_
+
 template <typename T, typename NT = T, typename CREF = const T&, typename REPT = NT>
 struct markable_type
 {
@@ -113,17 +181,73 @@ struct markable_type
 template <typename T, T Val>
 struct mark_int : markable_type<T>
 {
+  typedef bit_pattern_marking marking;
+
   static AK_TOOLKIT_CONSTEXPR T marked_value() AK_TOOLKIT_NOEXCEPT { return Val; }
   static AK_TOOLKIT_CONSTEXPR bool is_marked_value(T v) AK_TOOLKIT_NOEXCEPT { return v == Val; }
 };
 
+// Marks every negative value of a signed integer type, for columns that are non-negative by
+// construction. The test is one sign-bit test, and bulk scans read the sign bits with movemask.
+template <typename T>
+struct mark_sign_bit : markable_type<T>
+{
+  static_assert(std::is_integral<T>::value && std::is_signed<T>::value, "mark_sign_bit requires a signed integral type");
+
+  typedef sign_bit_marking marking;
+
+  static AK_TOOLKIT_CONSTEXPR T marked_value() AK_TOOLKIT_NOEXCEPT { return T(-1); }
+  static AK_TOOLKIT_CONSTEXPR bool is_marked_value(T v) AK_TOOLKIT_NOEXCEPT { return v < 0; }
+};
+
+// Marks every value in [Lo, Hi]; marked_value() is Lo. The test is a single unsigned compare
+// of v - Lo against Hi - Lo.
+template <typename T, T Lo, T Hi>
+struct mark_int_range : markable_type<T>
+{
+  static_assert(std::is_integral<T>::value && !std::is_same<T, bool>::value, "mark_int_range requires an integral type");
+  static_assert(Lo <= Hi, "mark_int_range requires Lo <= Hi");
+  typedef typename std::make_unsigned<T>::type unsigned_type;
+
+  typedef int_range_marking marking;
+
+  static AK_TOOLKIT_CONSTEXPR T marked_value() AK_TOOLKIT_NOEXCEPT { return Lo; }
+  static AK_TOOLKIT_CONSTEXPR T last_marked_value() AK_TOOLKIT_NOEXCEPT { return Hi; }
+  static AK_TOOLKIT_CONSTEXPR bool is_marked_value(T v) AK_TOOLKIT_NOEXCEPT
+  {
+    return unsigned_type(unsigned_type(v) - unsigned_type(Lo)) <= unsigned_type(unsigned_type(Hi) - unsigned_type(Lo));
+  }
+};
+
 template <typename FPT>
 struct mark_fp_nan : markable_type<FPT>
 {
+  typedef nan_marking marking;
+
   static AK_TOOLKIT_CONSTEXPR FPT marked_value() AK_TOOLKIT_NOEXCEPT { return std::numeric_limits<FPT>::quiet_NaN(); }
   static AK_TOOLKIT_CONSTEXPR bool is_marked_value(FPT v) AK_TOOLKIT_NOEXCEPT { return v != v; }
 };
 
+// Marks FPT with a single quiet NaN, the one whose payload (the significand bits below the quiet
+// bit) is Payload; every other NaN, such as the result of 0.0 / 0.0, is a value. The test is an
+// integer compare of the bits. Arithmetic on the marked value usually propagates its payload, so
+// the result is marked too.
+template <typename FPT, std::uint64_t Payload>
+struct mark_fp_nan_payload : markable_type<FPT>
+{
+  static_assert(std::numeric_limits<FPT>::is_iec559 && (sizeof(FPT) == 4 || sizeof(FPT) == 8),
+                "mark_fp_nan_payload requires IEEE single or double precision");
+  typedef typename std::conditional<sizeof(FPT) == 8, std::uint64_t, std::uint32_t>::type bits_type;
+  static constexpr bits_type quiet_bit = bits_type(1) << (std::numeric_limits<FPT>::digits - 2);
+  static_assert(Payload != 0 && Payload < quiet_bit, "the payload must be non-zero and fit below the quiet bit");
+  static constexpr bits_type marked_bits = std::bit_cast<bits_type>(std::numeric_limits<FPT>::infinity()) | quiet_bit | bits_type(Payload);
+
+  typedef bit_pattern_marking marking;
+
+  static AK_TOOLKIT_CONSTEXPR FPT marked_value() AK_TOOLKIT_NOEXCEPT { return std::bit_cast<FPT>(marked_bits); }
+  static AK_TOOLKIT_CONSTEXPR bool is_marked_value(FPT v) AK_TOOLKIT_NOEXCEPT { return std::bit_cast<bits_type>(v) == marked_bits; }
+};
+
 template <typename T> // requires Regular<T>
 struct mark_value_init : markable_type<T>
 {
@@ -154,6 +278,8 @@ struct mark_optional : markable_type<typename OT::value_type, OT>
 
 struct mark_bool : markable_type<bool, char, bool>
 {
+  typedef bit_pattern_marking marking;
+
   static AK_TOOLKIT_CONSTEXPR char marked_value() AK_TOOLKIT_NOEXCEPT { return char(2); }
   static AK_TOOLKIT_CONSTEXPR bool is_marked_value(char v) AK_TOOLKIT_NOEXCEPT { return v == 2; }
 
@@ -161,6 +287,41 @@ struct mark_bool : markable_type<bool, char, bool>
   static AK_TOOLKIT_CONSTEXPR char store_value(const bool& v) { return v; }
 };
 
+namespace detail_ {
+
+// True if no object of type T can live at address Mark (or Mark is null).
+template <typename T, std::uintptr_t Mark>
+constexpr bool is_pointer_niche()
+{
+  if constexpr (Mark == 0)
+    return true;
+  else if constexpr (std::is_object<T>::value)
+    return Mark % alignof(T) != 0;
+  else
+    return false;
+}
+
+} // namespace detail_
+
+// Marks T* with address Mark: nullptr by default, or a misaligned address (e.g. 1 when
+// alignof(T) > 1), in which case nullptr is a valid value.
+template <typename T, std::uintptr_t Mark = 0>
+struct mark_pointer : markable_type<T*>
+{
+  typedef bit_pattern_marking marking;
+
+  static AK_TOOLKIT_CONSTEXPR T* marked_value() AK_TOOLKIT_NOEXCEPT
+  {
+    static_assert(detail_::is_pointer_niche<T, Mark>(), "the mark must be null or an address no T can have");
+    if constexpr (Mark == 0)
+      return nullptr;
+    else
+      return reinterpret_cast<T*>(Mark);
+  }
+
+  static AK_TOOLKIT_CONSTEXPR bool is_marked_value(T* v) AK_TOOLKIT_NOEXCEPT { return v == marked_value(); }
+};
+
 
 #ifndef AK_TOOLBOX_NO_UNDERLYING_TYPE
 template <typename Enum, typename std::underlying_type<Enum>::type Val>
@@ -178,6 +339,7 @@ struct mark_enum : markable_type<Enum, int, Enum>
 
   typedef typename base::representation_type representation_type;
   typedef typename base::storage_type        storage_type;
+  typedef bit_pattern_marking                marking;
 
   static AK_TOOLKIT_CONSTEXPR representation_type marked_value() AK_TOOLKIT_NOEXCEPT { return Val; }
   static AK_TOOLKIT_CONSTEXPR bool is_marked_value(const representation_type& v) AK_TOOLKIT_NOEXCEPT { return v == Val; }
@@ -212,7 +374,9 @@ union dual_storage_union
   constexpr explicit dual_storage_union(const value_type& v) AK_TOOLKIT_NOEXCEPT_AS(value_type(std::move(v)))
     : _value(v) {}
 
-  ~dual_storage_union() {/* nothing here; will be properly destroyed by the owner */}
+  ~dual_storage_union() requires (std::is_trivially_destructible<value_type>::value
+                               && std::is_trivially_destructible<representation_type>::value) = default;
+  constexpr ~dual_storage_union() {/* nothing here; will be properly destroyed by the owner */}
 };
 
 template <typename MVP, typename = void>
@@ -224,6 +388,26 @@ struct check_safe_dual_storage_exception_safety<MVP, typename MVP::is_safe_dual_
 {
 };
 
+// For policies storing a scalar that is also the value (mark_int, mark_fp_nan, mark_enum, mark_bool)
+// access_value() is valid also for the marked state, so accessors can compute the value
+// unconditionally and select the result, without a branch.
+template <typename MP>
+struct has_select_friendly_storage
+  : std::integral_constant<bool, std::is_scalar<typename MP::storage_type>::value
+                              && std::is_scalar<typename MP::value_type>::value> {};
+
+template <typename T>
+struct is_markable : std::false_type {};
+
+template <typename MP>
+struct is_markable<markable<MP>> : std::true_type {};
+
+template <typename MP, typename = void>
+struct is_trivially_relocatable_policy : ::std::false_type {};
+
+template <typename MP>
+struct is_trivially_relocatable_policy<MP, typename MP::is_trivially_relocatable_mark_policy> : ::std::true_type {};
+
 } // namespace detail_
 
 template <typename T>
@@ -244,11 +428,12 @@ private:
   union_type value_;
 
 private:
-  void* address() { return static_cast<void*>(std::addressof(value_)); }
-  void construct_value(const value_type& v) { ::new (address()) value_type(v); }
-  void construct_value(value_type&& v) { ::new (address()) value_type(std::move(v)); }
+  // std::construct_at and std::destroy_at (rather than placement new and destructor calls)
+  // switch the active member of the union also during constant evaluation.
+  constexpr void construct_value(const value_type& v) { std::construct_at(std::addressof(value_._value), v); }
+  constexpr void construct_value(value_type&& v) { std::construct_at(std::addressof(value_._value), std::move(v)); }
 
-  void change_to_value(const value_type& v)
+  constexpr void change_to_value(const value_type& v)
     try {
       destroy_storage();
       construct_value(v);
@@ -259,7 +444,7 @@ private:
       throw;
     }
 
-  void change_to_value(value_type&& v)
+  constexpr void change_to_value(value_type&& v)
     try {
       destroy_storage();
       construct_value(std::move(v));
@@ -270,23 +455,35 @@ private:
       throw;
     }
 
-  void construct_storage() { ::new (address()) representation_type(MP::marked_value()); }
-  void construct_storage_checked() AK_TOOLKIT_NOEXCEPT { construct_storage(); }  // std::terminate() if MP::marked_value() throws
+  constexpr void construct_storage() { std::construct_at(std::addressof(value_._marking), MP::marked_value()); }
+  constexpr void construct_storage_checked() AK_TOOLKIT_NOEXCEPT { construct_storage(); }  // std::terminate() if MP::marked_value() throws
 
-  void destroy_value() AK_TOOLKIT_NOEXCEPT { as_value().value_type::~value_type(); }
-  void destroy_storage() AK_TOOLKIT_NOEXCEPT { representation().representation_type::~representation_type(); }
+  constexpr void destroy_value() AK_TOOLKIT_NOEXCEPT { std::destroy_at(std::addressof(value_._value)); }
+  constexpr void destroy_storage() AK_TOOLKIT_NOEXCEPT { std::destroy_at(std::addressof(value_._marking)); }
 
 public:
-  void clear_value() AK_TOOLKIT_NOEXCEPT { destroy_value(); construct_storage(); } // std::terminate() if MP::marked_value() throws
-  bool has_value() const AK_TOOLKIT_NOEXCEPT { return !MP::is_marked_value(representation()); }
+  constexpr void clear_value() AK_TOOLKIT_NOEXCEPT { destroy_value(); construct_storage(); } // std::terminate() if MP::marked_value() throws
 
-  value_type& as_value() { return value_._value; }
-  const value_type& as_value() const { return value_._value; }
+  // Reading the representation of an active value is fine at run time (common initial sequence),
+  // but not in constant evaluation, where only is_within_lifetime can tell the active member.
+  // Without it, has_value() is a constant expression only for the marked state; trivially
+  // copyable storage can still be copied, assigned and swapped at compile time.
+  constexpr bool has_value() const AK_TOOLKIT_NOEXCEPT
+  {
+#if defined __cpp_lib_is_within_lifetime
+    if (std::is_constant_evaluated())
+      return std::is_within_lifetime(std::addressof(value_._value));
+#endif
+    return !MP::is_marked_value(representation());
+  }
+
+  constexpr value_type& as_value() { return value_._value; }
+  constexpr const value_type& as_value() const { return value_._value; }
 
 public:
 
-  representation_type& representation() AK_TOOLKIT_NOEXCEPT { return value_._marking; }
-  const representation_type& representation() const AK_TOOLKIT_NOEXCEPT { return value_._marking; }
+  constexpr representation_type& representation() AK_TOOLKIT_NOEXCEPT { return value_._marking; }
+  constexpr const representation_type& representation() const AK_TOOLKIT_NOEXCEPT { return value_._marking; }
 
   constexpr explicit dual_storage(representation_type&& mv) AK_TOOLKIT_NOEXCEPT_AS(union_type(std::move(mv)))
     : value_(std::move(mv)) {}
@@ -297,7 +494,32 @@ public:
   constexpr explicit dual_storage(value_type&& v) AK_TOOLKIT_NOEXCEPT_AS(union_type(std::move(v)))
     : value_(std::move(v)) {}
 
-  dual_storage(const dual_storage& rhs) // TODO: add noexcept
+  // When both value_type and representation_type are trivially copyable, so is dual_storage:
+  // copying the union copies whichever member is active, and containers can use memcpy.
+  static constexpr bool is_trivial_ = std::is_trivially_copyable<value_type>::value
+                                   && std::is_trivially_copyable<representation_type>::value;
+
+  // Copy and move construct either a value or the marked representation. Assignments
+  // also may assign a value or destroy one and construct another in its place; clear_value()
+  // is noexcept because it only constructs the marked representation.
+  static constexpr bool is_nothrow_marked_ = AK_TOOLKIT_IS_NOEXCEPT(representation_type(MP::marked_value()));
+  static constexpr bool is_nothrow_copy_ = std::is_nothrow_copy_constructible<value_type>::value && is_nothrow_marked_;
+  static constexpr bool is_nothrow_move_ = std::is_nothrow_move_constructible<value_type>::value && is_nothrow_marked_;
+  static constexpr bool is_nothrow_copy_assign_ = std::is_nothrow_copy_assignable<value_type>::value
+                                               && std::is_nothrow_copy_constructible<value_type>::value;
+  static constexpr bool is_nothrow_move_assign_ = std::is_nothrow_move_assignable<value_type>::value
+                                               && std::is_nothrow_move_constructible<value_type>::value;
+  static constexpr bool is_nothrow_swap_ = std::is_nothrow_swappable<value_type>::value
+                                        && std::is_nothrow_move_constructible<value_type>::value;
+
+  // Copy operations are only available for a copyable value_type (mark_unique_ptr is move-only).
+  dual_storage(const dual_storage& rhs) requires is_trivial_ = default;
+  dual_storage(dual_storage&& rhs) requires is_trivial_ = default;
+  dual_storage& operator=(const dual_storage& rhs) requires is_trivial_ = default;
+  dual_storage& operator=(dual_storage&& rhs) requires is_trivial_ = default;
+
+  constexpr dual_storage(const dual_storage& rhs) AK_TOOLKIT_NOEXCEPT_IF(is_nothrow_copy_)
+    requires (!is_trivial_ && std::is_copy_constructible<value_type>::value)
     : value_(detail_::_init_nothing_tag{})
     {
       if (rhs.has_value())
@@ -306,7 +528,7 @@ public:
         construct_storage();
     }
 
-  dual_storage(dual_storage&& rhs) // TODO: add noexcept
+  constexpr dual_storage(dual_storage&& rhs) AK_TOOLKIT_NOEXCEPT_IF(is_nothrow_move_)
     : value_(detail_::_init_nothing_tag{})
     {
       if (rhs.has_value())
@@ -315,7 +537,8 @@ public:
         construct_storage();
     }
 
-  void operator=(const dual_storage& rhs)
+  constexpr dual_storage& operator=(const dual_storage& rhs) AK_TOOLKIT_NOEXCEPT_IF(is_nothrow_copy_assign_)
+    requires (!is_trivial_ && std::is_copy_assignable<value_type>::value)
     {
       if (has_value() && rhs.has_value())
       {
@@ -329,9 +552,10 @@ public:
       {
         change_to_value(rhs.as_value());
       }
+      return *this;
     }
 
-  void operator=(dual_storage&& rhs) // TODO: add noexcept
+  constexpr dual_storage& operator=(dual_storage&& rhs) AK_TOOLKIT_NOEXCEPT_IF(is_nothrow_move_assign_)
     {
       if (has_value() && rhs.has_value())
       {
@@ -345,30 +569,42 @@ public:
       {
         change_to_value(std::move(rhs.as_value()));
       }
+      return *this;
     }
 
-  void swap_impl(dual_storage& rhs)
+  constexpr void swap_impl(dual_storage& rhs) AK_TOOLKIT_NOEXCEPT_IF(is_trivial_ || is_nothrow_swap_)
   {
-    using namespace std;
-    if (has_value() && rhs.has_value())
-    {
-      swap(as_value(), rhs.as_value());
+    if constexpr (is_trivial_)
+    { // no need to inspect which member is active
+      dual_storage tmp(rhs);
+      rhs = *this;
+      *this = tmp;
     }
-    else if (has_value() && !rhs.has_value())
-    {
-      rhs.change_to_value(std::move(as_value()));
-      clear_value();
-    }
-    else if (!has_value() && rhs.has_value())
+    else
     {
-      change_to_value(std::move(rhs.as_value()));
-      rhs.clear_value();
+      using namespace std;
+      if (has_value() && rhs.has_value())
+      {
+        swap(as_value(), rhs.as_value());
+      }
+      else if (has_value() && !rhs.has_value())
+      {
+        rhs.change_to_value(std::move(as_value()));
+        clear_value();
+      }
+      else if (!has_value() && rhs.has_value())
+      {
+        change_to_value(std::move(rhs.as_value()));
+        rhs.clear_value();
+      }
     }
   }
 
-  friend void swap(dual_storage& lhs, dual_storage& rhs) { lhs.swap_impl(rhs); }
+  friend constexpr void swap(dual_storage& lhs, dual_storage& rhs) AK_TOOLKIT_NOEXCEPT_AS(lhs.swap_impl(rhs)) { lhs.swap_impl(rhs); }
+
+  ~dual_storage() requires std::is_trivially_destructible<union_type>::value = default;
 
-  ~dual_storage()
+  constexpr ~dual_storage()
   {
     if (has_value())
       destroy_value();
@@ -394,13 +630,13 @@ struct markable_dual_storage_type_unsafe
   typedef const T& reference_type;
   typedef dual_storage<MPT> storage_type;
 
-  static  reference_type access_value(const storage_type& v)
+  static AK_TOOLKIT_CONSTEXPR reference_type access_value(const storage_type& v)
   { return v.as_value(); }
-  static  const representation_type& representation(const storage_type& v)
+  static AK_TOOLKIT_CONSTEXPR const representation_type& representation(const storage_type& v)
   { return v.representation(); }
-  static  storage_type store_value(const value_type& v)
+  static AK_TOOLKIT_CONSTEXPR storage_type store_value(const value_type& v)
   { return storage_type(v); }
-  static  storage_type store_value(value_type&& v)
+  static AK_TOOLKIT_CONSTEXPR storage_type store_value(value_type&& v)
   { return storage_type(std::move(v)); }
 };
 
@@ -411,6 +647,60 @@ struct markable_dual_storage_type : markable_dual_storage_type_unsafe<MPT, T, RE
   typedef void is_safe_dual_storage_mark_policy;
 };
 
+// Marks std::unique_ptr<T> with address Mark, like mark_pointer. The marked state stores
+// only the raw pointer, so Mark is never passed to delete. Relies on unique_ptr with the
+// default deleter having the layout of T*, which holds in all major implementations.
+template <typename T, std::uintptr_t Mark = 0>
+struct mark_unique_ptr : markable_dual_storage_type<mark_unique_ptr<T, Mark>, std::unique_ptr<T>, T*>
+{
+  typedef void is_trivially_relocatable_mark_policy;
+
+  static AK_TOOLKIT_CONSTEXPR T* marked_value() AK_TOOLKIT_NOEXCEPT { return mark_pointer<T, Mark>::marked_value(); }
+  static AK_TOOLKIT_CONSTEXPR bool is_marked_value(T* v) AK_TOOLKIT_NOEXCEPT { return v == marked_value(); }
+};
+
+namespace detail_ {
+
+template <auto Member> struct member_pointer_traits;
+
+template <typename C, typename M, M C::* Member>
+struct member_pointer_traits<Member>
+{
+  typedef C class_type;
+};
+
+template <typename T>
+constexpr T& member_at(T& o) AK_TOOLKIT_NOEXCEPT { return o; }
+
+template <auto Member, auto... Path, typename T>
+constexpr auto& member_at(T& o) AK_TOOLKIT_NOEXCEPT { return member_at<Path...>(o.*Member); }
+
+} // namespace detail_
+
+// Marks a class, e.g. an aggregate, by one of its members, reached through the member pointers
+// Member, Path...: the object has no value when that member has none. The member is a markable
+// (or another type with has_value() whose default constructed state has no value), so
+// markable<mark_member<...>> takes no more space than the class itself. An object whose designated
+// member has no value cannot be stored.
+template <auto Member, auto... Path>
+struct mark_member : markable_type<typename detail_::member_pointer_traits<Member>::class_type>
+{
+  typedef typename detail_::member_pointer_traits<Member>::class_type value_type;
+  typedef typename std::remove_cvref<decltype(detail_::member_at<Member, Path...>(std::declval<value_type&>()))>::type member_type;
+
+  static AK_TOOLKIT_CONSTEXPR value_type marked_value() AK_TOOLKIT_NOEXCEPT_AS(value_type())
+  {
+    value_type v{};
+    detail_::member_at<Member, Path...>(v) = member_type();
+    return v;
+  }
+
+  static AK_TOOLKIT_CONSTEXPR bool is_marked_value(const value_type& v)
+  {
+    return !detail_::member_at<Member, Path...>(v).has_value();
+  }
+};
+
 template <AK_TOOLKIT_MARK_POLICY MP>
 class markable
 {
@@ -446,31 +736,262 @@ public:
 
   AK_TOOLKIT_CONSTEXPR storage_type const& storage_value() const { return _storage; }
 
-  void assign(value_type&& v) { _storage = MP::store_value(std::move(v)); }
-  void assign(const value_type& v) { _storage = MP::store_value(v); }
+  // Returns the value if present, otherwise `fallback` converted to value_type. For policies storing
+  // a scalar both candidates are computed, so this compiles to a conditional move, not a branch.
+  template <typename U>
+  AK_TOOLKIT_CONSTEXPR value_type value_or(U&& fallback) const
+  {
+    if constexpr (detail_::has_select_friendly_storage<MP>::value)
+    {
+      const value_type v = MP::access_value(_storage);
+      const value_type f = static_cast<value_type>(std::forward<U>(fallback));
+      return has_value() ? v : f;
+    }
+    else
+    {
+      return has_value() ? value_type(MP::access_value(_storage)) : static_cast<value_type>(std::forward<U>(fallback));
+    }
+  }
+
+  // Returns markable<MP2> holding f(value()) if a value is present, a marked one otherwise.
+  template <typename MP2 = MP, typename F>
+  AK_TOOLKIT_CONSTEXPR markable<MP2> transform(F&& f) const
+  {
+    return has_value() ? markable<MP2>(std::invoke(std::forward<F>(f), MP::access_value(_storage))) : markable<MP2>();
+  }
+
+  // f(value()) must return a markable; returns it if a value is present, a marked one otherwise.
+  template <typename F>
+  AK_TOOLKIT_CONSTEXPR auto and_then(F&& f) const
+  {
+    typedef std::remove_cvref_t<std::invoke_result_t<F, reference_type>> result_type;
+    static_assert(detail_::is_markable<result_type>::value, "and_then requires a function returning a markable");
+    return has_value() ? std::invoke(std::forward<F>(f), MP::access_value(_storage)) : result_type();
+  }
+
+  // Returns *this if a value is present, f() (convertible to markable) otherwise.
+  template <typename F>
+  AK_TOOLKIT_CONSTEXPR markable or_else(F&& f) const
+  {
+    return has_value() ? *this : static_cast<markable>(std::invoke(std::forward<F>(f)));
+  }
+
+  AK_TOOLKIT_CONSTEXPR void assign(value_type&& v) { _storage = MP::store_value(std::move(v)); }
+  AK_TOOLKIT_CONSTEXPR void assign(const value_type& v) { _storage = MP::store_value(v); }
 
-  void assign_storage(storage_type&& s) { _storage = std::move(s); }
-  void assign_storage(storage_type const& s) { _storage = s; }
+  AK_TOOLKIT_CONSTEXPR void assign_storage(storage_type&& s) { _storage = std::move(s); }
+  AK_TOOLKIT_CONSTEXPR void assign_storage(storage_type const& s) { _storage = s; }
 
-  friend void swap(markable& lhs, markable& rhs)
+  friend AK_TOOLKIT_CONSTEXPR void swap(markable& lhs, markable& rhs) AK_TOOLKIT_NOEXCEPT_IF(std::is_nothrow_swappable<storage_type>::value)
   {
     using std::swap; swap(lhs._storage, rhs._storage);
   }
+
+  // Marked values are equal to each other and unequal to every value.
+  friend AK_TOOLKIT_CONSTEXPR bool operator==(const markable& l, const markable& r)
+    requires std::equality_comparable<value_type>
+  {
+    return l.has_value() == r.has_value() && (!l.has_value() || l.value() == r.value());
+  }
+
+  // Marked values order first; use markable_compare<null_order::last> to order them last.
+  friend AK_TOOLKIT_CONSTEXPR auto operator<=>(const markable& l, const markable& r)
+    requires std::three_way_comparable<value_type>
+  {
+    return markable_compare<null_order::first>{}(l, r);
+  }
 };
 
+// A type is trivially relocatable if moving an object to a new address and abandoning
+// the source (without calling its destructor) can be done by copying bytes.
+// Containers that support relocation can use uninitialized_relocate_n() below.
+template <typename T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+// markable<MP> is trivially relocatable when it is trivially copyable, or when the policy
+// opts in by declaring `typedef void is_trivially_relocatable_mark_policy;` (e.g., for
+// a storage holding a pointer to a heap-allocated object).
+template <typename MP>
+struct is_trivially_relocatable<markable<MP>>
+  : std::integral_constant<bool, std::is_trivially_copyable<markable<MP>>::value
+                              || detail_::is_trivially_relocatable_policy<MP>::value> {};
+
+// Moves n objects from `first` to uninitialized memory at `dest` and ends the lifetime of the
+// source objects. Trivially relocatable types are moved with a single memmove.
+template <typename T>
+T* uninitialized_relocate_n(T* first, std::size_t n, T* dest)
+  AK_TOOLKIT_NOEXCEPT_IF(is_trivially_relocatable<T>::value || std::is_nothrow_move_constructible<T>::value)
+{
+  if constexpr (is_trivially_relocatable<T>::value)
+  {
+    std::memmove(static_cast<void*>(dest), static_cast<const void*>(first), n * sizeof(T));
+    return dest + n;
+  }
+  else
+  {
+    T* ans = std::uninitialized_move_n(first, n, dest).second;
+    std::destroy_n(first, n);
+    return ans;
+  }
+}
+
+namespace detail_ {
+
+template <typename MP, typename = void>
+struct declared_marked_byte : std::integral_constant<int, -2> {}; // -2: not declared
+
+template <typename MP>
+struct declared_marked_byte<MP, typename std::conditional<true, void, decltype(MP::marked_byte)>::type>
+  : std::integral_constant<int, MP::marked_byte> {};
+
+// whether marked_value() and is_marked_value() can be evaluated at compile time
+template <typename MP, typename = void>
+struct has_constexpr_marking : std::false_type {};
+
+template <typename MP>
+struct has_constexpr_marking<MP, typename std::conditional<true, void,
+  std::integral_constant<bool, MP::is_marked_value(typename MP::representation_type(MP::marked_value()))>>::type>
+  : std::true_type {};
+
+template <typename S>
+constexpr S repeat_byte(int b)
+{
+  std::array<unsigned char, sizeof(S)> bytes {};
+  for (unsigned char& c : bytes)
+    c = static_cast<unsigned char>(b);
+  return std::bit_cast<S>(bytes);
+}
+
+template <typename MP>
+constexpr int find_repeated_marked_byte()
+{
+  typedef typename MP::storage_type storage_type;
+  if constexpr (declared_marked_byte<MP>::value != -2)
+    return declared_marked_byte<MP>::value;
+  else if constexpr (std::is_same<storage_type, typename MP::representation_type>::value
+                     && ((std::is_integral<storage_type>::value && !std::is_same<storage_type, bool>::value)
+                         || std::is_enum<storage_type>::value
+                         || std::is_same<storage_type, float>::value || std::is_same<storage_type, double>::value)
+                     && has_constexpr_marking<MP>::value)
+  {
+    // zero first, so that zeroed memory is marked; then the byte of marked_value(), so that
+    // filled elements equal marked ones bitwise if they can
+    if (MP::is_marked_value(repeat_byte<storage_type>(0)))
+      return 0;
+    const int own = std::bit_cast<std::array<unsigned char, sizeof(storage_type)>>(storage_type(MP::marked_value()))[0];
+    if (MP::is_marked_value(repeat_byte<storage_type>(own)))
+      return own;
+    for (int b = 1; b != 256; ++b)
+      if (MP::is_marked_value(repeat_byte<storage_type>(b)))
+        return b;
+    return -1;
+  }
+  else
+    return -1;
+}
+
+struct free_deleter
+{
+  void operator()(void* p) const AK_TOOLKIT_NOEXCEPT { std::free(p); }
+};
+
+} // namespace detail_
+
+// A byte b such that an object of markable<MP> whose bytes all equal b is marked, or -1 if
+// there is none. -1 unless markable<MP> is trivially copyable. It is found at compile time
+// for integral, enumeration, float and double storage, preferring zero, then the byte of
+// marked_value() (e.g. 0xFF for mark_int<int, -1>, and for mark_fp_nan, whose every NaN is
+// marked). Other policies may declare it as `static constexpr int marked_byte`.
+template <typename MP>
+struct repeated_marked_byte
+  : std::integral_constant<int, std::is_trivially_copyable<markable<MP>>::value ? detail_::find_repeated_marked_byte<MP>() : -1> {};
+
+// Constructs n marked objects in the uninitialized memory at `first`: a single memset if
+// repeated_marked_byte<MP> is not -1, one constructor call per element otherwise.
+template <typename MP>
+markable<MP>* uninitialized_fill_marked(markable<MP>* first, std::size_t n)
+{
+  if constexpr (repeated_marked_byte<MP>::value >= 0)
+  {
+    if (n != 0) // `first` may be null then
+      std::memset(static_cast<void*>(first), repeated_marked_byte<MP>::value, n * sizeof(markable<MP>));
+    return first + n;
+  }
+  else
+  {
+    return std::uninitialized_default_construct_n(first, n);
+  }
+}
+
+// Makes the n objects at `first` marked, like assigning markable<MP>() to each.
+template <typename MP>
+void fill_marked(markable<MP>* first, std::size_t n)
+{
+  if constexpr (repeated_marked_byte<MP>::value >= 0)
+  {
+    if (n != 0) // `first` may be null then
+      std::memset(static_cast<void*>(first), repeated_marked_byte<MP>::value, n * sizeof(markable<MP>));
+  }
+  else
+    std::fill_n(first, n, markable<MP>());
+}
+
+// An array of markable<MP> allocated by make_marked_array.
+template <typename MP>
+using marked_array = std::unique_ptr<markable<MP>[], detail_::free_deleter>;
+
+// Allocates n marked objects of a trivially copyable markable<MP>. If zero bytes mark them, the
+// memory comes from std::calloc: for large arrays these are fresh pages, zeroed by the system
+// when first touched, and nothing is written here. Otherwise a memset or a loop fills it.
+template <typename MP>
+marked_array<MP> make_marked_array(std::size_t n)
+{
+  static_assert(std::is_trivially_copyable<markable<MP>>::value, "make_marked_array requires a trivially copyable markable");
+  static_assert(alignof(markable<MP>) <= alignof(std::max_align_t), "make_marked_array requires fundamental alignment");
+  if (n > std::size_t(-1) / sizeof(markable<MP>))
+    throw std::bad_array_new_length();
+  void* p = repeated_marked_byte<MP>::value == 0 ? std::calloc(n, sizeof(markable<MP>)) : std::malloc(n * sizeof(markable<MP>));
+  if (p == nullptr && n != 0)
+    throw std::bad_alloc();
+  markable<MP>* first = static_cast<markable<MP>*>(p);
+  if constexpr (repeated_marked_byte<MP>::value != 0)
+    uninitialized_fill_marked(first, n);
+  return marked_array<MP>(first);
+}
+
 } // namespace markable_ns
 
 using markable_ns::markable;
+using markable_ns::null_order;
+using markable_ns::markable_compare;
+using markable_ns::markable_less;
+using markable_ns::is_trivially_relocatable;
+using markable_ns::uninitialized_relocate_n;
+using markable_ns::repeated_marked_byte;
+using markable_ns::uninitialized_fill_marked;
+using markable_ns::fill_marked;
+using markable_ns::marked_array;
+using markable_ns::make_marked_array;
 using markable_ns::markable_type;
 using markable_ns::markable_dual_storage_type;
 using markable_ns::markable_dual_storage_type_unsafe;
 using markable_ns::mark_bool;
+using markable_ns::mark_pointer;
+using markable_ns::mark_unique_ptr;
+using markable_ns::mark_member;
 using markable_ns::mark_int;
+using markable_ns::mark_sign_bit;
+using markable_ns::mark_int_range;
 using markable_ns::mark_fp_nan;
+using markable_ns::mark_fp_nan_payload;
 using markable_ns::mark_value_init;
 using markable_ns::mark_optional;
 using markable_ns::mark_stl_empty;
 using markable_ns::mark_enum;
+using markable_ns::bit_pattern_marking;
+using markable_ns::nan_marking;
+using markable_ns::sign_bit_marking;
+using markable_ns::int_range_marking;
 
 # if defined AK_TOOLKIT_WITH_CONCEPTS
 
@@ -478,6 +999,8 @@ using markable_ns::mark_policy;
 
 static_assert(mark_policy<mark_bool>, "mark_policy test failed");
 static_assert(mark_policy<mark_int<int, 0>>, "mark_policy test failed");
+static_assert(mark_policy<mark_sign_bit<int>>, "mark_policy test failed");
+static_assert(mark_policy<mark_int_range<unsigned, 0xFFFFFF00u, 0xFFFFFFFFu>>, "mark_policy test failed");
 static_assert(mark_policy<mark_fp_nan<float>>, "mark_policy test failed");
 static_assert(mark_policy<mark_value_init<int>>, "mark_policy test failed");
 
@@ -0,0 +1,1422 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_ALGORITHM_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_ALGORITHM_HEADER_GUARD_
+
+#include "markable.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <ranges>
+#include <type_traits>
+
+#if !defined AK_TOOLKIT_MARKABLE_NO_SIMD && defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#  define AK_TOOLKIT_MARKABLE_X86_SIMD
+#  include <immintrin.h>
+#  define AK_TOOLKIT_TARGET(ISA) __attribute__((target(ISA)))
+#  define AK_TOOLKIT_FORCE_INLINE inline __attribute__((always_inline))
+#else
+#  define AK_TOOLKIT_TARGET(ISA)
+#  define AK_TOOLKIT_FORCE_INLINE inline
+#endif
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// Instruction sets the bulk algorithms can use; the best one supported by the CPU
+// is picked at run time.
+enum class simd_isa { scalar, sse2, avx2, avx512 };
+
+namespace detail_ {
+
+inline simd_isa detect_simd_isa() AK_TOOLKIT_NOEXCEPT
+{
+#if defined AK_TOOLKIT_MARKABLE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    return simd_isa::avx512;
+  if (__builtin_cpu_supports("avx2"))
+    return simd_isa::avx2;
+  if (__builtin_cpu_supports("sse2"))
+    return simd_isa::sse2;
+#endif
+  return simd_isa::scalar;
+}
+
+} // namespace detail_
+
+inline simd_isa supported_simd_isa() AK_TOOLKIT_NOEXCEPT
+{
+  static const simd_isa isa = detail_::detect_simd_isa();
+  return isa;
+}
+
+namespace detail_ {
+
+template <typename T>
+struct markable_policy_of;
+
+template <typename MP>
+struct markable_policy_of<markable<MP>>
+{
+  typedef MP type;
+};
+
+template <std::size_t N> struct uint_of_size;
+template <> struct uint_of_size<1> { typedef std::uint8_t  type; };
+template <> struct uint_of_size<2> { typedef std::uint16_t type; };
+template <> struct uint_of_size<4> { typedef std::uint32_t type; };
+template <> struct uint_of_size<8> { typedef std::uint64_t type; };
+
+template <typename MP>
+constexpr bool has_raw_layout()
+{
+  typedef typename MP::representation_type rep;
+  return std::is_same<typename MP::storage_type, rep>::value
+      && std::is_trivially_copyable<rep>::value
+      && sizeof(markable<MP>) == sizeof(rep)
+      && (sizeof(rep) == 1 || sizeof(rep) == 2 || sizeof(rep) == 4 || sizeof(rep) == 8);
+}
+
+// Describes how to test the marked state of a raw array of markable<MP> many values at a time.
+// When `vectorizable` is false, algorithms fall back to calling has_value() on each element.
+template <typename MP, typename Marking = typename marking_of<MP>::type, typename = void>
+struct bulk_traits
+{
+  static constexpr bool vectorizable = false;
+};
+
+template <typename MP>
+struct bulk_traits<MP, bit_pattern_marking, typename std::enable_if<has_raw_layout<MP>()>::type>
+{
+  typedef typename MP::representation_type representation_type;
+  typedef bit_pattern_marking marking;
+  typedef typename uint_of_size<sizeof(representation_type)>::type word;
+
+  static constexpr bool vectorizable = std::is_integral<representation_type>::value
+                                    || std::is_enum<representation_type>::value
+                                    || std::is_pointer<representation_type>::value
+                                    || (std::is_floating_point<representation_type>::value
+                                        && std::numeric_limits<representation_type>::is_iec559);
+
+  static word pattern() AK_TOOLKIT_NOEXCEPT { return std::bit_cast<word>(representation_type(MP::marked_value())); }
+};
+
+template <typename MP>
+struct bulk_traits<MP, nan_marking, typename std::enable_if<has_raw_layout<MP>()>::type>
+{
+  typedef typename MP::representation_type representation_type;
+  typedef nan_marking marking;
+  typedef typename uint_of_size<sizeof(representation_type)>::type word;
+
+  static constexpr bool vectorizable = (std::is_same<representation_type, float>::value
+                                     || std::is_same<representation_type, double>::value)
+                                     && std::numeric_limits<representation_type>::is_iec559;
+
+  // for NaN marking the pattern is +infinity: a value is a NaN iff its magnitude bits exceed it
+  static word pattern() AK_TOOLKIT_NOEXCEPT { return std::bit_cast<word>(std::numeric_limits<representation_type>::infinity()); }
+};
+
+template <typename MP>
+struct bulk_traits<MP, sign_bit_marking, typename std::enable_if<has_raw_layout<MP>()>::type>
+{
+  typedef typename MP::representation_type representation_type;
+  typedef sign_bit_marking marking;
+  typedef typename uint_of_size<sizeof(representation_type)>::type word;
+
+  static constexpr bool vectorizable = std::is_integral<representation_type>::value;
+
+  // for sign-bit marking the pattern is the sign bit
+  static word pattern() AK_TOOLKIT_NOEXCEPT { return word(word(1) << (8 * sizeof(word) - 1)); }
+};
+
+// The pattern of int_range_marking: the words first, first + 1, ..., first + width (modulo 2^N).
+template <typename Word>
+struct word_range
+{
+  Word first, width;
+};
+
+template <typename MP>
+struct bulk_traits<MP, int_range_marking, typename std::enable_if<has_raw_layout<MP>()>::type>
+{
+  typedef typename MP::representation_type representation_type;
+  typedef int_range_marking marking;
+  typedef typename uint_of_size<sizeof(representation_type)>::type word;
+
+  static constexpr bool vectorizable = std::is_integral<representation_type>::value;
+
+  static word_range<word> pattern() AK_TOOLKIT_NOEXCEPT
+  {
+    word first = std::bit_cast<word>(representation_type(MP::marked_value()));
+    word last = std::bit_cast<word>(representation_type(MP::last_marked_value()));
+    return {first, word(last - first)};
+  }
+};
+
+// Scalar kernels: test one raw value. SIMD kernels derive from them and add
+// `lanes` and `mask(p)`, which returns one bit per present value in a block of `lanes` values.
+
+template <typename Marking, typename Word>
+struct scalar_kernel;
+
+template <typename Word>
+struct scalar_kernel<bit_pattern_marking, Word>
+{
+  typedef Word word;
+  static constexpr std::size_t width = sizeof(Word);
+  Word pattern;
+
+  bool present(const unsigned char* p) const AK_TOOLKIT_NOEXCEPT
+  {
+    Word w; std::memcpy(&w, p, sizeof(Word));
+    return w != pattern;
+  }
+};
+
+template <typename Word>
+struct scalar_kernel<nan_marking, Word>
+{
+  typedef Word word;
+  static constexpr std::size_t width = sizeof(Word);
+  static constexpr Word magnitude_mask = Word(~Word(0)) >> 1;
+  Word pattern;
+
+  // integer test, so that it is not optimized away under -ffinite-math-only
+  bool present(const unsigned char* p) const AK_TOOLKIT_NOEXCEPT
+  {
+    Word w; std::memcpy(&w, p, sizeof(Word));
+    return (w & magnitude_mask) <= pattern;
+  }
+};
+
+template <typename Word>
+struct scalar_kernel<sign_bit_marking, Word>
+{
+  typedef Word word;
+  static constexpr std::size_t width = sizeof(Word);
+  Word pattern;
+
+  bool present(const unsigned char* p) const AK_TOOLKIT_NOEXCEPT
+  {
+    Word w; std::memcpy(&w, p, sizeof(Word));
+    return !(w & pattern);
+  }
+};
+
+template <typename Word>
+struct scalar_kernel<int_range_marking, word_range<Word>>
+{
+  typedef Word word;
+  static constexpr std::size_t width = sizeof(Word);
+  word_range<Word> pattern;
+
+  bool present(const unsigned char* p) const AK_TOOLKIT_NOEXCEPT
+  {
+    Word w; std::memcpy(&w, p, sizeof(Word));
+    return Word(w - pattern.first) > pattern.width;
+  }
+
+  // SSE2 and AVX2 have only signed compares: flipping the sign bits of both sides turns the
+  // unsigned compare into a signed one, and the flip of w - first is folded into the subtraction.
+  static constexpr Word sign = Word(Word(1) << (8 * sizeof(Word) - 1));
+  Word signed_bias() const AK_TOOLKIT_NOEXCEPT { return Word(pattern.first ^ sign); }
+  Word signed_width() const AK_TOOLKIT_NOEXCEPT { return Word(pattern.width ^ sign); }
+};
+
+template <typename K>
+inline std::uint64_t scalar_mask(const unsigned char* p, std::size_t count, const K& k) AK_TOOLKIT_NOEXCEPT
+{
+  std::uint64_t m = 0;
+  for (std::size_t j = 0; j != count; ++j)
+    m |= std::uint64_t(k.present(p + j * K::width)) << j;
+  return m;
+}
+
+// Calls op(first_index, present_mask, count) for consecutive blocks of values until op returns false.
+// Block sizes are powers of two not greater than 64, so a block never straddles a 64-bit word
+// of a bitmap. Returns false iff op stopped the scan.
+template <typename K, typename Op>
+AK_TOOLKIT_FORCE_INLINE bool scan_blocks(const unsigned char* p, std::size_t n, const K& k, Op& op)
+{
+  std::size_t i = 0;
+  for (; i + K::lanes <= n; i += K::lanes)
+    if (!op(i, k.mask(p + i * K::width), K::lanes))
+      return false;
+  return i == n || op(i, scalar_mask(p + i * K::width, n - i, k), n - i);
+}
+
+template <typename Marking, typename Word>
+struct scalar_block_kernel : scalar_kernel<Marking, Word>
+{
+  static constexpr std::size_t lanes = 64;
+  std::uint64_t mask(const unsigned char* p) const AK_TOOLKIT_NOEXCEPT { return scalar_mask(p, lanes, *this); }
+};
+
+template <typename Marking, typename Word, typename Op>
+bool scan_scalar(const unsigned char* p, std::size_t n, Word pattern, Op& op)
+{
+  scalar_block_kernel<Marking, Word> k {{pattern}};
+  return scan_blocks(p, n, k, op);
+}
+
+#if defined AK_TOOLKIT_MARKABLE_X86_SIMD
+
+namespace sse2_ {
+
+template <typename Marking, typename Word> struct kernel;
+
+template <> struct kernel<bit_pattern_marking, std::uint8_t> : scalar_kernel<bit_pattern_marking, std::uint8_t>
+{
+  static constexpr std::size_t lanes = 16;
+  AK_TOOLKIT_TARGET("sse2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), _mm_set1_epi8(char(pattern)));
+    return ~unsigned(_mm_movemask_epi8(eq)) & 0xFFFFu;
+  }
+};
+
+template <> struct kernel<bit_pattern_marking, std::uint16_t> : scalar_kernel<bit_pattern_marking, std::uint16_t>
+{
+  static constexpr std::size_t lanes = 8;
+  AK_TOOLKIT_TARGET("sse2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m128i eq = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)p), _mm_set1_epi16(short(pattern)));
+    return ~unsigned(_mm_movemask_epi8(_mm_packs_epi16(eq, eq))) & 0xFFu;
+  }
+};
+
+template <> struct kernel<bit_pattern_marking, std::uint32_t> : scalar_kernel<bit_pattern_marking, std::uint32_t>
+{
+  static constexpr std::size_t lanes = 4;
+  AK_TOOLKIT_TARGET("sse2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)p), _mm_set1_epi32(int(pattern)));
+    return ~unsigned(_mm_movemask_ps(_mm_castsi128_ps(eq))) & 0xFu;
+  }
+};
+
+template <> struct kernel<bit_pattern_marking, std::uint64_t> : scalar_kernel<bit_pattern_marking, std::uint64_t>
+{
+  static constexpr std::size_t lanes = 2;
+  AK_TOOLKIT_TARGET("sse2") std::uint64_t mask(const unsigned char* p) const
+  { // no 64-bit compare in SSE2: both 32-bit halves must be equal
+    __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)p), _mm_set1_epi64x((long long)pattern));
+    eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+    return ~unsigned(_mm_movemask_pd(_mm_castsi128_pd(eq))) & 0x3u;
+  }
+};
+
+template <> struct kernel<nan_marking, std::uint32_t> : scalar_kernel<nan_marking, std::uint32_t>
+{
+  static constexpr std::size_t lanes = 4;
+  AK_TOOLKIT_TARGET("sse2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m128 v = _mm_loadu_ps((const float*)p);
+    return unsigned(_mm_movemask_ps(_mm_cmpord_ps(v, v)));
+  }
+};
+
+template <> struct kernel<nan_marking, std::uint64_t> : scalar_kernel<nan_marking, std::uint64_t>
+{
+  static constexpr std::size_t lanes = 2;
+  AK_TOOLKIT_TARGET("sse2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m128d v = _mm_loadu_pd((const double*)p);
+    return unsigned(_mm_movemask_pd(_mm_cmpord_pd(v, v)));
+  }
+};
+
+template <> struct kernel<sign_bit_marking, std::uint8_t> : scalar_kernel<sign_bit_marking, std::uint8_t>
+{
+  static constexpr std::size_t lanes = 16;
+  AK_TOOLKIT_TARGET("sse2") std::uint64_t mask(const unsigned char* p) const
+  { return ~unsigned(_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p))) & 0xFFFFu; }
+};
+
+template <> struct kernel<sign_bit_marking, std::uint16_t> : scalar_kernel<sign_bit_marking, std::uint16_t>
+{
+  static constexpr std::size_t lanes = 8;
+  AK_TOOLKIT_TARGET("sse2") std::uint64_t mask(const unsigned char* p) const
+  { // signed saturation keeps the sign
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    return ~unsigned(_mm_movemask_epi8(_mm_packs_epi16(v, v))) & 0xFFu;
+  }
+};
+
+template <> struct kernel<sign_bit_marking, std::uint32_t> : scalar_kernel<sign_bit_marking, std::uint32_t>
+{
+  static constexpr std::size_t lanes = 4;
+  AK_TOOLKIT_TARGET("sse2") std::uint64_t mask(const unsigned char* p) const
+  { return ~unsigned(_mm_movemask_ps(_mm_loadu_ps((const float*)p))) & 0xFu; }
+};
+
+template <> struct kernel<sign_bit_marking, std::uint64_t> : scalar_kernel<sign_bit_marking, std::uint64_t>
+{
+  static constexpr std::size_t lanes = 2;
+  AK_TOOLKIT_TARGET("sse2") std::uint64_t mask(const unsigned char* p) const
+  { return ~unsigned(_mm_movemask_pd(_mm_loadu_pd((const double*)p))) & 0x3u; }
+};
+
+template <> struct kernel<int_range_marking, word_range<std::uint8_t>> : scalar_kernel<int_range_marking, word_range<std::uint8_t>>
+{
+  static constexpr std::size_t lanes = 16;
+  AK_TOOLKIT_TARGET("sse2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m128i d = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)p), _mm_set1_epi8(char(signed_bias())));
+    return unsigned(_mm_movemask_epi8(_mm_cmpgt_epi8(d, _mm_set1_epi8(char(signed_width())))));
+  }
+};
+
+template <> struct kernel<int_range_marking, word_range<std::uint16_t>> : scalar_kernel<int_range_marking, word_range<std::uint16_t>>
+{
+  static constexpr std::size_t lanes = 8;
+  AK_TOOLKIT_TARGET("sse2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m128i d = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)p), _mm_set1_epi16(short(signed_bias())));
+    __m128i gt = _mm_cmpgt_epi16(d, _mm_set1_epi16(short(signed_width())));
+    return unsigned(_mm_movemask_epi8(_mm_packs_epi16(gt, gt))) & 0xFFu;
+  }
+};
+
+template <> struct kernel<int_range_marking, word_range<std::uint32_t>> : scalar_kernel<int_range_marking, word_range<std::uint32_t>>
+{
+  static constexpr std::size_t lanes = 4;
+  AK_TOOLKIT_TARGET("sse2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m128i d = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)p), _mm_set1_epi32(int(signed_bias())));
+    return unsigned(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(d, _mm_set1_epi32(int(signed_width()))))));
+  }
+};
+
+template <> struct kernel<int_range_marking, word_range<std::uint64_t>> : scalar_kernel<int_range_marking, word_range<std::uint64_t>>
+{ // no 64-bit compare in SSE2
+  static constexpr std::size_t lanes = 2;
+  std::uint64_t mask(const unsigned char* p) const AK_TOOLKIT_NOEXCEPT { return scalar_mask(p, lanes, *this); }
+};
+
+template <typename Marking, typename Word, typename Op>
+AK_TOOLKIT_TARGET("sse2") bool scan(const unsigned char* p, std::size_t n, Word pattern, Op& op)
+{
+  kernel<Marking, Word> k {{pattern}};
+  return scan_blocks(p, n, k, op);
+}
+
+} // namespace sse2_
+
+namespace avx2_ {
+
+template <typename Marking, typename Word> struct kernel;
+
+template <> struct kernel<bit_pattern_marking, std::uint8_t> : scalar_kernel<bit_pattern_marking, std::uint8_t>
+{
+  static constexpr std::size_t lanes = 32;
+  AK_TOOLKIT_TARGET("avx2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), _mm256_set1_epi8(char(pattern)));
+    return ~unsigned(_mm256_movemask_epi8(eq)) & 0xFFFFFFFFu;
+  }
+};
+
+template <> struct kernel<bit_pattern_marking, std::uint16_t> : scalar_kernel<bit_pattern_marking, std::uint16_t>
+{
+  static constexpr std::size_t lanes = 32;
+  AK_TOOLKIT_TARGET("avx2") std::uint64_t mask(const unsigned char* p) const
+  { // pack two registers of 16-bit results into bytes, then undo the per-128-bit-lane interleaving
+    __m256i m = _mm256_set1_epi16(short(pattern));
+    __m256i eq0 = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i*)p), m);
+    __m256i eq1 = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i*)(p + 32)), m);
+    __m256i eq = _mm256_permute4x64_epi64(_mm256_packs_epi16(eq0, eq1), _MM_SHUFFLE(3, 1, 2, 0));
+    return ~unsigned(_mm256_movemask_epi8(eq)) & 0xFFFFFFFFu;
+  }
+};
+
+template <> struct kernel<bit_pattern_marking, std::uint32_t> : scalar_kernel<bit_pattern_marking, std::uint32_t>
+{
+  static constexpr std::size_t lanes = 8;
+  AK_TOOLKIT_TARGET("avx2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)p), _mm256_set1_epi32(int(pattern)));
+    return ~unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(eq))) & 0xFFu;
+  }
+};
+
+template <> struct kernel<bit_pattern_marking, std::uint64_t> : scalar_kernel<bit_pattern_marking, std::uint64_t>
+{
+  static constexpr std::size_t lanes = 4;
+  AK_TOOLKIT_TARGET("avx2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)p), _mm256_set1_epi64x((long long)pattern));
+    return ~unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(eq))) & 0xFu;
+  }
+};
+
+template <> struct kernel<nan_marking, std::uint32_t> : scalar_kernel<nan_marking, std::uint32_t>
+{
+  static constexpr std::size_t lanes = 8;
+  AK_TOOLKIT_TARGET("avx2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m256 v = _mm256_loadu_ps((const float*)p);
+    return unsigned(_mm256_movemask_ps(_mm256_cmp_ps(v, v, _CMP_ORD_Q)));
+  }
+};
+
+template <> struct kernel<nan_marking, std::uint64_t> : scalar_kernel<nan_marking, std::uint64_t>
+{
+  static constexpr std::size_t lanes = 4;
+  AK_TOOLKIT_TARGET("avx2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m256d v = _mm256_loadu_pd((const double*)p);
+    return unsigned(_mm256_movemask_pd(_mm256_cmp_pd(v, v, _CMP_ORD_Q)));
+  }
+};
+
+template <> struct kernel<sign_bit_marking, std::uint8_t> : scalar_kernel<sign_bit_marking, std::uint8_t>
+{
+  static constexpr std::size_t lanes = 32;
+  AK_TOOLKIT_TARGET("avx2") std::uint64_t mask(const unsigned char* p) const
+  { return ~unsigned(_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)p))) & 0xFFFFFFFFu; }
+};
+
+template <> struct kernel<sign_bit_marking, std::uint16_t> : scalar_kernel<sign_bit_marking, std::uint16_t>
+{
+  static constexpr std::size_t lanes = 32;
+  AK_TOOLKIT_TARGET("avx2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m256i v0 = _mm256_loadu_si256((const __m256i*)p);
+    __m256i v1 = _mm256_loadu_si256((const __m256i*)(p + 32));
+    __m256i v = _mm256_permute4x64_epi64(_mm256_packs_epi16(v0, v1), _MM_SHUFFLE(3, 1, 2, 0));
+    return ~unsigned(_mm256_movemask_epi8(v)) & 0xFFFFFFFFu;
+  }
+};
+
+template <> struct kernel<sign_bit_marking, std::uint32_t> : scalar_kernel<sign_bit_marking, std::uint32_t>
+{
+  static constexpr std::size_t lanes = 8;
+  AK_TOOLKIT_TARGET("avx2") std::uint64_t mask(const unsigned char* p) const
+  { return ~unsigned(_mm256_movemask_ps(_mm256_loadu_ps((const float*)p))) & 0xFFu; }
+};
+
+template <> struct kernel<sign_bit_marking, std::uint64_t> : scalar_kernel<sign_bit_marking, std::uint64_t>
+{
+  static constexpr std::size_t lanes = 4;
+  AK_TOOLKIT_TARGET("avx2") std::uint64_t mask(const unsigned char* p) const
+  { return ~unsigned(_mm256_movemask_pd(_mm256_loadu_pd((const double*)p))) & 0xFu; }
+};
+
+template <> struct kernel<int_range_marking, word_range<std::uint8_t>> : scalar_kernel<int_range_marking, word_range<std::uint8_t>>
+{
+  static constexpr std::size_t lanes = 32;
+  AK_TOOLKIT_TARGET("avx2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m256i d = _mm256_sub_epi8(_mm256_loadu_si256((const __m256i*)p), _mm256_set1_epi8(char(signed_bias())));
+    return unsigned(_mm256_movemask_epi8(_mm256_cmpgt_epi8(d, _mm256_set1_epi8(char(signed_width())))));
+  }
+};
+
+template <> struct kernel<int_range_marking, word_range<std::uint16_t>> : scalar_kernel<int_range_marking, word_range<std::uint16_t>>
+{
+  static constexpr std::size_t lanes = 32;
+  AK_TOOLKIT_TARGET("avx2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m256i bias = _mm256_set1_epi16(short(signed_bias())), w = _mm256_set1_epi16(short(signed_width()));
+    __m256i gt0 = _mm256_cmpgt_epi16(_mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)p), bias), w);
+    __m256i gt1 = _mm256_cmpgt_epi16(_mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(p + 32)), bias), w);
+    __m256i gt = _mm256_permute4x64_epi64(_mm256_packs_epi16(gt0, gt1), _MM_SHUFFLE(3, 1, 2, 0));
+    return unsigned(_mm256_movemask_epi8(gt));
+  }
+};
+
+template <> struct kernel<int_range_marking, word_range<std::uint32_t>> : scalar_kernel<int_range_marking, word_range<std::uint32_t>>
+{
+  static constexpr std::size_t lanes = 8;
+  AK_TOOLKIT_TARGET("avx2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m256i d = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)p), _mm256_set1_epi32(int(signed_bias())));
+    return unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(d, _mm256_set1_epi32(int(signed_width()))))));
+  }
+};
+
+template <> struct kernel<int_range_marking, word_range<std::uint64_t>> : scalar_kernel<int_range_marking, word_range<std::uint64_t>>
+{
+  static constexpr std::size_t lanes = 4;
+  AK_TOOLKIT_TARGET("avx2") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m256i d = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i*)p), _mm256_set1_epi64x((long long)signed_bias()));
+    return unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(d, _mm256_set1_epi64x((long long)signed_width())))));
+  }
+};
+
+template <typename Marking, typename Word, typename Op>
+AK_TOOLKIT_TARGET("avx2") bool scan(const unsigned char* p, std::size_t n, Word pattern, Op& op)
+{
+  kernel<Marking, Word> k {{pattern}};
+  return scan_blocks(p, n, k, op);
+}
+
+} // namespace avx2_
+
+namespace avx512_ {
+
+template <typename Marking, typename Word> struct kernel;
+
+template <> struct kernel<bit_pattern_marking, std::uint8_t> : scalar_kernel<bit_pattern_marking, std::uint8_t>
+{
+  static constexpr std::size_t lanes = 64;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") std::uint64_t mask(const unsigned char* p) const
+  { return _mm512_cmpneq_epi8_mask(_mm512_loadu_si512(p), _mm512_set1_epi8(char(pattern))); }
+};
+
+template <> struct kernel<bit_pattern_marking, std::uint16_t> : scalar_kernel<bit_pattern_marking, std::uint16_t>
+{
+  static constexpr std::size_t lanes = 32;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") std::uint64_t mask(const unsigned char* p) const
+  { return _mm512_cmpneq_epi16_mask(_mm512_loadu_si512(p), _mm512_set1_epi16(short(pattern))); }
+};
+
+template <> struct kernel<bit_pattern_marking, std::uint32_t> : scalar_kernel<bit_pattern_marking, std::uint32_t>
+{
+  static constexpr std::size_t lanes = 16;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") std::uint64_t mask(const unsigned char* p) const
+  { return _mm512_cmpneq_epi32_mask(_mm512_loadu_si512(p), _mm512_set1_epi32(int(pattern))); }
+};
+
+template <> struct kernel<bit_pattern_marking, std::uint64_t> : scalar_kernel<bit_pattern_marking, std::uint64_t>
+{
+  static constexpr std::size_t lanes = 8;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") std::uint64_t mask(const unsigned char* p) const
+  { return _mm512_cmpneq_epi64_mask(_mm512_loadu_si512(p), _mm512_set1_epi64((long long)pattern)); }
+};
+
+template <> struct kernel<nan_marking, std::uint32_t> : scalar_kernel<nan_marking, std::uint32_t>
+{
+  static constexpr std::size_t lanes = 16;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m512 v = _mm512_loadu_ps(p);
+    return _mm512_cmp_ps_mask(v, v, _CMP_ORD_Q);
+  }
+};
+
+template <> struct kernel<nan_marking, std::uint64_t> : scalar_kernel<nan_marking, std::uint64_t>
+{
+  static constexpr std::size_t lanes = 8;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m512d v = _mm512_loadu_pd(p);
+    return _mm512_cmp_pd_mask(v, v, _CMP_ORD_Q);
+  }
+};
+
+template <> struct kernel<sign_bit_marking, std::uint8_t> : scalar_kernel<sign_bit_marking, std::uint8_t>
+{
+  static constexpr std::size_t lanes = 64;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") std::uint64_t mask(const unsigned char* p) const
+  { return _mm512_cmpge_epi8_mask(_mm512_loadu_si512(p), _mm512_setzero_si512()); }
+};
+
+template <> struct kernel<sign_bit_marking, std::uint16_t> : scalar_kernel<sign_bit_marking, std::uint16_t>
+{
+  static constexpr std::size_t lanes = 32;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") std::uint64_t mask(const unsigned char* p) const
+  { return _mm512_cmpge_epi16_mask(_mm512_loadu_si512(p), _mm512_setzero_si512()); }
+};
+
+template <> struct kernel<sign_bit_marking, std::uint32_t> : scalar_kernel<sign_bit_marking, std::uint32_t>
+{
+  static constexpr std::size_t lanes = 16;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") std::uint64_t mask(const unsigned char* p) const
+  { return _mm512_cmpge_epi32_mask(_mm512_loadu_si512(p), _mm512_setzero_si512()); }
+};
+
+template <> struct kernel<sign_bit_marking, std::uint64_t> : scalar_kernel<sign_bit_marking, std::uint64_t>
+{
+  static constexpr std::size_t lanes = 8;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") std::uint64_t mask(const unsigned char* p) const
+  { return _mm512_cmpge_epi64_mask(_mm512_loadu_si512(p), _mm512_setzero_si512()); }
+};
+
+template <> struct kernel<int_range_marking, word_range<std::uint8_t>> : scalar_kernel<int_range_marking, word_range<std::uint8_t>>
+{
+  static constexpr std::size_t lanes = 64;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m512i d = _mm512_sub_epi8(_mm512_loadu_si512(p), _mm512_set1_epi8(char(pattern.first)));
+    return _mm512_cmpgt_epu8_mask(d, _mm512_set1_epi8(char(pattern.width)));
+  }
+};
+
+template <> struct kernel<int_range_marking, word_range<std::uint16_t>> : scalar_kernel<int_range_marking, word_range<std::uint16_t>>
+{
+  static constexpr std::size_t lanes = 32;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m512i d = _mm512_sub_epi16(_mm512_loadu_si512(p), _mm512_set1_epi16(short(pattern.first)));
+    return _mm512_cmpgt_epu16_mask(d, _mm512_set1_epi16(short(pattern.width)));
+  }
+};
+
+template <> struct kernel<int_range_marking, word_range<std::uint32_t>> : scalar_kernel<int_range_marking, word_range<std::uint32_t>>
+{
+  static constexpr std::size_t lanes = 16;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m512i d = _mm512_sub_epi32(_mm512_loadu_si512(p), _mm512_set1_epi32(int(pattern.first)));
+    return _mm512_cmpgt_epu32_mask(d, _mm512_set1_epi32(int(pattern.width)));
+  }
+};
+
+template <> struct kernel<int_range_marking, word_range<std::uint64_t>> : scalar_kernel<int_range_marking, word_range<std::uint64_t>>
+{
+  static constexpr std::size_t lanes = 8;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") std::uint64_t mask(const unsigned char* p) const
+  {
+    __m512i d = _mm512_sub_epi64(_mm512_loadu_si512(p), _mm512_set1_epi64((long long)pattern.first));
+    return _mm512_cmpgt_epu64_mask(d, _mm512_set1_epi64((long long)pattern.width));
+  }
+};
+
+template <typename Marking, typename Word, typename Op>
+AK_TOOLKIT_TARGET("avx512f,avx512bw") bool scan(const unsigned char* p, std::size_t n, Word pattern, Op& op)
+{
+  kernel<Marking, Word> k {{pattern}};
+  return scan_blocks(p, n, k, op);
+}
+
+} // namespace avx512_
+
+#endif // AK_TOOLKIT_MARKABLE_X86_SIMD
+
+// Policies without a known marking: one has_value() call per element.
+template <typename MP, typename Op>
+bool scan_generic(const markable<MP>* data, std::size_t n, Op& op)
+{
+  for (std::size_t i = 0; i < n; i += 64)
+  {
+    std::size_t count = n - i < 64 ? n - i : 64;
+    std::uint64_t m = 0;
+    for (std::size_t j = 0; j != count; ++j)
+      m |= std::uint64_t(data[i + j].has_value()) << j;
+    if (!op(i, m, count))
+      return false;
+  }
+  return true;
+}
+
+template <typename MP, typename Op>
+bool scan_present(simd_isa isa, const markable<MP>* data, std::size_t n, Op op)
+{
+  typedef bulk_traits<MP> traits;
+  if constexpr (traits::vectorizable)
+  {
+    typedef typename traits::marking marking;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    switch (isa)
+    {
+#if defined AK_TOOLKIT_MARKABLE_X86_SIMD
+      case simd_isa::avx512: return avx512_::scan<marking>(p, n, traits::pattern(), op);
+      case simd_isa::avx2:   return avx2_::scan<marking>(p, n, traits::pattern(), op);
+      case simd_isa::sse2:   return sse2_::scan<marking>(p, n, traits::pattern(), op);
+#endif
+      default:               return scan_scalar<marking>(p, n, traits::pattern(), op);
+    }
+  }
+  else
+  {
+    (void)isa;
+    return scan_generic(data, n, op);
+  }
+}
+
+template <typename MP>
+std::size_t count_present(simd_isa isa, const markable<MP>* data, std::size_t n)
+{
+  std::size_t count = 0;
+  scan_present(isa, data, n, [&count](std::size_t, std::uint64_t m, std::size_t) {
+    count += std::popcount(m);
+    return true;
+  });
+  return count;
+}
+
+template <typename MP>
+std::size_t find_first_present(simd_isa isa, const markable<MP>* data, std::size_t n)
+{
+  std::size_t pos = n;
+  scan_present(isa, data, n, [&pos](std::size_t i, std::uint64_t m, std::size_t) {
+    if (m == 0)
+      return true;
+    pos = i + std::countr_zero(m);
+    return false;
+  });
+  return pos;
+}
+
+// Calls op(first_index, nan_mask, count) for consecutive blocks of raw IEEE values of type FPT, with
+// one bit per NaN in nan_mask, until op returns false. Returns false iff op stopped the scan.
+template <typename FPT, typename Op>
+bool scan_nans(simd_isa isa, const unsigned char* p, std::size_t n, Op op)
+{
+  typedef typename uint_of_size<sizeof(FPT)>::type word;
+  const word infinity = std::bit_cast<word>(std::numeric_limits<FPT>::infinity());
+  auto nan_op = [&op](std::size_t i, std::uint64_t present, std::size_t count) {
+    std::uint64_t all = count == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << count) - 1;
+    return op(i, ~present & all, count);
+  };
+  switch (isa)
+  {
+#if defined AK_TOOLKIT_MARKABLE_X86_SIMD
+    case simd_isa::avx512: return avx512_::scan<nan_marking>(p, n, infinity, nan_op);
+    case simd_isa::avx2:   return avx2_::scan<nan_marking>(p, n, infinity, nan_op);
+    case simd_isa::sse2:   return sse2_::scan<nan_marking>(p, n, infinity, nan_op);
+#endif
+    default:               return scan_scalar<nan_marking>(p, n, infinity, nan_op);
+  }
+}
+
+// Policies marking a floating-point type by one bit pattern, such as mark_fp_nan_payload:
+// there the NaNs other than the marked value are values.
+template <typename MP>
+constexpr bool has_nan_values()
+{
+  return std::is_floating_point<typename MP::representation_type>::value
+      && std::is_same<typename marking_of<MP>::type, bit_pattern_marking>::value
+      && bulk_traits<MP>::vectorizable;
+}
+
+// Calls f(index, is_marked) for every NaN in data[0..n) until f returns false.
+template <typename MP, typename F>
+void for_each_nan(simd_isa isa, const markable<MP>* data, std::size_t n, F f)
+{
+  typedef bulk_traits<MP> traits;
+  typedef typename traits::word word;
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  const word pattern = traits::pattern();
+  scan_nans<typename MP::representation_type>(isa, p, n, [&](std::size_t i, std::uint64_t m, std::size_t) {
+    for (; m != 0; m &= m - 1)
+    {
+      std::size_t j = i + std::countr_zero(m);
+      word w;
+      std::memcpy(&w, p + j * sizeof(word), sizeof(word));
+      if (!f(j, w == pattern))
+        return false;
+    }
+    return true;
+  });
+}
+
+inline void store_bitmap_word(std::uint8_t* out, std::uint64_t word, std::size_t bytes) AK_TOOLKIT_NOEXCEPT
+{
+  if constexpr (std::endian::native == std::endian::little)
+    std::memcpy(out, &word, bytes);
+  else
+    for (std::size_t b = 0; b != bytes; ++b)
+      out[b] = std::uint8_t(word >> (8 * b));
+}
+
+// Collects the block masks produced by a scan into a bitmap, least significant bit first.
+class bitmap_writer
+{
+  std::uint8_t* _bitmap;
+  std::uint64_t _word = 0;
+  std::size_t _set_bits = 0;
+
+public:
+  explicit bitmap_writer(std::uint8_t* bitmap) AK_TOOLKIT_NOEXCEPT : _bitmap(bitmap) {}
+
+  void put(std::size_t i, std::uint64_t m, std::size_t count) AK_TOOLKIT_NOEXCEPT
+  {
+    _word |= m << (i % 64);
+    _set_bits += std::popcount(m);
+    std::size_t end = i + count;
+    if (end % 64 == 0)
+    {
+      store_bitmap_word(_bitmap + (end - 64) / 8, _word, 8);
+      _word = 0;
+    }
+  }
+
+  // Flushes the last partial word of an n-bit bitmap; returns the number of bits set.
+  std::size_t finish(std::size_t n) AK_TOOLKIT_NOEXCEPT
+  {
+    if (n % 64 != 0)
+      store_bitmap_word(_bitmap + (n - n % 64) / 8, _word, (n % 64 + 7) / 8);
+    return _set_bits;
+  }
+};
+
+template <typename MP>
+std::size_t presence_bitmap(simd_isa isa, const markable<MP>* data, std::size_t n, std::uint8_t* bitmap)
+{
+  bitmap_writer writer(bitmap);
+  scan_present(isa, data, n, [&writer](std::size_t i, std::uint64_t m, std::size_t count) {
+    writer.put(i, m, count);
+    return true;
+  });
+  return writer.finish(n);
+}
+
+// Compaction copies the raw words of the present values, so it needs policies that store the value
+// with its own bits (mark_int, mark_fp_nan, mark_enum, mark_bool and the like). Others fall back
+// to value() on each present element.
+template <typename MP>
+constexpr bool is_bitwise_compactable()
+{
+  if constexpr (bulk_traits<MP>::vectorizable)
+  {
+    typedef typename MP::storage_type storage_type;
+    typedef typename MP::value_type value_type;
+    return has_select_friendly_storage<MP>::value
+        && sizeof(value_type) == sizeof(storage_type)
+        && std::is_floating_point<value_type>::value == std::is_floating_point<storage_type>::value;
+  }
+  else
+    return false;
+}
+
+// Appends the present ones of `count` raw words at p + first (mask m) to out + k, and their indices
+// to idx + k if Index; returns the new k. One iteration per present value: no branch depends on
+// the state of a single element.
+template <typename Word, bool Index>
+AK_TOOLKIT_FORCE_INLINE std::size_t compact_block(const unsigned char* p, std::size_t first, std::uint64_t m, std::size_t count,
+                                                  unsigned char* out, std::uint32_t* idx, std::size_t k)
+{
+  if (m == (count == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << count) - 1))
+  {
+    std::memcpy(out + k * sizeof(Word), p + first * sizeof(Word), count * sizeof(Word));
+    if constexpr (Index)
+      for (std::size_t j = 0; j != count; ++j)
+        idx[k + j] = std::uint32_t(first + j);
+    return k + count;
+  }
+  for (; m != 0; m &= m - 1, ++k)
+  {
+    std::size_t j = first + std::countr_zero(m);
+    std::memcpy(out + k * sizeof(Word), p + j * sizeof(Word), sizeof(Word));
+    if constexpr (Index)
+      idx[k] = std::uint32_t(j);
+  }
+  return k;
+}
+
+#if defined AK_TOOLKIT_MARKABLE_X86_SIMD
+
+namespace avx512_ {
+
+// Writes the values of a chunk of 16 words of 1, 2 or 4 bytes (8 words of 8 bytes) at p + i with
+// presence mask m to out + k with vpcompress, and their indices to idx + k. Narrow words are
+// widened to 32 bits, so that AVX-512F suffices. Masked stores write exactly popcount(m) values.
+template <typename Word, bool Index>
+AK_TOOLKIT_FORCE_INLINE AK_TOOLKIT_TARGET("avx512f,avx512bw")
+void compress_chunk(const unsigned char* p, std::size_t i, unsigned m, unsigned char* out, std::uint32_t* idx, std::size_t k)
+{
+  const __mmask16 all = 0xFFFF, written = __mmask16((1u << std::popcount(m)) - 1);
+  const unsigned char* in = p + i * sizeof(Word);
+  unsigned char* to = out + k * sizeof(Word);
+  if constexpr (sizeof(Word) == 8)
+    _mm512_mask_storeu_epi64(to, __mmask8(written), _mm512_maskz_compress_epi64(__mmask8(m), _mm512_loadu_si512(in)));
+  else if constexpr (sizeof(Word) == 4)
+    _mm512_mask_storeu_epi32(to, written, _mm512_maskz_compress_epi32(__mmask16(m), _mm512_loadu_si512(in)));
+  else if constexpr (sizeof(Word) == 2)
+    _mm512_mask_cvtepi32_storeu_epi16(to, written, _mm512_maskz_compress_epi32(__mmask16(m),
+      _mm512_maskz_cvtepu16_epi32(all, _mm256_loadu_si256((const __m256i*)in))));
+  else
+    _mm512_mask_cvtepi32_storeu_epi8(to, written, _mm512_maskz_compress_epi32(__mmask16(m),
+      _mm512_maskz_cvtepu8_epi32(all, _mm_loadu_si128((const __m128i*)in))));
+
+  if constexpr (Index)
+  {
+    const __m512i ids = _mm512_add_epi32(_mm512_set1_epi32(int(i)), _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    _mm512_mask_storeu_epi32(idx + k, written, _mm512_maskz_compress_epi32(__mmask16(m), ids));
+  }
+}
+
+template <typename Marking, typename Pattern, bool Index>
+AK_TOOLKIT_TARGET("avx512f,avx512bw") std::size_t compact(const unsigned char* p, std::size_t n, Pattern pattern, unsigned char* out, std::uint32_t* idx)
+{
+  typedef kernel<Marking, Pattern> K;
+  typedef typename K::word word;
+  constexpr std::size_t chunk = sizeof(word) == 8 ? 8 : 16;
+  K k {{pattern}};
+  std::size_t i = 0, written = 0;
+  for (; i + K::lanes <= n; i += K::lanes)
+  {
+    std::uint64_t m = k.mask(p + i * K::width);
+    for (std::size_t c = 0; c != K::lanes; c += chunk, m >>= chunk)
+    {
+      unsigned chunk_mask = unsigned(m & ((1u << chunk) - 1));
+      compress_chunk<word, Index>(p, i + c, chunk_mask, out, idx, written);
+      written += std::popcount(chunk_mask);
+    }
+  }
+  return i == n ? written : compact_block<word, Index>(p, i, scalar_mask(p + i * K::width, n - i, k), n - i, out, idx, written);
+}
+
+} // namespace avx512_
+
+namespace avx2_ {
+
+// compress_table[m]: the positions of the bits set in the 8-bit m, in order, one per byte.
+inline constexpr std::array<std::uint64_t, 256> compress_table = [] {
+  std::array<std::uint64_t, 256> t {};
+  for (unsigned m = 0; m != 256; ++m)
+    for (unsigned b = 0, k = 0; b != 8; ++b)
+      if (m & (1u << b))
+        t[m] |= std::uint64_t(b) << (8 * k++);
+  return t;
+}();
+
+// Writes the values of a chunk of 8 words of 4 bytes (4 words of 8 bytes) at p + i with presence
+// mask m to out + k, permuted by an entry of compress_table, and their indices to idx + k.
+// Masked stores write exactly popcount(m) values.
+template <typename Word, bool Index>
+AK_TOOLKIT_FORCE_INLINE AK_TOOLKIT_TARGET("avx2")
+void compress_chunk(const unsigned char* p, std::size_t i, unsigned m, unsigned char* out, std::uint32_t* idx, std::size_t k)
+{
+  static_assert(sizeof(Word) == 4 || sizeof(Word) == 8, "vpermd moves 32-bit lanes");
+  // a 64-bit word is a pair of 32-bit lanes: its mask bit is doubled
+  const unsigned lanes32 = sizeof(Word) == 8 ? (m & 1) * 3 | (m & 2) * 6 | (m & 4) * 12 | (m & 8) * 24 : m;
+  const __m256i iota = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i perm = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128((long long)compress_table[lanes32]));
+  const __m256i written = _mm256_cmpgt_epi32(_mm256_set1_epi32(std::popcount(lanes32)), iota);
+  const __m256i v = _mm256_loadu_si256((const __m256i*)(p + i * sizeof(Word)));
+  _mm256_maskstore_epi32((int*)(out + k * sizeof(Word)), written, _mm256_permutevar8x32_epi32(v, perm));
+
+  if constexpr (Index && sizeof(Word) == 4)
+    _mm256_maskstore_epi32((int*)(idx + k), written, _mm256_add_epi32(_mm256_set1_epi32(int(i)), perm));
+  else if constexpr (Index)
+  {
+    // value j comes from the 32-bit lanes perm[2j] and perm[2j] + 1
+    __m128i ids = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(_mm256_srli_epi32(perm, 1), _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0)));
+    __m128i written_ids = _mm_cmpgt_epi32(_mm_set1_epi32(std::popcount(m)), _mm_setr_epi32(0, 1, 2, 3));
+    _mm_maskstore_epi32((int*)(idx + k), written_ids, _mm_add_epi32(_mm_set1_epi32(int(i)), ids));
+  }
+}
+
+// Words of 1 and 2 bytes, which have no 8- or 16-bit lane permute in AVX2, are compacted from
+// the vector masks one present value at a time.
+template <typename Marking, typename Pattern, bool Index>
+AK_TOOLKIT_TARGET("avx2") std::size_t compact(const unsigned char* p, std::size_t n, Pattern pattern, unsigned char* out, std::uint32_t* idx)
+{
+  typedef kernel<Marking, Pattern> K;
+  typedef typename K::word word;
+  K k {{pattern}};
+  std::size_t i = 0, written = 0;
+  for (; i + K::lanes <= n; i += K::lanes)
+  {
+    std::uint64_t m = k.mask(p + i * K::width);
+    if constexpr (sizeof(word) >= 4)
+    {
+      static_assert(K::lanes * K::width == 32, "one chunk per block");
+      compress_chunk<word, Index>(p, i, unsigned(m), out, idx, written);
+      written += std::popcount(m);
+    }
+    else
+      written = compact_block<word, Index>(p, i, m, K::lanes, out, idx, written);
+  }
+  return i == n ? written : compact_block<word, Index>(p, i, scalar_mask(p + i * K::width, n - i, k), n - i, out, idx, written);
+}
+
+} // namespace avx2_
+
+#endif // AK_TOOLKIT_MARKABLE_X86_SIMD
+
+template <typename MP, bool Index>
+std::size_t compact_present(simd_isa isa, const markable<MP>* data, std::size_t n, typename MP::value_type* out, std::uint32_t* idx)
+{
+  AK_TOOLKIT_ASSERT(n <= std::size_t(std::numeric_limits<std::uint32_t>::max()) + 1);
+  std::size_t k = 0;
+  if constexpr (is_bitwise_compactable<MP>())
+  {
+    typedef bulk_traits<MP> traits;
+    typedef typename traits::marking marking;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    unsigned char* o = reinterpret_cast<unsigned char*>(out);
+    switch (isa)
+    {
+#if defined AK_TOOLKIT_MARKABLE_X86_SIMD
+      case simd_isa::avx512: return avx512_::compact<marking, decltype(traits::pattern()), Index>(p, n, traits::pattern(), o, idx);
+      case simd_isa::avx2:   return avx2_::compact<marking, decltype(traits::pattern()), Index>(p, n, traits::pattern(), o, idx);
+#endif
+      default:
+      {
+          // the masks of SSE2 blocks are gathered into words of 64 elements, so that the loop over
+          // the present values does not end (and mispredict) every 2 to 16 elements
+          std::uint64_t word = 0;
+          scan_present(isa, data, n, [&](std::size_t i, std::uint64_t m, std::size_t count) {
+            word |= m << (i % 64);
+            const std::size_t end = i + count;
+            if (end % 64 == 0 || end == n)
+            {
+              const std::size_t first = (end - 1) / 64 * 64;
+              k = compact_block<typename traits::word, Index>(p, first, word, end - first, o, idx, k);
+              word = 0;
+            }
+            return true;
+          });
+      }
+    }
+  }
+  else
+  {
+    scan_present(isa, data, n, [&](std::size_t i, std::uint64_t m, std::size_t) {
+      for (; m != 0; m &= m - 1, ++k)
+      {
+        std::size_t j = i + std::countr_zero(m);
+        out[k] = data[j].value();
+        if constexpr (Index)
+          idx[k] = std::uint32_t(j);
+      }
+      return true;
+    });
+  }
+  return k;
+}
+
+} // namespace detail_
+
+// A contiguous range (vector, array, span, markable_column...) of markable<MP> objects.
+template <typename R>
+concept markable_contiguous_range =
+  std::ranges::contiguous_range<R> && std::ranges::sized_range<R> &&
+  requires { typename detail_::markable_policy_of<std::remove_cv_t<std::ranges::range_value_t<R>>>::type; };
+
+namespace detail_ {
+
+template <typename R>
+using range_policy_t = typename markable_policy_of<std::remove_cv_t<std::ranges::range_value_t<R>>>::type;
+
+} // namespace detail_
+
+// Returns the number of elements that have a value.
+template <markable_contiguous_range R>
+std::size_t count_present(R&& r)
+{
+  return detail_::count_present(supported_simd_isa(), std::ranges::data(r), std::ranges::size(r));
+}
+
+// Returns the index of the first element that has a value, or the size of the range if there is none.
+template <markable_contiguous_range R>
+std::size_t find_first_present(R&& r)
+{
+  return detail_::find_first_present(supported_simd_isa(), std::ranges::data(r), std::ranges::size(r));
+}
+
+// Writes (size + 7) / 8 bytes to `bitmap`: bit i (least significant bit first) is set iff element i has a value.
+// This is the layout of an Arrow validity bitmap. Returns the number of elements that have a value.
+template <markable_contiguous_range R>
+std::size_t presence_bitmap(R&& r, std::uint8_t* bitmap)
+{
+  return detail_::presence_bitmap(supported_simd_isa(), std::ranges::data(r), std::ranges::size(r), bitmap);
+}
+
+// Copies the values of the elements that have a value, in order, to `out`, and their indices to
+// `idx_out` unless it is null; returns their number. `out` and `idx_out` need room for
+// count_present(r) elements only, and the range must have at most 2^32 elements. For mark_int,
+// mark_fp_nan, mark_enum, mark_bool and the like the values are moved with vpcompress (AVX-512),
+// a shuffle table (AVX2) or one iteration per present value, with no branch per element.
+template <markable_contiguous_range R>
+std::size_t compact_present(R&& r, typename detail_::range_policy_t<R>::value_type* out, std::uint32_t* idx_out = nullptr)
+{
+  typedef detail_::range_policy_t<R> MP;
+  if (idx_out)
+    return detail_::compact_present<MP, true>(supported_simd_isa(), std::ranges::data(r), std::ranges::size(r), out, idx_out);
+  else
+    return detail_::compact_present<MP, false>(supported_simd_isa(), std::ranges::data(r), std::ranges::size(r), out, nullptr);
+}
+
+// The inverse of compact_present: marks every element of r, then assigns values[k] to the element
+// idx[k], for k in [0, count). Marking is a memset when repeated_marked_byte allows.
+template <markable_contiguous_range R>
+void expand_present(R&& r, const typename detail_::range_policy_t<R>::value_type* values, const std::uint32_t* idx, std::size_t count)
+{
+  typedef markable<detail_::range_policy_t<R>> element;
+  element* data = std::ranges::data(r);
+  const std::size_t n = std::ranges::size(r);
+  fill_marked(data, n);
+  for (std::size_t k = 0; k != count; ++k)
+    data[AK_TOOLKIT_ASSERTED_EXPRESSION(idx[k] < n, idx[k])] = element(values[k]);
+}
+
+// Numbers of marked elements and of NaN values in a range of markable<mark_fp_nan_payload<FPT, Payload>>.
+struct nan_counts
+{
+  std::size_t marked = 0;
+  std::size_t computed = 0; // NaNs that are values, e.g. results of 0.0 / 0.0
+};
+
+// Counts the marked elements and the NaN values in one pass; the NaNs are found many at a time.
+template <markable_contiguous_range R>
+  requires (detail_::has_nan_values<detail_::range_policy_t<R>>())
+nan_counts count_nans(R&& r)
+{
+  nan_counts c;
+  detail_::for_each_nan(supported_simd_isa(), std::ranges::data(r), std::ranges::size(r), [&c](std::size_t, bool marked) {
+    ++(marked ? c.marked : c.computed);
+    return true;
+  });
+  return c;
+}
+
+// Returns the index of the first NaN value (not the marked value), or the size of the range if there is none.
+template <markable_contiguous_range R>
+  requires (detail_::has_nan_values<detail_::range_policy_t<R>>())
+std::size_t find_first_computed_nan(R&& r)
+{
+  std::size_t pos = std::ranges::size(r);
+  detail_::for_each_nan(supported_simd_isa(), std::ranges::data(r), pos, [&pos](std::size_t i, bool marked) {
+    if (marked)
+      return true;
+    pos = i;
+    return false;
+  });
+  return pos;
+}
+
+// Array-level counterparts of markable's value_or, transform, and_then and or_else; element i of
+// `r` produces out[i]. For policies storing a scalar (mark_int, mark_fp_nan, mark_enum, mark_bool)
+// the loop bodies are branch-free selects, which compilers vectorize.
+
+template <markable_contiguous_range R>
+void value_or_each(R&& r, const typename detail_::range_policy_t<R>::value_type& fallback,
+                   typename detail_::range_policy_t<R>::value_type* out)
+{
+  auto* in = std::ranges::data(r);
+  for (std::size_t i = 0, n = std::ranges::size(r); i != n; ++i)
+    out[i] = in[i].value_or(fallback);
+}
+
+namespace detail_ {
+
+// transform_each may invoke f on every element, with value_type() standing in for the marked ones,
+// when both value types are numbers or enumerations. f never sees the mark itself (a null or
+// misaligned pointer, INT_MIN), and the loop needs no branch.
+template <typename MP>
+struct has_eager_transform
+  : std::integral_constant<bool, has_select_friendly_storage<MP>::value
+                              && (std::is_arithmetic<typename MP::value_type>::value || std::is_enum<typename MP::value_type>::value)> {};
+
+} // namespace detail_
+
+// For policies storing a number or an enumeration, f is also invoked with value_type() for the
+// marked elements (its result is discarded), so that no branch is needed: f(value_type()) must be
+// valid. Other policies, such as mark_pointer, invoke f only for the elements that have a value.
+template <typename MP2 = void, markable_contiguous_range R, typename F>
+void transform_each(R&& r, markable<typename std::conditional<std::is_void<MP2>::value, detail_::range_policy_t<R>, MP2>::type>* out, F f)
+{
+  typedef detail_::range_policy_t<R> MP;
+  typedef typename std::conditional<std::is_void<MP2>::value, MP, MP2>::type result_policy;
+  typedef markable<result_policy> result_type;
+
+  auto* in = std::ranges::data(r);
+  std::size_t n = std::ranges::size(r);
+  if constexpr (detail_::has_eager_transform<MP>::value && detail_::has_eager_transform<result_policy>::value)
+  {
+    typedef typename MP::value_type value_type;
+    for (std::size_t i = 0; i != n; ++i)
+    {
+      const value_type x = in[i].value_or(value_type());
+      const typename result_policy::value_type y = std::invoke(f, x);
+      out[i] = in[i].has_value() ? result_type(y) : result_type();
+    }
+  }
+  else
+  {
+    for (std::size_t i = 0; i != n; ++i)
+      out[i] = in[i].template transform<result_policy>(f);
+  }
+}
+
+template <markable_contiguous_range R, typename Out, typename F>
+void and_then_each(R&& r, Out* out, F f)
+{
+  auto* in = std::ranges::data(r);
+  for (std::size_t i = 0, n = std::ranges::size(r); i != n; ++i)
+    out[i] = in[i].and_then(f);
+}
+
+template <markable_contiguous_range R, typename F>
+void or_else_each(R&& r, markable<detail_::range_policy_t<R>>* out, F f)
+{
+  auto* in = std::ranges::data(r);
+  for (std::size_t i = 0, n = std::ranges::size(r); i != n; ++i)
+    out[i] = in[i].or_else(f);
+}
+
+namespace detail_ {
+
+// Radix sort applies to policies whose markable<MP> is an integral or IEEE floating-point
+// storage_type of 1, 2, 4 or 8 bytes (mark_int, mark_enum, mark_bool, mark_fp_nan), unless
+// floating-point values are stored in integers, which do not sort like them.
+template <typename MP>
+constexpr bool is_radix_sortable()
+{
+  typedef typename MP::storage_type storage_type;
+  return (std::is_integral<storage_type>::value || (std::is_floating_point<storage_type>::value && std::numeric_limits<storage_type>::is_iec559))
+      && (!std::is_floating_point<typename MP::value_type>::value || std::is_same<typename MP::value_type, storage_type>::value)
+      && sizeof(markable<MP>) == sizeof(storage_type)
+      && (sizeof(storage_type) == 1 || sizeof(storage_type) == 2 || sizeof(storage_type) == 4 || sizeof(storage_type) == 8);
+}
+
+// Maps the bits of a storage_type to an unsigned key with the same order, and back.
+template <typename T>
+struct radix_key
+{
+  typedef typename uint_of_size<sizeof(T)>::type word;
+  static constexpr word sign = word(word(1) << (8 * sizeof(T) - 1));
+
+  static word encode(word w) AK_TOOLKIT_NOEXCEPT
+  {
+    if constexpr (std::is_floating_point<T>::value)
+      return (w & sign) ? word(~w) : word(w | sign);
+    else if constexpr (std::is_signed<T>::value)
+      return word(w ^ sign);
+    else
+      return w;
+  }
+
+  static word decode(word k) AK_TOOLKIT_NOEXCEPT
+  {
+    if constexpr (std::is_floating_point<T>::value)
+      return (k & sign) ? word(k ^ sign) : word(~k);
+    else if constexpr (std::is_signed<T>::value)
+      return word(k ^ sign);
+    else
+      return k;
+  }
+};
+
+template <typename Word>
+Word load_word(const unsigned char* p, std::size_t i) AK_TOOLKIT_NOEXCEPT
+{
+  Word w;
+  std::memcpy(&w, p + i * sizeof(Word), sizeof(Word));
+  return w;
+}
+
+template <typename Word>
+void store_word(unsigned char* p, std::size_t i, Word w) AK_TOOLKIT_NOEXCEPT
+{
+  std::memcpy(p + i * sizeof(Word), &w, sizeof(Word));
+}
+
+// LSD radix sort of n keys in `keys` by bytes, using `tmp` (room for n words) as the other buffer.
+// Passes over a byte that is equal in all keys are skipped. Returns the buffer holding the result.
+template <typename Word>
+unsigned char* radix_sort_words(unsigned char* keys, unsigned char* tmp, std::size_t n)
+{
+  constexpr std::size_t digits = sizeof(Word);
+  std::size_t counts[digits][256] = {};
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    Word w = load_word<Word>(keys, i);
+    for (std::size_t d = 0; d != digits; ++d)
+      ++counts[d][(w >> (8 * d)) & 0xFF];
+  }
+
+  for (std::size_t d = 0; d != digits; ++d)
+  {
+    std::size_t* c = counts[d];
+    if (c[(load_word<Word>(keys, 0) >> (8 * d)) & 0xFF] == n)
+      continue;
+    std::size_t offset = 0;
+    for (std::size_t b = 0; b != 256; ++b)
+    {
+      std::size_t k = c[b];
+      c[b] = offset;
+      offset += k;
+    }
+    for (std::size_t i = 0; i != n; ++i)
+    {
+      Word w = load_word<Word>(keys, i);
+      store_word(tmp, c[(w >> (8 * d)) & 0xFF]++, w);
+    }
+    std::swap(keys, tmp);
+  }
+  return keys;
+}
+
+template <typename MP>
+void radix_sort(markable<MP>* data, std::size_t n, null_order order)
+{
+  typedef typename MP::storage_type storage_type;
+  typedef radix_key<storage_type> key;
+  typedef typename key::word word;
+
+  if (n < 2)
+    return;
+
+  // Partition pass: keys of the values go to the front of `buf`, the marked elements
+  // (with their exact bits) to the back.
+  std::unique_ptr<word[]> buf(new word[n]);
+  unsigned char* bytes = reinterpret_cast<unsigned char*>(data);
+  std::size_t present = 0, marked = n;
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    word w = load_word<word>(bytes, i);
+    if (data[i].has_value())
+      buf[present++] = key::encode(w);
+    else
+      buf[--marked] = w;
+  }
+
+  // Sort the keys; the input array serves as the second buffer.
+  unsigned char* keys = reinterpret_cast<unsigned char*>(buf.get());
+  if (present < 256)
+    std::sort(buf.get(), buf.get() + present);
+  else if (radix_sort_words<word>(keys, bytes, present) != keys)
+    std::memcpy(keys, bytes, present * sizeof(word));
+
+  std::size_t first_value = order == null_order::first ? n - present : 0;
+  std::size_t first_marked = order == null_order::first ? 0 : present;
+  for (std::size_t i = 0; i != present; ++i)
+    store_word(bytes, first_value + i, key::decode(buf[i]));
+  std::memcpy(bytes + first_marked * sizeof(word), buf.get() + present, (n - present) * sizeof(word));
+}
+
+} // namespace detail_
+
+// Sorts the elements in ascending order of their values, with marked elements first or last,
+// like std::sort with markable_less<order> (but not stable with respect to equal values of
+// different bit patterns, such as 0.0 and -0.0, which are ordered by their bits).
+// Marked elements are separated in a single pass; values are sorted by an LSD radix sort
+// that skips the bytes equal in all values. Needs n additional words of memory.
+template <markable_contiguous_range R>
+  requires (detail_::is_radix_sortable<detail_::range_policy_t<R>>())
+void radix_sort(R&& r, null_order order = null_order::first)
+{
+  detail_::radix_sort(std::ranges::data(r), std::ranges::size(r), order);
+}
+
+} // namespace markable_ns
+
+using markable_ns::simd_isa;
+using markable_ns::supported_simd_isa;
+using markable_ns::count_present;
+using markable_ns::find_first_present;
+using markable_ns::presence_bitmap;
+using markable_ns::compact_present;
+using markable_ns::expand_present;
+using markable_ns::nan_counts;
+using markable_ns::count_nans;
+using markable_ns::find_first_computed_nan;
+using markable_ns::value_or_each;
+using markable_ns::transform_each;
+using markable_ns::and_then_each;
+using markable_ns::or_else_each;
+using markable_ns::radix_sort;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_ALGORITHM_HEADER_GUARD_
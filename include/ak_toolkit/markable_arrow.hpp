@@ -0,0 +1,336 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_ARROW_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_ARROW_HEADER_GUARD_
+
+// Conversions between arrays of markable<MP> and the Arrow layout: a buffer of values
+// plus a validity bitmap (bit i, least significant bit first, set iff value i is not null).
+//
+// For policies with a raw layout (mark_int, mark_enum, mark_fp_nan) the array of
+// markable<MP> already is a valid Arrow values buffer: export only computes the bitmap,
+// and import only overwrites null slots with the marked value.
+
+#include "markable_algorithm.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+namespace ak_toolkit {
+namespace markable_ns {
+namespace detail_ {
+
+template <typename MP>
+struct arrow_traits
+{
+  typedef typename MP::storage_type storage_type;
+  typedef typename uint_of_size<sizeof(storage_type)>::type word;
+
+  static constexpr bool supported = bulk_traits<MP>::vectorizable;
+
+  static word marked_pattern() AK_TOOLKIT_NOEXCEPT { return std::bit_cast<word>(storage_type(MP::marked_value())); }
+};
+
+// Returns bits [i, i + count) of the bitmap; i % 8 + count must not exceed 64.
+inline std::uint64_t load_bits(const std::uint8_t* bitmap, std::size_t i, std::size_t count) AK_TOOLKIT_NOEXCEPT
+{
+  std::size_t first = i / 8, shift = i % 8, bytes = (shift + count + 7) / 8;
+  std::uint64_t w = 0;
+  for (std::size_t b = 0; b != bytes; ++b)
+    w |= std::uint64_t(bitmap[first + b]) << (8 * b);
+  w >>= shift;
+  return count == 64 ? w : w & ((std::uint64_t(1) << count) - 1);
+}
+
+inline bool test_bit(const std::uint8_t* bitmap, std::size_t i) AK_TOOLKIT_NOEXCEPT
+{
+  return (bitmap[i / 8] >> (i % 8)) & 1u;
+}
+
+// Blend kernels: out[j] = bit j of `valid` ? in[j] : pattern, for a block of `lanes` words.
+// `in` and `out` may be the same buffer.
+
+template <typename Word>
+struct scalar_blend_kernel
+{
+  static constexpr std::size_t width = sizeof(Word);
+  Word pattern;
+
+  void blend_one(const unsigned char* in, bool valid, unsigned char* out) const AK_TOOLKIT_NOEXCEPT
+  {
+    Word w; std::memcpy(&w, in, sizeof(Word));
+    Word m = Word(Word(0) - Word(valid));
+    w = Word((w & m) | (pattern & ~m));
+    std::memcpy(out, &w, sizeof(Word));
+  }
+};
+
+template <typename Word>
+struct scalar_block_blend_kernel : scalar_blend_kernel<Word>
+{
+  static constexpr std::size_t lanes = 8;
+  void blend(const unsigned char* in, std::uint64_t valid, unsigned char* out) const AK_TOOLKIT_NOEXCEPT
+  {
+    for (std::size_t j = 0; j != lanes; ++j)
+      this->blend_one(in + j * sizeof(Word), (valid >> j) & 1u, out + j * sizeof(Word));
+  }
+};
+
+template <typename K>
+AK_TOOLKIT_FORCE_INLINE void blend_blocks(const unsigned char* in, const std::uint8_t* validity,
+                                          unsigned char* out, std::size_t n, const K& k)
+{
+  std::size_t i = 0;
+  for (; i + K::lanes <= n; i += K::lanes)
+    k.blend(in + i * K::width, load_bits(validity, i, K::lanes), out + i * K::width);
+  for (; i != n; ++i)
+    k.blend_one(in + i * K::width, test_bit(validity, i), out + i * K::width);
+}
+
+template <typename Word>
+void blend_scalar(const unsigned char* in, const std::uint8_t* validity, unsigned char* out, std::size_t n, Word pattern)
+{
+  scalar_block_blend_kernel<Word> k {{pattern}};
+  blend_blocks(in, validity, out, n, k);
+}
+
+#if defined AK_TOOLKIT_MARKABLE_X86_SIMD
+
+namespace avx2_ {
+
+template <typename Word> struct blend_kernel;
+
+template <> struct blend_kernel<std::uint8_t> : scalar_blend_kernel<std::uint8_t>
+{
+  static constexpr std::size_t lanes = 32;
+  AK_TOOLKIT_TARGET("avx2") void blend(const unsigned char* in, std::uint64_t valid, unsigned char* out) const
+  { // broadcast the 32 bits, copy byte k of them to lanes 8k..8k+7, then test one bit per lane
+    __m256i bits = _mm256_shuffle_epi8(_mm256_set1_epi32(int(valid)),
+                                       _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                                        2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3));
+    __m256i sel = _mm256_set1_epi64x(0x8040201008040201ll);
+    __m256i m = _mm256_cmpeq_epi8(_mm256_and_si256(bits, sel), sel);
+    __m256i v = _mm256_loadu_si256((const __m256i*)in);
+    _mm256_storeu_si256((__m256i*)out, _mm256_blendv_epi8(_mm256_set1_epi8(char(pattern)), v, m));
+  }
+};
+
+template <> struct blend_kernel<std::uint16_t> : scalar_blend_kernel<std::uint16_t>
+{
+  static constexpr std::size_t lanes = 16;
+  AK_TOOLKIT_TARGET("avx2") void blend(const unsigned char* in, std::uint64_t valid, unsigned char* out) const
+  {
+    __m256i sel = _mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, short(0x8000));
+    __m256i m = _mm256_cmpeq_epi16(_mm256_and_si256(_mm256_set1_epi16(short(valid)), sel), sel);
+    __m256i v = _mm256_loadu_si256((const __m256i*)in);
+    _mm256_storeu_si256((__m256i*)out, _mm256_blendv_epi8(_mm256_set1_epi16(short(pattern)), v, m));
+  }
+};
+
+template <> struct blend_kernel<std::uint32_t> : scalar_blend_kernel<std::uint32_t>
+{
+  static constexpr std::size_t lanes = 8;
+  AK_TOOLKIT_TARGET("avx2") void blend(const unsigned char* in, std::uint64_t valid, unsigned char* out) const
+  {
+    __m256i sel = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i m = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(int(valid)), sel), sel);
+    __m256i v = _mm256_loadu_si256((const __m256i*)in);
+    _mm256_storeu_si256((__m256i*)out, _mm256_blendv_epi8(_mm256_set1_epi32(int(pattern)), v, m));
+  }
+};
+
+template <> struct blend_kernel<std::uint64_t> : scalar_blend_kernel<std::uint64_t>
+{
+  static constexpr std::size_t lanes = 4;
+  AK_TOOLKIT_TARGET("avx2") void blend(const unsigned char* in, std::uint64_t valid, unsigned char* out) const
+  {
+    __m256i sel = _mm256_setr_epi64x(1, 2, 4, 8);
+    __m256i m = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x((long long)valid), sel), sel);
+    __m256i v = _mm256_loadu_si256((const __m256i*)in);
+    _mm256_storeu_si256((__m256i*)out, _mm256_blendv_epi8(_mm256_set1_epi64x((long long)pattern), v, m));
+  }
+};
+
+template <typename Word>
+AK_TOOLKIT_TARGET("avx2") void blend(const unsigned char* in, const std::uint8_t* validity, unsigned char* out, std::size_t n, Word pattern)
+{
+  blend_kernel<Word> k {{pattern}};
+  blend_blocks(in, validity, out, n, k);
+}
+
+} // namespace avx2_
+
+namespace avx512_ {
+
+template <typename Word> struct blend_kernel;
+
+template <> struct blend_kernel<std::uint8_t> : scalar_blend_kernel<std::uint8_t>
+{
+  static constexpr std::size_t lanes = 64;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") void blend(const unsigned char* in, std::uint64_t valid, unsigned char* out) const
+  { _mm512_storeu_si512(out, _mm512_mask_blend_epi8(valid, _mm512_set1_epi8(char(pattern)), _mm512_loadu_si512(in))); }
+};
+
+template <> struct blend_kernel<std::uint16_t> : scalar_blend_kernel<std::uint16_t>
+{
+  static constexpr std::size_t lanes = 32;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") void blend(const unsigned char* in, std::uint64_t valid, unsigned char* out) const
+  { _mm512_storeu_si512(out, _mm512_mask_blend_epi16(__mmask32(valid), _mm512_set1_epi16(short(pattern)), _mm512_loadu_si512(in))); }
+};
+
+template <> struct blend_kernel<std::uint32_t> : scalar_blend_kernel<std::uint32_t>
+{
+  static constexpr std::size_t lanes = 16;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") void blend(const unsigned char* in, std::uint64_t valid, unsigned char* out) const
+  { _mm512_storeu_si512(out, _mm512_mask_blend_epi32(__mmask16(valid), _mm512_set1_epi32(int(pattern)), _mm512_loadu_si512(in))); }
+};
+
+template <> struct blend_kernel<std::uint64_t> : scalar_blend_kernel<std::uint64_t>
+{
+  static constexpr std::size_t lanes = 8;
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") void blend(const unsigned char* in, std::uint64_t valid, unsigned char* out) const
+  { _mm512_storeu_si512(out, _mm512_mask_blend_epi64(__mmask8(valid), _mm512_set1_epi64((long long)pattern), _mm512_loadu_si512(in))); }
+};
+
+template <typename Word>
+AK_TOOLKIT_TARGET("avx512f,avx512bw") void blend(const unsigned char* in, const std::uint8_t* validity, unsigned char* out, std::size_t n, Word pattern)
+{
+  blend_kernel<Word> k {{pattern}};
+  blend_blocks(in, validity, out, n, k);
+}
+
+} // namespace avx512_
+
+#endif // AK_TOOLKIT_MARKABLE_X86_SIMD
+
+template <typename MP>
+void import_arrow(simd_isa isa, const typename MP::storage_type* values, const std::uint8_t* validity,
+                  markable<MP>* out, std::size_t n)
+{
+  typedef arrow_traits<MP> traits;
+  static_assert(traits::supported, "policy does not have a raw layout usable as an Arrow values buffer");
+
+  const unsigned char* in = reinterpret_cast<const unsigned char*>(values);
+  unsigned char* dst = reinterpret_cast<unsigned char*>(out);
+  if (validity == nullptr) // Arrow: no bitmap means no nulls
+  {
+    if (in != dst)
+      std::memmove(dst, in, n * sizeof(markable<MP>));
+    return;
+  }
+
+  switch (isa)
+  {
+#if defined AK_TOOLKIT_MARKABLE_X86_SIMD
+    case simd_isa::avx512: return avx512_::blend(in, validity, dst, n, traits::marked_pattern());
+    case simd_isa::avx2:   return avx2_::blend(in, validity, dst, n, traits::marked_pattern());
+#endif
+    default:               return blend_scalar(in, validity, dst, n, traits::marked_pattern());
+  }
+}
+
+template <typename Op>
+bool scan_equal_bytes(simd_isa isa, const unsigned char* p, std::size_t n, std::uint8_t byte, Op& op)
+{ // op receives masks of bytes different from `byte`
+  switch (isa)
+  {
+#if defined AK_TOOLKIT_MARKABLE_X86_SIMD
+    case simd_isa::avx512: return avx512_::scan<bit_pattern_marking>(p, n, byte, op);
+    case simd_isa::avx2:   return avx2_::scan<bit_pattern_marking>(p, n, byte, op);
+    case simd_isa::sse2:   return sse2_::scan<bit_pattern_marking>(p, n, byte, op);
+#endif
+    default:               return scan_scalar<bit_pattern_marking>(p, n, byte, op);
+  }
+}
+
+inline void export_arrow_bool(simd_isa isa, const markable<mark_bool>* data, std::size_t n, std::uint8_t* values)
+{
+  bitmap_writer writer(values);
+  auto op = [&writer](std::size_t i, std::uint64_t not_true, std::size_t count) {
+    writer.put(i, ~not_true & (count == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << count) - 1), count);
+    return true;
+  };
+  scan_equal_bytes(isa, reinterpret_cast<const unsigned char*>(data), n, std::uint8_t(1), op);
+  writer.finish(n);
+}
+
+inline void import_arrow_bool(const std::uint8_t* values, const std::uint8_t* validity, markable<mark_bool>* out, std::size_t n)
+{
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    unsigned v = test_bit(values, i);
+    unsigned valid = validity == nullptr || test_bit(validity, i);
+    out[i].assign_storage(char(valid ? v : 2u)); // compiles to a select
+  }
+}
+
+} // namespace detail_
+
+// Returns a view of the values buffer of the Arrow array: the storage of `r` itself, not a copy.
+// Null slots hold MP::marked_value().
+template <markable_contiguous_range R>
+auto arrow_values(R&& r) -> std::span<const typename detail_::range_policy_t<R>::storage_type>
+{
+  typedef detail_::range_policy_t<R> MP;
+  static_assert(detail_::arrow_traits<MP>::supported, "policy does not have a raw layout usable as an Arrow values buffer");
+  return {reinterpret_cast<const typename MP::storage_type*>(std::ranges::data(r)), std::ranges::size(r)};
+}
+
+// Writes the validity bitmap of `r`, (size + 7) / 8 bytes, and returns the null count.
+template <markable_contiguous_range R>
+std::size_t arrow_validity(R&& r, std::uint8_t* validity)
+{
+  return std::ranges::size(r) - presence_bitmap(r, validity);
+}
+
+// Arrow stores booleans as bits, so unlike other policies, mark_bool needs its values
+// exported as well: writes (size + 7) / 8 bytes, bit i set iff element i is true.
+template <markable_contiguous_range R>
+  requires std::is_same_v<detail_::range_policy_t<R>, mark_bool>
+void arrow_bool_values(R&& r, std::uint8_t* values)
+{
+  detail_::export_arrow_bool(supported_simd_isa(), std::ranges::data(r), std::ranges::size(r), values);
+}
+
+// Fills `out` from an Arrow values buffer and validity bitmap (which may be null, meaning no nulls).
+// `values` may point to the storage of `out` itself, in which case only the null slots are written.
+// Values are not checked: a valid slot holding the marked value of the policy (e.g. -1 for
+// mark_int<int, -1>, or any NaN for mark_fp_nan) silently becomes a null. Where the Arrow data
+// may contain such values, pick a policy whose marked value cannot occur, or check the values.
+template <markable_contiguous_range R>
+void import_arrow(const typename detail_::range_policy_t<R>::storage_type* values, const std::uint8_t* validity, R&& out)
+{
+  detail_::import_arrow(supported_simd_isa(), values, validity, std::ranges::data(out), std::ranges::size(out));
+}
+
+// Applies an Arrow validity bitmap to values already in place: null slots get MP::marked_value().
+template <markable_contiguous_range R>
+void import_arrow_validity(const std::uint8_t* validity, R&& r)
+{
+  import_arrow(arrow_values(r).data(), validity, r);
+}
+
+// mark_bool counterpart of import_arrow: both values and validity are bitmaps.
+template <markable_contiguous_range R>
+  requires std::is_same_v<detail_::range_policy_t<R>, mark_bool>
+void import_arrow_bool(const std::uint8_t* values, const std::uint8_t* validity, R&& out)
+{
+  detail_::import_arrow_bool(values, validity, std::ranges::data(out), std::ranges::size(out));
+}
+
+} // namespace markable_ns
+
+using markable_ns::arrow_values;
+using markable_ns::arrow_validity;
+using markable_ns::arrow_bool_values;
+using markable_ns::import_arrow;
+using markable_ns::import_arrow_validity;
+using markable_ns::import_arrow_bool;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_ARROW_HEADER_GUARD_
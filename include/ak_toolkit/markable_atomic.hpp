@@ -0,0 +1,168 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_ATOMIC_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_ATOMIC_HEADER_GUARD_
+
+// atomic_markable<MP>: a markable<MP> that can be read and written concurrently, for
+// policies whose storage_type is lock-free as a std::atomic. Since the marked value lives
+// in the same word as the value, "not computed yet" slots of shared tables need neither a
+// separate flag nor a mutex: readers of a published value pay one acquire load.
+
+#include "markable.hpp"
+#include <atomic>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// Operations compare the object representations of the storage, as std::atomic does. The
+// state without a value is the bit pattern of MP::marked_value(), which is what a default
+// constructed markable<MP> holds; a storage with another representation of the marked state
+// (e.g. a NaN with a different payload for mark_fp_nan) would not compare equal to it.
+template <AK_TOOLKIT_MARK_POLICY MP>
+class atomic_markable
+{
+public:
+  typedef markable<MP> markable_type;
+  typedef typename MP::value_type value_type;
+  typedef typename MP::storage_type storage_type;
+
+  static_assert(std::is_trivially_copyable<storage_type>::value, "atomic_markable requires a trivially copyable storage_type");
+  static_assert(std::atomic<storage_type>::is_always_lock_free, "atomic_markable requires a lock-free std::atomic<storage_type>");
+
+  static constexpr bool is_always_lock_free = true;
+
+private:
+  std::atomic<storage_type> _storage;
+
+  static markable_type from_storage(const storage_type& s) AK_TOOLKIT_NOEXCEPT
+  {
+    markable_type ans;
+    ans.assign_storage(s);
+    return ans;
+  }
+
+  static std::memory_order failure_order(std::memory_order order) AK_TOOLKIT_NOEXCEPT
+  {
+    return order == std::memory_order_acq_rel ? std::memory_order_acquire
+         : order == std::memory_order_release ? std::memory_order_relaxed
+         : order;
+  }
+
+public:
+  atomic_markable() AK_TOOLKIT_NOEXCEPT : _storage(markable_type().storage_value()) {}
+  explicit atomic_markable(const markable_type& m) AK_TOOLKIT_NOEXCEPT : _storage(m.storage_value()) {}
+  explicit atomic_markable(const value_type& v) : _storage(MP::store_value(v)) {}
+
+  atomic_markable(const atomic_markable&) = delete;
+  atomic_markable& operator=(const atomic_markable&) = delete;
+
+  markable_type load(std::memory_order order = std::memory_order_seq_cst) const AK_TOOLKIT_NOEXCEPT
+  {
+    return from_storage(_storage.load(order));
+  }
+
+  bool has_value(std::memory_order order = std::memory_order_seq_cst) const AK_TOOLKIT_NOEXCEPT
+  {
+    return load(order).has_value();
+  }
+
+  void store(const markable_type& m, std::memory_order order = std::memory_order_seq_cst) AK_TOOLKIT_NOEXCEPT
+  {
+    _storage.store(m.storage_value(), order);
+  }
+
+  markable_type exchange(const markable_type& m, std::memory_order order = std::memory_order_seq_cst) AK_TOOLKIT_NOEXCEPT
+  {
+    return from_storage(_storage.exchange(m.storage_value(), order));
+  }
+
+  // As std::atomic: on failure `expected` receives the current contents.
+  bool compare_exchange_weak(markable_type& expected, const markable_type& desired,
+                             std::memory_order order = std::memory_order_seq_cst) AK_TOOLKIT_NOEXCEPT
+  {
+    storage_type e = expected.storage_value();
+    bool ans = _storage.compare_exchange_weak(e, desired.storage_value(), order, failure_order(order));
+    expected = from_storage(e);
+    return ans;
+  }
+
+  bool compare_exchange_strong(markable_type& expected, const markable_type& desired,
+                               std::memory_order order = std::memory_order_seq_cst) AK_TOOLKIT_NOEXCEPT
+  {
+    storage_type e = expected.storage_value();
+    bool ans = _storage.compare_exchange_strong(e, desired.storage_value(), order, failure_order(order));
+    expected = from_storage(e);
+    return ans;
+  }
+
+  // Stores `v` if there is no value yet. Returns true if this call stored it; otherwise `current`
+  // receives the value already there.
+  bool try_set(const value_type& v, markable_type& current, std::memory_order order = std::memory_order_acq_rel)
+  {
+    current = markable_type();
+    return compare_exchange_strong(current, markable_type(v), order);
+  }
+
+  bool try_set(const value_type& v, std::memory_order order = std::memory_order_acq_rel)
+  {
+    markable_type current;
+    return try_set(v, current, order);
+  }
+
+  // Blocks while the contents are bitwise equal to `old`; needs notify_one() or notify_all() from the writer.
+  void wait(const markable_type& old, std::memory_order order = std::memory_order_seq_cst) const AK_TOOLKIT_NOEXCEPT
+  {
+    _storage.wait(old.storage_value(), order);
+  }
+
+  void notify_one() AK_TOOLKIT_NOEXCEPT { _storage.notify_one(); }
+  void notify_all() AK_TOOLKIT_NOEXCEPT { _storage.notify_all(); }
+
+  // Blocks until there is a value and returns it.
+  value_type wait_for_value() const
+  {
+    markable_type m = load(std::memory_order_acquire);
+    while (!m.has_value())
+    {
+      _storage.wait(m.storage_value(), std::memory_order_acquire);
+      m = load(std::memory_order_acquire);
+    }
+    return m.value();
+  }
+
+  // Returns the value, first computing it with f() if there is none. When several threads find
+  // no value, each calls f(), but exactly one result is published (and waiters of wait_for_value
+  // are notified); every caller returns that one. Once published, a call is one acquire load.
+  // If f() throws, nothing is published.
+  template <typename F>
+  value_type get_or_compute(F&& f)
+  {
+    markable_type m = load(std::memory_order_acquire);
+    if (AK_TOOLKIT_LIKELY(m.has_value()))
+      return m.value();
+
+    markable_type computed(static_cast<value_type>(std::invoke(std::forward<F>(f))));
+    AK_TOOLKIT_ASSERT(computed.has_value());
+    if (try_set(computed.value(), m))
+    {
+      _storage.notify_all();
+      return computed.value();
+    }
+    return m.value();
+  }
+};
+
+} // namespace markable_ns
+
+using markable_ns::atomic_markable;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_ATOMIC_HEADER_GUARD_
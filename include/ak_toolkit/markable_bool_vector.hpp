@@ -0,0 +1,215 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_BOOL_VECTOR_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_BOOL_VECTOR_HEADER_GUARD_
+
+// A sequence of markable<mark_bool> packed at 2 bits per element in two bit planes:
+// bit i of the "has" plane is set iff element i has a value, and bit i of the "value"
+// plane holds the value (and is 0 when there is none). Counting and the three-valued
+// (Kleene) logical operations process 64 elements per word.
+
+#include "markable.hpp"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+class markable_bool_vector
+{
+public:
+  typedef markable<mark_bool> value_type;
+  typedef std::size_t size_type;
+  typedef std::uint64_t word_type;
+
+  static constexpr size_type word_bits = 64;
+
+private:
+  std::vector<word_type> _has;
+  std::vector<word_type> _val;
+  size_type _size = 0;
+
+  static size_type words_for(size_type n) AK_TOOLKIT_NOEXCEPT { return (n + word_bits - 1) / word_bits; }
+  static word_type bit(size_type i) AK_TOOLKIT_NOEXCEPT { return word_type(1) << (i % word_bits); }
+
+  // Bits past size() are kept 0, so that whole words can be counted.
+  void clear_tail() AK_TOOLKIT_NOEXCEPT
+  {
+    if (_size % word_bits)
+    {
+      word_type mask = bit(_size) - 1;
+      _has.back() &= mask;
+      _val.back() &= mask;
+    }
+  }
+
+  void set(size_type i, const value_type& v) AK_TOOLKIT_NOEXCEPT
+  {
+    word_type b = bit(i);
+    word_type& h = _has[i / word_bits];
+    word_type& x = _val[i / word_bits];
+    h = v.has_value() ? h | b : h & ~b;
+    x = v.has_value() && v.value() ? x | b : x & ~b;
+  }
+
+public:
+  // Behaves like markable<mark_bool>& for an element of the vector.
+  class reference
+  {
+    friend class markable_bool_vector;
+    markable_bool_vector* _v;
+    size_type _i;
+
+    reference(markable_bool_vector* v, size_type i) AK_TOOLKIT_NOEXCEPT : _v(v), _i(i) {}
+
+  public:
+    reference(const reference&) = default;
+
+    reference& operator=(const value_type& v) AK_TOOLKIT_NOEXCEPT { _v->set(_i, v); return *this; }
+    reference& operator=(const reference& r) AK_TOOLKIT_NOEXCEPT { return *this = value_type(r); }
+
+    operator value_type() const AK_TOOLKIT_NOEXCEPT { return (*static_cast<const markable_bool_vector*>(_v))[_i]; }
+
+    bool has_value() const AK_TOOLKIT_NOEXCEPT { return value_type(*this).has_value(); }
+    bool value() const { return value_type(*this).value(); }
+    bool value_or(bool fallback) const AK_TOOLKIT_NOEXCEPT { return value_type(*this).value_or(fallback); }
+
+    void assign(bool b) AK_TOOLKIT_NOEXCEPT { *this = value_type(b); }
+    void reset() AK_TOOLKIT_NOEXCEPT { *this = value_type(); }
+  };
+
+  markable_bool_vector() = default;
+
+  explicit markable_bool_vector(size_type n, const value_type& v = value_type())
+  {
+    resize(n, v);
+  }
+
+  size_type size() const AK_TOOLKIT_NOEXCEPT { return _size; }
+  bool empty() const AK_TOOLKIT_NOEXCEPT { return _size == 0; }
+  void reserve(size_type n) { _has.reserve(words_for(n)); _val.reserve(words_for(n)); }
+  void clear() AK_TOOLKIT_NOEXCEPT { _has.clear(); _val.clear(); _size = 0; }
+
+  void resize(size_type n, const value_type& v = value_type())
+  {
+    size_type old_size = _size;
+    _has.resize(words_for(n));
+    _val.resize(words_for(n));
+    _size = n;
+    if (n < old_size)
+      clear_tail();
+    else if (v.has_value())
+      for (size_type i = old_size; i != n; ++i)
+        set(i, v);
+  }
+
+  void push_back(const value_type& v)
+  {
+    if (_size % word_bits == 0)
+    {
+      _has.push_back(0);
+      _val.push_back(0);
+    }
+    set(_size++, v);
+  }
+
+  value_type operator[](size_type i) const
+  {
+    AK_TOOLKIT_ASSERT(i < _size);
+    word_type b = bit(i);
+    if (!(_has[i / word_bits] & b))
+      return value_type();
+    return value_type(bool(_val[i / word_bits] & b));
+  }
+
+  reference operator[](size_type i) { return AK_TOOLKIT_ASSERT(i < _size), reference(this, i); }
+
+  // The bit planes, words_for(size()) words each, element i at bit i % 64 of word i / 64.
+  const word_type* has_words() const AK_TOOLKIT_NOEXCEPT { return _has.data(); }
+  const word_type* value_words() const AK_TOOLKIT_NOEXCEPT { return _val.data(); }
+  size_type word_count() const AK_TOOLKIT_NOEXCEPT { return _has.size(); }
+
+  size_type count_true() const AK_TOOLKIT_NOEXCEPT
+  {
+    size_type ans = 0;
+    for (word_type w : _val)
+      ans += std::popcount(w);
+    return ans;
+  }
+
+  size_type count_unset() const AK_TOOLKIT_NOEXCEPT
+  {
+    size_type ans = 0;
+    for (word_type w : _has)
+      ans += std::popcount(w);
+    return _size - ans;
+  }
+
+  size_type count_false() const AK_TOOLKIT_NOEXCEPT
+  {
+    size_type ans = 0;
+    for (size_type i = 0; i != _has.size(); ++i)
+      ans += std::popcount(_has[i] & ~_val[i]);
+    return ans;
+  }
+
+  friend bool operator==(const markable_bool_vector& l, const markable_bool_vector& r) AK_TOOLKIT_NOEXCEPT
+  {
+    return l._size == r._size && l._has == r._has && l._val == r._val;
+  }
+
+  // Three-valued logic: unset stands for "unknown". a AND b is false if either is false,
+  // true if both are true, and unset otherwise; OR is its dual. The vectors must have the same size.
+  friend markable_bool_vector kleene_and(const markable_bool_vector& a, const markable_bool_vector& b)
+  {
+    AK_TOOLKIT_ASSERT(a.size() == b.size());
+    markable_bool_vector ans(a.size());
+    for (size_type i = 0; i != ans._has.size(); ++i)
+    {
+      word_type t = a._val[i] & b._val[i];
+      word_type f = (a._has[i] & ~a._val[i]) | (b._has[i] & ~b._val[i]);
+      ans._has[i] = t | f;
+      ans._val[i] = t;
+    }
+    return ans;
+  }
+
+  friend markable_bool_vector kleene_or(const markable_bool_vector& a, const markable_bool_vector& b)
+  {
+    AK_TOOLKIT_ASSERT(a.size() == b.size());
+    markable_bool_vector ans(a.size());
+    for (size_type i = 0; i != ans._has.size(); ++i)
+    {
+      word_type t = a._val[i] | b._val[i];
+      word_type f = (a._has[i] & ~a._val[i]) & (b._has[i] & ~b._val[i]);
+      ans._has[i] = t | f;
+      ans._val[i] = t;
+    }
+    return ans;
+  }
+
+  friend markable_bool_vector kleene_not(const markable_bool_vector& a)
+  {
+    markable_bool_vector ans(a.size());
+    for (size_type i = 0; i != ans._has.size(); ++i)
+    {
+      ans._has[i] = a._has[i];
+      ans._val[i] = a._has[i] & ~a._val[i];
+    }
+    return ans;
+  }
+};
+
+} // namespace markable_ns
+
+using markable_ns::markable_bool_vector;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_BOOL_VECTOR_HEADER_GUARD_
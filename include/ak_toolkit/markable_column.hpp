@@ -0,0 +1,94 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_COLUMN_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_COLUMN_HEADER_GUARD_
+
+#include "markable_algorithm.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// A growable column of optional values. Elements are stored as markable<MP>, which has
+// the layout of MP::storage_type, so the column is a contiguous array of raw representations
+// and presence queries can be answered by bulk scans.
+template <AK_TOOLKIT_MARK_POLICY MP>
+class markable_column
+{
+public:
+  typedef markable<MP> element_type;
+  typedef typename MP::value_type value_type;
+  typedef typename MP::storage_type storage_type;
+  typedef std::size_t size_type;
+  typedef typename std::vector<element_type>::const_iterator const_iterator;
+
+private:
+  std::vector<element_type> _elements;
+
+public:
+  markable_column() = default;
+
+  explicit markable_column(size_type n) // all elements without a value
+    : _elements(n) {}
+
+  size_type size() const AK_TOOLKIT_NOEXCEPT { return _elements.size(); }
+  bool empty() const AK_TOOLKIT_NOEXCEPT { return _elements.empty(); }
+  size_type capacity() const AK_TOOLKIT_NOEXCEPT { return _elements.capacity(); }
+  void reserve(size_type n) { _elements.reserve(n); }
+  void resize(size_type n) { _elements.resize(n); }
+  void clear() AK_TOOLKIT_NOEXCEPT { _elements.clear(); }
+
+  const element_type* data() const AK_TOOLKIT_NOEXCEPT { return _elements.data(); }
+  const_iterator begin() const AK_TOOLKIT_NOEXCEPT { return _elements.begin(); }
+  const_iterator end() const AK_TOOLKIT_NOEXCEPT { return _elements.end(); }
+
+  const element_type& operator[](size_type i) const { return AK_TOOLKIT_ASSERT(i < size()), _elements[i]; }
+  bool has_value(size_type i) const { return (*this)[i].has_value(); }
+  typename MP::reference_type value(size_type i) const { return (*this)[i].value(); }
+
+  void push_back(const element_type& e) { _elements.push_back(e); }
+  void push_back(element_type&& e) { _elements.push_back(std::move(e)); }
+  void push_back_value(const value_type& v) { _elements.emplace_back(v); }
+  void push_back_value(value_type&& v) { _elements.emplace_back(std::move(v)); }
+  void push_back_marked() { _elements.emplace_back(); }
+
+  void assign(size_type i, const value_type& v) { AK_TOOLKIT_ASSERT(i < size()); _elements[i].assign(v); }
+  void assign(size_type i, value_type&& v) { AK_TOOLKIT_ASSERT(i < size()); _elements[i].assign(std::move(v)); }
+  void reset(size_type i) { AK_TOOLKIT_ASSERT(i < size()); _elements[i] = element_type(); }
+  void reset_all() { fill_marked(_elements.data(), size()); } // a memset when repeated_marked_byte<MP> allows
+
+  size_type count_present() const { return markable_ns::count_present(_elements); }
+  size_type count_marked() const { return size() - count_present(); }
+
+  // Writes (size() + 7) / 8 bytes, bit i set iff element i has a value; returns count_present().
+  size_type presence_bitmap(std::uint8_t* bitmap) const { return markable_ns::presence_bitmap(_elements, bitmap); }
+
+  std::vector<std::uint8_t> presence_bitmap() const
+  {
+    std::vector<std::uint8_t> bitmap((size() + 7) / 8);
+    presence_bitmap(bitmap.data());
+    return bitmap;
+  }
+
+  // Returns the index of the first element at or after `from` that has a value, or size() if there is none.
+  size_type find_first_present(size_type from = 0) const
+  {
+    if (from >= size())
+      return size();
+    return from + detail_::find_first_present(supported_simd_isa(), data() + from, size() - from);
+  }
+};
+
+} // namespace markable_ns
+
+using markable_ns::markable_column;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_COLUMN_HEADER_GUARD_
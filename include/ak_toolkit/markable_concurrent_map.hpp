@@ -0,0 +1,228 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_CONCURRENT_MAP_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_CONCURRENT_MAP_HEADER_GUARD_
+
+// Fixed-capacity, insert-only hash set and map that any number of threads can use at once,
+// without locks. Keys are atomic_markable<MP> slots probed linearly: the marked value denotes
+// an empty slot, and a key is inserted by a compare-exchange from the marked value, so there
+// is no occupancy array. The map keeps its values in a parallel array of atomic_markable<VP>,
+// published after the key: a key whose value is not yet published is found with no value.
+
+#include "markable_atomic.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+namespace detail_ {
+
+// Shared key array of markable_concurrent_set and markable_concurrent_map.
+template <typename MP, typename Hash>
+class concurrent_table
+{
+public:
+  typedef typename MP::value_type key_type;
+  typedef std::size_t size_type;
+
+protected:
+  typedef markable<MP> slot_value_type;
+  static constexpr size_type min_capacity = 16;
+
+  std::unique_ptr<atomic_markable<MP>[]> _keys;
+  size_type _capacity;   // a power of two
+  unsigned _shift;       // 64 - log2(_capacity)
+  Hash _hash;
+
+  static size_type capacity_for(size_type n)
+  {
+    size_type c = min_capacity;
+    while (n * 4 > c * 3) // max load factor 3/4: probe sequences stay short under concurrent inserts
+      c *= 2;
+    return c;
+  }
+
+  static unsigned shift_for(size_type capacity)
+  {
+    unsigned shift = 64;
+    for (size_type c = capacity; c > 1; c /= 2)
+      --shift;
+    return shift;
+  }
+
+  // Fibonacci hashing of the hash value.
+  size_type home(const key_type& k) const
+  {
+    std::uint64_t h = std::uint64_t(_hash(k)) * 0x9E3779B97F4A7C15ull;
+    return size_type(h >> _shift);
+  }
+
+  // Returns the slot holding `k`, or -1.
+  std::ptrdiff_t find_slot(const key_type& k) const
+  {
+    AK_TOOLKIT_ASSERT(markable<MP>(k).has_value());
+    size_type i = home(k);
+    for (size_type probes = 0; probes != _capacity; ++probes, i = (i + 1) & (_capacity - 1))
+    {
+      slot_value_type s = _keys[i].load(std::memory_order_acquire);
+      if (!s.has_value())
+        return -1; // slots are never emptied, so `k` is not further along
+      if (s.value() == k)
+        return std::ptrdiff_t(i);
+    }
+    return -1;
+  }
+
+  // Returns {slot holding `k`, true if this call stored `k` there}. Throws std::length_error if
+  // `k` is absent and every slot is taken.
+  std::pair<size_type, bool> find_or_claim_slot(const key_type& k)
+  {
+    AK_TOOLKIT_ASSERT(markable<MP>(k).has_value());
+    size_type i = home(k);
+    for (size_type probes = 0; probes != _capacity; ++probes, i = (i + 1) & (_capacity - 1))
+    {
+      slot_value_type s = _keys[i].load(std::memory_order_acquire);
+      if (!s.has_value())
+      {
+        if (_keys[i].try_set(k, s, std::memory_order_acq_rel))
+          return {i, true};
+        // another thread claimed the slot first; `s` is its key
+      }
+      if (s.value() == k)
+        return {i, false};
+    }
+    throw std::length_error("markable concurrent table is full");
+  }
+
+  explicit concurrent_table(size_type expected_size)
+    : _keys(new atomic_markable<MP>[capacity_for(expected_size)]), _capacity(capacity_for(expected_size)),
+      _shift(shift_for(_capacity)), _hash()
+  {}
+
+public:
+  size_type capacity() const AK_TOOLKIT_NOEXCEPT { return _capacity; } // number of slots
+
+  bool contains(const key_type& k) const { return find_slot(k) != -1; }
+
+  // Counts the keys; exact when no insert runs concurrently. Takes O(capacity()) time.
+  size_type size() const
+  {
+    size_type ans = 0;
+    for (size_type i = 0; i != _capacity; ++i)
+      ans += _keys[i].has_value(std::memory_order_relaxed);
+    return ans;
+  }
+};
+
+} // namespace detail_
+
+// Set of keys of MP::value_type for at most `expected_size` keys, given at construction (the table
+// holds a third more before it is full). The marked value cannot be stored.
+template <AK_TOOLKIT_MARK_POLICY MP, typename Hash = std::hash<typename MP::value_type>>
+class markable_concurrent_set : public detail_::concurrent_table<MP, Hash>
+{
+  typedef detail_::concurrent_table<MP, Hash> base;
+
+public:
+  typedef typename base::key_type key_type;
+  typedef typename base::size_type size_type;
+
+  explicit markable_concurrent_set(size_type expected_size) : base(expected_size) {}
+
+  // Returns true if `k` was not yet in the set; of several threads inserting the same key, exactly one gets true.
+  bool insert(const key_type& k) { return this->find_or_claim_slot(k).second; }
+
+  // Calls f(key) for every element, in unspecified order; elements inserted concurrently may be missed.
+  template <typename F>
+  void for_each(F&& f) const
+  {
+    for (size_type i = 0; i != this->_capacity; ++i)
+    {
+      markable<MP> s = this->_keys[i].load(std::memory_order_acquire);
+      if (s.has_value())
+        f(s.value());
+    }
+  }
+};
+
+// Map from keys of KP::value_type to values of VP::value_type for at most `expected_size` keys.
+// Values are held in atomic_markable<VP>, so VP::storage_type must be lock-free as well.
+template <AK_TOOLKIT_MARK_POLICY KP, AK_TOOLKIT_MARK_POLICY VP, typename Hash = std::hash<typename KP::value_type>>
+class markable_concurrent_map : public detail_::concurrent_table<KP, Hash>
+{
+  typedef detail_::concurrent_table<KP, Hash> base;
+  std::unique_ptr<atomic_markable<VP>[]> _values;
+
+public:
+  typedef typename base::key_type key_type;
+  typedef typename VP::value_type mapped_type;
+  typedef typename base::size_type size_type;
+
+  explicit markable_concurrent_map(size_type expected_size)
+    : base(expected_size), _values(new atomic_markable<VP>[this->_capacity]) {}
+
+  // Returns the value mapped to `k`, or no value if `k` is absent or its value is not yet published.
+  markable<VP> find(const key_type& k) const
+  {
+    std::ptrdiff_t i = this->find_slot(k);
+    return i == -1 ? markable<VP>() : _values[i].load(std::memory_order_acquire);
+  }
+
+  // Maps `k` to `v` unless `k` already has a value; returns true if this call published `v`.
+  bool insert(const key_type& k, const mapped_type& v)
+  {
+    return _values[this->find_or_claim_slot(k).first].try_set(v);
+  }
+
+  // Maps `k` to `v`, replacing the previous value.
+  void insert_or_assign(const key_type& k, const mapped_type& v)
+  {
+    _values[this->find_or_claim_slot(k).first].store(markable<VP>(v), std::memory_order_release);
+  }
+
+  // Returns the value mapped to `k`, first mapping it to f() if there is none (see atomic_markable::get_or_compute).
+  template <typename F>
+  mapped_type get_or_compute(const key_type& k, F&& f)
+  {
+    return _values[this->find_or_claim_slot(k).first].get_or_compute(std::forward<F>(f));
+  }
+
+  // Inserts `k` if absent, and returns its value slot for compare-exchange loops and the like.
+  atomic_markable<VP>& value_slot(const key_type& k)
+  {
+    return _values[this->find_or_claim_slot(k).first];
+  }
+
+  // Calls f(key, value) for every key with a published value, in unspecified order.
+  template <typename F>
+  void for_each(F&& f) const
+  {
+    for (size_type i = 0; i != this->_capacity; ++i)
+    {
+      markable<KP> k = this->_keys[i].load(std::memory_order_acquire);
+      if (!k.has_value())
+        continue;
+      markable<VP> v = _values[i].load(std::memory_order_acquire);
+      if (v.has_value())
+        f(k.value(), v.value());
+    }
+  }
+};
+
+} // namespace markable_ns
+
+using markable_ns::markable_concurrent_set;
+using markable_ns::markable_concurrent_map;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_CONCURRENT_MAP_HEADER_GUARD_
@@ -0,0 +1,252 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_EXPECTED_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_EXPECTED_HEADER_GUARD_
+
+// markable_expected<T, E, N>: either a value of an integral type T or one of N error codes of
+// type E, in sizeof(T) bytes. The top N values of T are reserved: error e is stored as the
+// value numeric_limits<T>::max() - N + 1 + e, so a markable_expected is a markable of
+// mark_int_range over the reserved values, and arrays of them are classified by the same
+// vectorized scans.
+
+#include "markable.hpp"
+#include "markable_algorithm.hpp"
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// Wraps an error code for constructing a markable_expected holding it.
+template <typename E>
+class markable_unexpected
+{
+  E _error;
+
+public:
+  AK_TOOLKIT_CONSTEXPR explicit markable_unexpected(E e) AK_TOOLKIT_NOEXCEPT : _error(e) {}
+  AK_TOOLKIT_CONSTEXPR E error() const AK_TOOLKIT_NOEXCEPT { return _error; }
+};
+
+namespace detail_ {
+
+// 256 error codes, or half of the non-negative values of a one-byte T (64 for int8_t, 128 for uint8_t),
+// so that T() and small values remain values.
+template <typename T>
+constexpr std::size_t default_error_count()
+{
+  constexpr std::size_t half = std::size_t(std::numeric_limits<T>::max()) / 2 + 1;
+  return half < 256 ? half : 256;
+}
+
+} // namespace detail_
+
+template <typename T, typename E, std::size_t N = detail_::default_error_count<T>()> class markable_expected;
+
+namespace detail_ {
+
+template <typename T>
+struct is_markable_expected : std::false_type {};
+
+template <typename T, typename E, std::size_t N>
+struct is_markable_expected<markable_expected<T, E, N>> : std::true_type {};
+
+} // namespace detail_
+
+// E is an enumeration or an integral type whose error codes are 0, 1, ..., N - 1 (std::errc qualifies
+// for the default N of T wider than a byte). Like std::expected, a default-constructed object holds T().
+template <typename T, typename E, std::size_t N>
+class markable_expected
+{
+  static_assert(std::is_integral<T>::value && !std::is_same<T, bool>::value, "markable_expected requires an integral value type");
+  static_assert(std::is_enum<E>::value || std::is_integral<E>::value, "markable_expected requires an enumeration or integral error type");
+  static_assert(N >= 1 && N - 1 < std::size_t(std::numeric_limits<typename std::make_unsigned<T>::type>::max()),
+                "markable_expected reserves at least one value of T, and leaves at least one for values");
+
+public:
+  typedef T value_type;
+  typedef E error_type;
+  typedef typename std::make_unsigned<T>::type unsigned_type;
+  static constexpr std::size_t error_count = N;
+  static constexpr T first_error_value = T(unsigned_type(std::numeric_limits<T>::max()) - unsigned_type(N - 1));
+  static_assert(first_error_value > T(), "markable_expected must not reserve T(), which a default-constructed object holds");
+
+  // marks exactly the reserved values: "no value" means "an error"
+  typedef mark_int_range<T, first_error_value, std::numeric_limits<T>::max()> policy_type;
+
+private:
+  markable<policy_type> _m;
+
+  static AK_TOOLKIT_CONSTEXPR T encode(E e) AK_TOOLKIT_NOEXCEPT
+  {
+    return AK_TOOLKIT_ASSERTED_EXPRESSION(std::size_t(e) < N, T(unsigned_type(first_error_value) + unsigned_type(e)));
+  }
+
+public:
+  AK_TOOLKIT_CONSTEXPR markable_expected() AK_TOOLKIT_NOEXCEPT : _m(T()) {}
+
+  // `v` must not be one of the reserved values.
+  AK_TOOLKIT_CONSTEXPR markable_expected(const T& v) AK_TOOLKIT_NOEXCEPT : _m(v) { AK_TOOLKIT_ASSERT(_m.has_value()); }
+
+  template <typename G>
+  AK_TOOLKIT_CONSTEXPR markable_expected(const markable_unexpected<G>& u) AK_TOOLKIT_NOEXCEPT
+    : _m(encode(static_cast<E>(u.error()))) {}
+
+  AK_TOOLKIT_CONSTEXPR bool has_value() const AK_TOOLKIT_NOEXCEPT { return _m.has_value(); }
+  AK_TOOLKIT_CONSTEXPR explicit operator bool() const AK_TOOLKIT_NOEXCEPT { return has_value(); }
+
+  AK_TOOLKIT_CONSTEXPR T value() const AK_TOOLKIT_NOEXCEPT { return _m.value(); }
+  AK_TOOLKIT_CONSTEXPR T operator*() const AK_TOOLKIT_NOEXCEPT { return value(); }
+
+  AK_TOOLKIT_CONSTEXPR E error() const AK_TOOLKIT_NOEXCEPT
+  {
+    return AK_TOOLKIT_ASSERTED_EXPRESSION(!has_value(), E(unsigned_type(_m.storage_value()) - unsigned_type(first_error_value)));
+  }
+
+  template <typename U>
+  AK_TOOLKIT_CONSTEXPR T value_or(U&& fallback) const { return _m.value_or(std::forward<U>(fallback)); }
+
+  template <typename G>
+  AK_TOOLKIT_CONSTEXPR E error_or(G&& fallback) const
+  {
+    return has_value() ? static_cast<E>(std::forward<G>(fallback)) : error();
+  }
+
+  AK_TOOLKIT_CONSTEXPR const markable<policy_type>& as_markable() const AK_TOOLKIT_NOEXCEPT { return _m; }
+  AK_TOOLKIT_CONSTEXPR T storage_value() const AK_TOOLKIT_NOEXCEPT { return _m.storage_value(); }
+
+  // f(value()) must return a markable_expected with the same E and N; returns it if a value is
+  // present, the error otherwise.
+  template <typename F>
+  AK_TOOLKIT_CONSTEXPR auto and_then(F&& f) const
+  {
+    typedef std::remove_cvref_t<std::invoke_result_t<F, T>> result_type;
+    static_assert(detail_::is_markable_expected<result_type>::value, "and_then requires a function returning a markable_expected");
+    static_assert(std::is_same<typename result_type::error_type, E>::value && result_type::error_count == N,
+                  "and_then requires a function returning a markable_expected of the same error type");
+    return has_value() ? std::invoke(std::forward<F>(f), value()) : result_type(markable_unexpected<E>(error()));
+  }
+
+  // Returns markable_expected holding f(value()) if a value is present, the error otherwise.
+  template <typename F>
+  AK_TOOLKIT_CONSTEXPR auto transform(F&& f) const
+  {
+    typedef markable_expected<std::remove_cvref_t<std::invoke_result_t<F, T>>, E, N> result_type;
+    return has_value() ? result_type(std::invoke(std::forward<F>(f), value())) : result_type(markable_unexpected<E>(error()));
+  }
+
+  // Returns *this if a value is present, f(error()) (convertible to markable_expected) otherwise.
+  template <typename F>
+  AK_TOOLKIT_CONSTEXPR markable_expected or_else(F&& f) const
+  {
+    return has_value() ? *this : static_cast<markable_expected>(std::invoke(std::forward<F>(f), error()));
+  }
+
+  // Returns markable_expected holding the value, or the error f(error()).
+  template <typename F>
+  AK_TOOLKIT_CONSTEXPR auto transform_error(F&& f) const
+  {
+    typedef std::remove_cvref_t<std::invoke_result_t<F, E>> error_result_type;
+    typedef markable_expected<T, error_result_type, N> result_type;
+    return has_value() ? result_type(value()) : result_type(markable_unexpected<error_result_type>(std::invoke(std::forward<F>(f), error())));
+  }
+
+  // Each value and each error is stored as one bit pattern, so equality is equality of the storage.
+  friend AK_TOOLKIT_CONSTEXPR bool operator==(const markable_expected& l, const markable_expected& r) AK_TOOLKIT_NOEXCEPT
+  {
+    return l.storage_value() == r.storage_value();
+  }
+};
+
+// Numbers of elements holding a value and holding each error code, in a range of markable_expected<T, E, N>.
+template <std::size_t N>
+struct error_counts
+{
+  std::size_t values = 0;
+  std::array<std::size_t, N> errors {}; // errors[e]: elements holding error e
+
+  template <typename E>
+  std::size_t operator[](E e) const AK_TOOLKIT_NOEXCEPT { return errors[std::size_t(e)]; }
+};
+
+// A contiguous range of markable_expected objects.
+template <typename R>
+concept markable_expected_contiguous_range =
+  std::ranges::contiguous_range<R> && std::ranges::sized_range<R> &&
+  detail_::is_markable_expected<std::remove_cv_t<std::ranges::range_value_t<R>>>::value;
+
+namespace detail_ {
+
+template <typename R>
+using range_expected_t = std::remove_cv_t<std::ranges::range_value_t<R>>;
+
+// Calls f(index, error) for the elements holding an error, in order, until f returns false.
+// The errors are found many elements at a time by the scans of mark_int_range.
+template <typename X, typename F>
+void for_each_error(simd_isa isa, const X* data, std::size_t n, F f)
+{
+  static_assert(sizeof(X) == sizeof(markable<typename X::policy_type>), "markable_expected must have the layout of its markable");
+  const markable<typename X::policy_type>* m = reinterpret_cast<const markable<typename X::policy_type>*>(data);
+  scan_present(isa, m, n, [&](std::size_t i, std::uint64_t present, std::size_t count) {
+    std::uint64_t errors = ~present & (count == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << count) - 1);
+    for (; errors; errors &= errors - 1)
+    {
+      std::size_t j = i + std::size_t(std::countr_zero(errors));
+      if (!f(j, data[j].error()))
+        return false;
+    }
+    return true;
+  });
+}
+
+} // namespace detail_
+
+// Counts the elements holding a value and holding each error code in one pass.
+template <markable_expected_contiguous_range R>
+error_counts<detail_::range_expected_t<R>::error_count> count_errors(R&& r)
+{
+  error_counts<detail_::range_expected_t<R>::error_count> c;
+  std::size_t n = std::ranges::size(r), errors = 0;
+  detail_::for_each_error(supported_simd_isa(), std::ranges::data(r), n, [&](std::size_t, auto e) {
+    ++c.errors[std::size_t(e)];
+    ++errors;
+    return true;
+  });
+  c.values = n - errors;
+  return c;
+}
+
+// Returns the index of the first element holding an error, or the size of the range if there is none.
+template <markable_expected_contiguous_range R>
+std::size_t find_first_error(R&& r)
+{
+  std::size_t pos = std::ranges::size(r);
+  detail_::for_each_error(supported_simd_isa(), std::ranges::data(r), pos, [&pos](std::size_t i, auto) {
+    pos = i;
+    return false;
+  });
+  return pos;
+}
+
+} // namespace markable_ns
+
+using markable_ns::markable_unexpected;
+using markable_ns::markable_expected;
+using markable_ns::error_counts;
+using markable_ns::count_errors;
+using markable_ns::find_first_error;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_EXPECTED_HEADER_GUARD_
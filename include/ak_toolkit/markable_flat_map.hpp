@@ -0,0 +1,509 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_FLAT_MAP_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_FLAT_MAP_HEADER_GUARD_
+
+// Open-addressing hash set and map whose keys are stored as markable<MP>.
+//
+// The marked value of the policy denotes an empty slot, and a second reserved value,
+// MP::tombstone_value(), denotes an erased one; no per-slot metadata is stored. Keys are
+// kept in their own array, apart from the mapped values, and slots are grouped by cache
+// line: a lookup examines every key in the line the key hashes to, and only continues to
+// the next line if that line has no empty slot.
+
+#include "markable.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// mark_int with a second reserved value marking erased slots in markable_flat_map and markable_flat_set.
+template <typename T, T Val, T TombstoneVal>
+struct mark_int_tombstone : mark_int<T, Val>
+{
+  static_assert(Val != TombstoneVal, "the tombstone must differ from the marked value");
+
+  static AK_TOOLKIT_CONSTEXPR T tombstone_value() AK_TOOLKIT_NOEXCEPT { return TombstoneVal; }
+};
+
+namespace detail_ {
+
+template <typename MP>
+struct has_tombstone : std::bool_constant<requires { MP::tombstone_value(); }> {};
+
+// Shared implementation of markable_flat_set (Mapped is void) and markable_flat_map.
+template <typename MP, typename Mapped, typename Hash>
+class flat_table
+{
+  static_assert(has_tombstone<MP>::value, "the mark policy must declare static function tombstone_value()");
+  static_assert(std::is_trivially_copyable<typename MP::storage_type>::value, "flat tables require a trivially copyable storage_type");
+  static_assert(sizeof(markable<MP>) == sizeof(typename MP::storage_type), "markable<MP> must have the layout of its storage");
+
+public:
+  typedef typename MP::value_type key_type;
+  typedef std::size_t size_type;
+
+protected:
+  typedef markable<MP> slot_type;
+  typedef typename MP::storage_type storage_type;
+  typedef typename std::conditional<std::is_void<Mapped>::value, char, Mapped>::type mapped_type;
+
+  static constexpr bool is_map = !std::is_void<Mapped>::value;
+  static constexpr size_type cache_line = 64;
+  static constexpr size_type group_size = sizeof(slot_type) < cache_line ? cache_line / sizeof(slot_type) : 1;
+  static constexpr size_type min_capacity = group_size < 16 ? 16 : group_size;
+  static constexpr size_type npos = size_type(-1);
+
+  static_assert(cache_line % sizeof(slot_type) == 0 || group_size == 1, "keys must not straddle cache lines");
+
+  slot_type* _keys = nullptr;
+  mapped_type* _values = nullptr;
+  size_type _capacity = 0;   // 0 or a power of two, not less than min_capacity
+  size_type _size = 0;
+  size_type _tombstones = 0;
+  unsigned _shift = 64;      // 64 - log2(_capacity)
+  Hash _hash;
+
+  static bool is_tombstone(const slot_type& s) { return MP::representation(s.storage_value()) == MP::tombstone_value(); }
+  static bool is_occupied(const slot_type& s) { return s.has_value() && !is_tombstone(s); }
+
+  static bool is_valid_key(const key_type& k)
+  {
+    const storage_type s = MP::store_value(k);
+    return !MP::is_marked_value(MP::representation(s)) && !(MP::representation(s) == MP::tombstone_value());
+  }
+
+  static size_type capacity_for(size_type n)
+  {
+    size_type c = min_capacity;
+    while (n * 8 > c * 7) // max load factor 7/8
+      c *= 2;
+    return c;
+  }
+
+  // First slot of the group `k` hashes to (Fibonacci hashing of the hash value) in a table of
+  // 2^(64 - shift) slots.
+  size_type home(const key_type& k, unsigned shift) const
+  {
+    std::uint64_t h = std::uint64_t(_hash(k)) * 0x9E3779B97F4A7C15ull;
+    return size_type(h >> shift) & ~(group_size - 1);
+  }
+
+  size_type home(const key_type& k) const { return home(k, _shift); }
+
+  size_type next_group(size_type base) const AK_TOOLKIT_NOEXCEPT { return (base + group_size) & (_capacity - 1); }
+
+  // Returns the slot holding `k`, or npos.
+  size_type find_slot(const key_type& k) const
+  {
+    AK_TOOLKIT_ASSERT(is_valid_key(k));
+    if (_size == 0)
+      return npos;
+    for (size_type base = home(k);; base = next_group(base))
+    {
+      bool group_has_empty = false;
+      for (size_type i = base; i != base + group_size; ++i)
+      {
+        if (!_keys[i].has_value())
+          group_has_empty = true;
+        else if (MP::access_value(_keys[i].storage_value()) == k) // a tombstone never compares equal to a valid key
+          return i;
+      }
+      if (group_has_empty)
+        return npos;
+    }
+  }
+
+  // Returns {slot holding `k`, false}, or {free slot where `k` belongs, true}. Does not modify the slot.
+  std::pair<size_type, bool> find_or_prepare_slot(const key_type& k)
+  {
+    AK_TOOLKIT_ASSERT(is_valid_key(k));
+    if ((_size + _tombstones + 1) * 8 > _capacity * 7)
+      rehash(capacity_for(2 * (_size + 1)));
+
+    size_type free = npos;
+    for (size_type base = home(k);; base = next_group(base))
+    {
+      bool group_has_empty = false;
+      for (size_type i = base; i != base + group_size; ++i)
+      {
+        if (!_keys[i].has_value())
+        {
+          group_has_empty = true;
+          if (free == npos)
+            free = i;
+        }
+        else if (is_tombstone(_keys[i]))
+        {
+          if (free == npos)
+            free = i;
+        }
+        else if (MP::access_value(_keys[i].storage_value()) == k)
+          return {i, false};
+      }
+      if (group_has_empty)
+        return {free, true};
+    }
+  }
+
+  // Stores `k` in a slot returned by find_or_prepare_slot; the mapped value must already be constructed.
+  void occupy(size_type i, const key_type& k)
+  {
+    if (_keys[i].has_value())
+      --_tombstones;
+    _keys[i].assign(k);
+    ++_size;
+  }
+
+  void erase_slot(size_type i)
+  {
+    if constexpr (is_map)
+      std::destroy_at(_values + i);
+    --_size;
+
+    // A group with an empty slot is never probed past, so the erased slot can become empty too.
+    size_type base = i & ~(group_size - 1);
+    bool group_has_empty = false;
+    for (size_type j = base; j != base + group_size; ++j)
+      group_has_empty |= !_keys[j].has_value();
+
+    if (group_has_empty)
+      _keys[i] = slot_type();
+    else
+    {
+      _keys[i].assign_storage(storage_type(MP::tombstone_value()));
+      ++_tombstones;
+    }
+  }
+
+  static slot_type* allocate_keys(size_type n)
+  {
+    slot_type* p = static_cast<slot_type*>(::operator new(n * sizeof(slot_type), std::align_val_t(cache_line)));
+    std::uninitialized_value_construct_n(p, n);
+    return p;
+  }
+
+  static void deallocate_keys(slot_type* p) AK_TOOLKIT_NOEXCEPT
+  {
+    ::operator delete(p, std::align_val_t(cache_line));
+  }
+
+  void destroy_all() AK_TOOLKIT_NOEXCEPT
+  {
+    if (!_keys)
+      return;
+    if constexpr (is_map)
+    {
+      if (!std::is_trivially_destructible<mapped_type>::value)
+        for (size_type i = 0; i != _capacity; ++i)
+          if (is_occupied(_keys[i]))
+            std::destroy_at(_values + i);
+      std::allocator<mapped_type>().deallocate(_values, _capacity);
+    }
+    deallocate_keys(_keys);
+  }
+
+  // Moves all elements into a fresh table of `new_capacity` slots, dropping the tombstones.
+  // The members are switched to the new table only once it is filled: if the hash or the copy of
+  // a mapped value throws (values are moved only if that cannot throw), the table is unchanged.
+  void rehash(size_type new_capacity)
+  {
+    slot_type* keys = allocate_keys(new_capacity);
+    mapped_type* values = nullptr;
+    if constexpr (is_map)
+    {
+      try {
+        values = std::allocator<mapped_type>().allocate(new_capacity);
+      }
+      catch (...) {
+        deallocate_keys(keys);
+        throw;
+      }
+    }
+
+    unsigned shift = 64;
+    for (size_type c = new_capacity; c > 1; c /= 2)
+      --shift;
+
+    try {
+      for (size_type i = 0; i != _capacity; ++i)
+      {
+        if (!is_occupied(_keys[i]))
+          continue;
+        const key_type& k = MP::access_value(_keys[i].storage_value());
+        for (size_type base = home(k, shift);; base = (base + group_size) & (new_capacity - 1))
+        {
+          size_type j = base;
+          while (j != base + group_size && keys[j].has_value())
+            ++j;
+          if (j != base + group_size)
+          {
+            if constexpr (is_map)
+              std::construct_at(values + j, std::move_if_noexcept(_values[i]));
+            keys[j] = _keys[i]; // only after the value is constructed, for the cleanup below
+            break;
+          }
+        }
+      }
+    }
+    catch (...) {
+      if constexpr (is_map)
+      {
+        for (size_type j = 0; j != new_capacity; ++j)
+          if (keys[j].has_value())
+            std::destroy_at(values + j);
+        std::allocator<mapped_type>().deallocate(values, new_capacity);
+      }
+      deallocate_keys(keys);
+      throw;
+    }
+
+    destroy_all();
+    _keys = keys;
+    _values = values;
+    _capacity = new_capacity;
+    _shift = shift;
+    _tombstones = 0;
+  }
+
+  flat_table() = default;
+
+  explicit flat_table(size_type expected_size, const Hash& hash = Hash())
+    : _hash(hash)
+  {
+    if (expected_size)
+      rehash(capacity_for(expected_size));
+  }
+
+  flat_table(flat_table&& rhs) AK_TOOLKIT_NOEXCEPT
+    : _keys(rhs._keys), _values(rhs._values), _capacity(rhs._capacity), _size(rhs._size),
+      _tombstones(rhs._tombstones), _shift(rhs._shift), _hash(rhs._hash)
+  {
+    rhs._keys = nullptr;
+    rhs._values = nullptr;
+    rhs._capacity = rhs._size = rhs._tombstones = 0;
+    rhs._shift = 64;
+  }
+
+  ~flat_table() { destroy_all(); }
+
+  void swap_impl(flat_table& rhs) AK_TOOLKIT_NOEXCEPT
+  {
+    using std::swap;
+    swap(_keys, rhs._keys);
+    swap(_values, rhs._values);
+    swap(_capacity, rhs._capacity);
+    swap(_size, rhs._size);
+    swap(_tombstones, rhs._tombstones);
+    swap(_shift, rhs._shift);
+    swap(_hash, rhs._hash);
+  }
+
+public:
+  size_type size() const AK_TOOLKIT_NOEXCEPT { return _size; }
+  bool empty() const AK_TOOLKIT_NOEXCEPT { return _size == 0; }
+  size_type capacity() const AK_TOOLKIT_NOEXCEPT { return _capacity; } // number of slots
+
+  bool contains(const key_type& k) const { return find_slot(k) != npos; }
+
+  // Makes room for `n` elements without further rehashing.
+  void reserve(size_type n)
+  {
+    if (capacity_for(n) > _capacity)
+      rehash(capacity_for(n));
+  }
+
+  bool erase(const key_type& k)
+  {
+    size_type i = find_slot(k);
+    if (i == npos)
+      return false;
+    erase_slot(i);
+    return true;
+  }
+
+  void clear() AK_TOOLKIT_NOEXCEPT
+  {
+    for (size_type i = 0; i != _capacity; ++i)
+    {
+      if constexpr (is_map)
+      {
+        if (is_occupied(_keys[i]))
+          std::destroy_at(_values + i);
+      }
+      _keys[i] = slot_type();
+    }
+    _size = _tombstones = 0;
+  }
+};
+
+} // namespace detail_
+
+// Hash set of keys of MP::value_type; neither the marked value nor MP::tombstone_value() can be stored.
+template <AK_TOOLKIT_MARK_POLICY MP, typename Hash = std::hash<typename MP::value_type>>
+class markable_flat_set : public detail_::flat_table<MP, void, Hash>
+{
+  typedef detail_::flat_table<MP, void, Hash> base;
+
+public:
+  typedef typename base::key_type key_type;
+  typedef typename base::size_type size_type;
+
+  markable_flat_set() = default;
+  explicit markable_flat_set(size_type expected_size, const Hash& hash = Hash()) : base(expected_size, hash) {}
+
+  markable_flat_set(const markable_flat_set& rhs) : base(rhs._size, rhs._hash)
+  {
+    rhs.for_each([&](const key_type& k) { insert(k); });
+  }
+
+  markable_flat_set(markable_flat_set&&) = default;
+
+  markable_flat_set& operator=(markable_flat_set rhs) AK_TOOLKIT_NOEXCEPT
+  {
+    this->swap_impl(rhs);
+    return *this;
+  }
+
+  // Returns true if `k` was not yet in the set.
+  bool insert(const key_type& k)
+  {
+    std::pair<size_type, bool> r = this->find_or_prepare_slot(k);
+    if (r.second)
+      this->occupy(r.first, k);
+    return r.second;
+  }
+
+  // Calls f(key) for every element, in unspecified order.
+  template <typename F>
+  void for_each(F&& f) const
+  {
+    for (size_type i = 0; i != this->_capacity; ++i)
+      if (base::is_occupied(this->_keys[i]))
+        f(MP::access_value(this->_keys[i].storage_value()));
+  }
+
+  friend void swap(markable_flat_set& l, markable_flat_set& r) AK_TOOLKIT_NOEXCEPT { l.swap_impl(r); }
+};
+
+// Hash map from keys of MP::value_type to T; neither the marked value nor MP::tombstone_value() can be a key.
+template <AK_TOOLKIT_MARK_POLICY MP, typename T, typename Hash = std::hash<typename MP::value_type>>
+class markable_flat_map : public detail_::flat_table<MP, T, Hash>
+{
+  typedef detail_::flat_table<MP, T, Hash> base;
+
+public:
+  typedef typename base::key_type key_type;
+  typedef T mapped_type;
+  typedef typename base::size_type size_type;
+
+  markable_flat_map() = default;
+  explicit markable_flat_map(size_type expected_size, const Hash& hash = Hash()) : base(expected_size, hash) {}
+
+  markable_flat_map(const markable_flat_map& rhs) : base(rhs._size, rhs._hash)
+  {
+    rhs.for_each([&](const key_type& k, const T& v) { insert(k, v); });
+  }
+
+  markable_flat_map(markable_flat_map&&) = default;
+
+  markable_flat_map& operator=(markable_flat_map rhs) AK_TOOLKIT_NOEXCEPT
+  {
+    this->swap_impl(rhs);
+    return *this;
+  }
+
+  // Returns a pointer to the value mapped to `k`, or nullptr.
+  T* find(const key_type& k)
+  {
+    size_type i = this->find_slot(k);
+    return i == base::npos ? nullptr : this->_values + i;
+  }
+
+  const T* find(const key_type& k) const
+  {
+    size_type i = this->find_slot(k);
+    return i == base::npos ? nullptr : this->_values + i;
+  }
+
+  // Maps `k` to a T constructed from `args` unless `k` is already present; returns true if it was not.
+  template <typename... Args>
+  bool try_emplace(const key_type& k, Args&&... args)
+  {
+    std::pair<size_type, bool> r = this->find_or_prepare_slot(k);
+    if (r.second)
+    {
+      std::construct_at(this->_values + r.first, std::forward<Args>(args)...);
+      this->occupy(r.first, k);
+    }
+    return r.second;
+  }
+
+  bool insert(const key_type& k, const T& v) { return try_emplace(k, v); }
+  bool insert(const key_type& k, T&& v) { return try_emplace(k, std::move(v)); }
+
+  // Maps `k` to `v`, replacing the previous value; returns true if `k` was not present.
+  template <typename U>
+  bool insert_or_assign(const key_type& k, U&& v)
+  {
+    std::pair<size_type, bool> r = this->find_or_prepare_slot(k);
+    if (!r.second)
+      this->_values[r.first] = std::forward<U>(v);
+    else
+    {
+      std::construct_at(this->_values + r.first, std::forward<U>(v));
+      this->occupy(r.first, k);
+    }
+    return r.second;
+  }
+
+  T& operator[](const key_type& k)
+  {
+    std::pair<size_type, bool> r = this->find_or_prepare_slot(k);
+    if (r.second)
+    {
+      std::construct_at(this->_values + r.first);
+      this->occupy(r.first, k);
+    }
+    return this->_values[r.first];
+  }
+
+  // Calls f(key, value) for every element, in unspecified order.
+  template <typename F>
+  void for_each(F&& f)
+  {
+    for (size_type i = 0; i != this->_capacity; ++i)
+      if (base::is_occupied(this->_keys[i]))
+        f(MP::access_value(this->_keys[i].storage_value()), this->_values[i]);
+  }
+
+  template <typename F>
+  void for_each(F&& f) const
+  {
+    for (size_type i = 0; i != this->_capacity; ++i)
+      if (base::is_occupied(this->_keys[i]))
+        f(MP::access_value(this->_keys[i].storage_value()), static_cast<const T&>(this->_values[i]));
+  }
+
+  friend void swap(markable_flat_map& l, markable_flat_map& r) AK_TOOLKIT_NOEXCEPT { l.swap_impl(r); }
+};
+
+} // namespace markable_ns
+
+using markable_ns::mark_int_tombstone;
+using markable_ns::markable_flat_set;
+using markable_ns::markable_flat_map;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_FLAT_MAP_HEADER_GUARD_
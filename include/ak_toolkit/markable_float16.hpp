@@ -0,0 +1,359 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_FLOAT16_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_FLOAT16_HEADER_GUARD_
+
+// 16-bit floating-point storage for markable floats: mark_half_nan (IEEE binary16) and
+// mark_bf16_nan (bfloat16) store a 16-bit pattern and return float. Storing a float rounds it
+// to nearest, ties to even; every NaN becomes the marked value, a quiet NaN, so NaNs cannot
+// be stored as values (as with mark_fp_nan) and the marked state is one bit pattern.
+//
+// from_floats and to_floats convert whole columns, with F16C, AVX2 or AVX-512 (BF16)
+// instructions when the CPU has them.
+
+#include "markable.hpp"
+#include "markable_algorithm.hpp"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+namespace detail_ {
+
+constexpr std::uint16_t half_marked_bits = 0x7E00;
+constexpr std::uint16_t bf16_marked_bits = 0x7FC0;
+
+inline AK_TOOLKIT_CONSTEXPR std::uint16_t float_to_half_bits(float f) AK_TOOLKIT_NOEXCEPT
+{
+  const std::uint32_t x = std::bit_cast<std::uint32_t>(f);
+  const std::uint16_t sign = std::uint16_t((x >> 16) & 0x8000);
+  const std::uint32_t ax = x & 0x7FFFFFFF;
+  if (ax > 0x7F800000)
+    return half_marked_bits;
+  if (ax >= 0x477FF000) // 65520 and above round to infinity
+    return std::uint16_t(sign | 0x7C00);
+  if (ax <= 0x33000000) // 2^-25 and below round to zero
+    return sign;
+
+  const std::uint32_t e = ax >> 23;
+  std::uint32_t r, rem, halfway;
+  if (e < 113) // a subnormal half: units of 2^-24
+  {
+    const std::uint32_t m = (ax & 0x7FFFFF) | 0x800000, s = 126 - e;
+    r = m >> s;
+    rem = m & ((std::uint32_t(1) << s) - 1);
+    halfway = std::uint32_t(1) << (s - 1);
+  }
+  else
+  {
+    r = ((e - 112) << 10) | ((ax & 0x7FFFFF) >> 13);
+    rem = ax & 0x1FFF;
+    halfway = 0x1000;
+  }
+  r += rem > halfway || (rem == halfway && (r & 1)); // a carry moves into the exponent correctly
+  return std::uint16_t(sign | r);
+}
+
+inline AK_TOOLKIT_CONSTEXPR float half_bits_to_float(std::uint16_t h) AK_TOOLKIT_NOEXCEPT
+{
+  const std::uint32_t sign = std::uint32_t(h & 0x8000) << 16;
+  std::uint32_t e = (h >> 10) & 0x1F, m = h & 0x3FF;
+  if (e == 0x1F) // infinities, and NaNs, which are made quiet like F16C does
+    return std::bit_cast<float>(sign | 0x7F800000 | (m << 13) | (m ? 0x400000u : 0u));
+  if (e == 0)
+  {
+    if (m == 0)
+      return std::bit_cast<float>(sign);
+    e = 113; // normalize the subnormal
+    while (!(m & 0x400))
+    {
+      m <<= 1;
+      --e;
+    }
+    return std::bit_cast<float>(sign | (e << 23) | ((m & 0x3FF) << 13));
+  }
+  return std::bit_cast<float>(sign | ((e + 112) << 23) | (m << 13));
+}
+
+// Subnormal floats become zero, as with the AVX-512 BF16 instructions, so that every path agrees.
+inline AK_TOOLKIT_CONSTEXPR std::uint16_t float_to_bf16_bits(float f) AK_TOOLKIT_NOEXCEPT
+{
+  std::uint32_t x = std::bit_cast<std::uint32_t>(f);
+  if ((x & 0x7FFFFFFF) > 0x7F800000)
+    return bf16_marked_bits;
+  if ((x & 0x7F800000) == 0)
+    x &= 0x80000000;
+  return std::uint16_t((x + 0x7FFF + ((x >> 16) & 1)) >> 16);
+}
+
+inline AK_TOOLKIT_CONSTEXPR float bf16_bits_to_float(std::uint16_t b) AK_TOOLKIT_NOEXCEPT
+{
+  return std::bit_cast<float>(std::uint32_t(b) << 16);
+}
+
+} // namespace detail_
+
+// IEEE binary16 storage of float values; the marked value is the quiet NaN 0x7E00.
+struct mark_half_nan : markable_type<float, std::uint16_t, float, std::uint16_t>
+{
+  typedef bit_pattern_marking marking;
+
+  static AK_TOOLKIT_CONSTEXPR std::uint16_t marked_value() AK_TOOLKIT_NOEXCEPT { return detail_::half_marked_bits; }
+  static AK_TOOLKIT_CONSTEXPR bool is_marked_value(std::uint16_t v) AK_TOOLKIT_NOEXCEPT { return v == detail_::half_marked_bits; }
+
+  static AK_TOOLKIT_CONSTEXPR float access_value(const std::uint16_t& v) AK_TOOLKIT_NOEXCEPT { return detail_::half_bits_to_float(v); }
+  static AK_TOOLKIT_CONSTEXPR std::uint16_t store_value(const float& v) AK_TOOLKIT_NOEXCEPT { return detail_::float_to_half_bits(v); }
+};
+
+// bfloat16 storage of float values (the upper half of a float); the marked value is the quiet NaN 0x7FC0.
+struct mark_bf16_nan : markable_type<float, std::uint16_t, float, std::uint16_t>
+{
+  typedef bit_pattern_marking marking;
+
+  static AK_TOOLKIT_CONSTEXPR std::uint16_t marked_value() AK_TOOLKIT_NOEXCEPT { return detail_::bf16_marked_bits; }
+  static AK_TOOLKIT_CONSTEXPR bool is_marked_value(std::uint16_t v) AK_TOOLKIT_NOEXCEPT { return v == detail_::bf16_marked_bits; }
+
+  static AK_TOOLKIT_CONSTEXPR float access_value(const std::uint16_t& v) AK_TOOLKIT_NOEXCEPT { return detail_::bf16_bits_to_float(v); }
+  static AK_TOOLKIT_CONSTEXPR std::uint16_t store_value(const float& v) AK_TOOLKIT_NOEXCEPT { return detail_::float_to_bf16_bits(v); }
+};
+
+namespace detail_ {
+
+// Instruction sets of the conversions: avx2 also needs F16C, avx512bf16 only speeds up bfloat16 stores.
+enum class float16_isa { scalar, avx2, avx512, avx512bf16 };
+
+inline float16_isa detect_float16_isa() AK_TOOLKIT_NOEXCEPT
+{
+#if defined AK_TOOLKIT_MARKABLE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    return __builtin_cpu_supports("avx512bf16") ? float16_isa::avx512bf16 : float16_isa::avx512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c"))
+    return float16_isa::avx2;
+#endif
+  return float16_isa::scalar;
+}
+
+inline float16_isa supported_float16_isa() AK_TOOLKIT_NOEXCEPT
+{
+  static const float16_isa isa = detect_float16_isa();
+  return isa;
+}
+
+template <typename MP> struct float16_format : std::false_type {};
+template <> struct float16_format<mark_half_nan> : std::true_type {};
+template <> struct float16_format<mark_bf16_nan> : std::true_type {};
+
+template <typename MP>
+void floats_to_bits_scalar(const float* in, std::size_t n, std::uint16_t* out) AK_TOOLKIT_NOEXCEPT
+{
+  for (std::size_t i = 0; i != n; ++i)
+    out[i] = MP::store_value(in[i]);
+}
+
+template <typename MP>
+void bits_to_floats_scalar(const std::uint16_t* in, std::size_t n, float* out) AK_TOOLKIT_NOEXCEPT
+{
+  for (std::size_t i = 0; i != n; ++i)
+    out[i] = MP::access_value(in[i]);
+}
+
+#if defined AK_TOOLKIT_MARKABLE_X86_SIMD
+
+// NaN lanes are replaced by the quiet NaN 0x7FC00000 before the conversion, which turns it into the marked value.
+// The AVX-512 kernels use zero-masking forms with a full mask: GCC warns about the unmasked ones at -O2.
+
+AK_TOOLKIT_TARGET("avx2,f16c") inline void floats_to_half_avx2(const float* in, std::size_t n, std::uint16_t* out)
+{
+  const __m256 qnan = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FC00000));
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256 v = _mm256_loadu_ps(in + i);
+    v = _mm256_blendv_ps(v, qnan, _mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+    _mm_storeu_si128((__m128i*)(out + i), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+  }
+  floats_to_bits_scalar<mark_half_nan>(in + i, n - i, out + i);
+}
+
+AK_TOOLKIT_TARGET("avx2,f16c") inline void half_to_floats_avx2(const std::uint16_t* in, std::size_t n, float* out)
+{
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(in + i))));
+  bits_to_floats_scalar<mark_half_nan>(in + i, n - i, out + i);
+}
+
+// Rounds 8 floats to bfloat16 in the low halves of the 32-bit lanes, like float_to_bf16_bits.
+AK_TOOLKIT_TARGET("avx2") inline __m256i round_to_bf16_avx2(__m256 f)
+{
+  const __m256i x0 = _mm256_castps_si256(f);
+  const __m256i subnormal = _mm256_cmpeq_epi32(_mm256_and_si256(x0, _mm256_set1_epi32(0x7F800000)), _mm256_setzero_si256());
+  const __m256i x = _mm256_blendv_epi8(x0, _mm256_and_si256(x0, _mm256_set1_epi32(int(0x80000000u))), subnormal);
+  const __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(1));
+  const __m256i r = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(x, _mm256_set1_epi32(0x7FFF)), lsb), 16);
+  const __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(f, f, _CMP_UNORD_Q));
+  return _mm256_blendv_epi8(r, _mm256_set1_epi32(bf16_marked_bits), nan);
+}
+
+AK_TOOLKIT_TARGET("avx2") inline void floats_to_bf16_avx2(const float* in, std::size_t n, std::uint16_t* out)
+{
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    __m256i lo = round_to_bf16_avx2(_mm256_loadu_ps(in + i));
+    __m256i hi = round_to_bf16_avx2(_mm256_loadu_ps(in + i + 8));
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8); // undo the per-lane interleaving
+    _mm256_storeu_si256((__m256i*)(out + i), packed);
+  }
+  floats_to_bits_scalar<mark_bf16_nan>(in + i, n - i, out + i);
+}
+
+AK_TOOLKIT_TARGET("avx2") inline void bf16_to_floats_avx2(const std::uint16_t* in, std::size_t n, float* out)
+{
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256i w = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(in + i)));
+    _mm256_storeu_si256((__m256i*)(out + i), _mm256_slli_epi32(w, 16));
+  }
+  bits_to_floats_scalar<mark_bf16_nan>(in + i, n - i, out + i);
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw") inline void floats_to_half_avx512(const float* in, std::size_t n, std::uint16_t* out)
+{
+  const __m512 qnan = _mm512_castsi512_ps(_mm512_set1_epi32(0x7FC00000));
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    __m512 v = _mm512_loadu_ps(in + i);
+    v = _mm512_mask_mov_ps(v, _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q), qnan);
+    _mm256_storeu_si256((__m256i*)(out + i), _mm512_maskz_cvtps_ph(0xFFFF, v, _MM_FROUND_TO_NEAREST_INT));
+  }
+  floats_to_bits_scalar<mark_half_nan>(in + i, n - i, out + i);
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw") inline void half_to_floats_avx512(const std::uint16_t* in, std::size_t n, float* out)
+{
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+    _mm512_storeu_ps(out + i, _mm512_maskz_cvtph_ps(0xFFFF, _mm256_loadu_si256((const __m256i*)(in + i))));
+  bits_to_floats_scalar<mark_half_nan>(in + i, n - i, out + i);
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw") inline void floats_to_bf16_avx512(const float* in, std::size_t n, std::uint16_t* out)
+{
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    const __m512 f = _mm512_loadu_ps(in + i);
+    __m512i x = _mm512_castps_si512(f);
+    const __mmask16 subnormal = _mm512_testn_epi32_mask(x, _mm512_set1_epi32(0x7F800000));
+    x = _mm512_mask_and_epi32(x, subnormal, x, _mm512_set1_epi32(int(0x80000000u)));
+    const __m512i lsb = _mm512_and_si512(_mm512_maskz_srli_epi32(0xFFFF, x, 16), _mm512_set1_epi32(1));
+    __m512i r = _mm512_maskz_srli_epi32(0xFFFF, _mm512_add_epi32(_mm512_add_epi32(x, _mm512_set1_epi32(0x7FFF)), lsb), 16);
+    r = _mm512_mask_mov_epi32(r, _mm512_cmp_ps_mask(f, f, _CMP_UNORD_Q), _mm512_set1_epi32(bf16_marked_bits));
+    _mm256_storeu_si256((__m256i*)(out + i), _mm512_maskz_cvtepi32_epi16(0xFFFF, r));
+  }
+  floats_to_bits_scalar<mark_bf16_nan>(in + i, n - i, out + i);
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw,avx512bf16") inline void floats_to_bf16_avx512bf16(const float* in, std::size_t n, std::uint16_t* out)
+{
+  const __m512 qnan = _mm512_castsi512_ps(_mm512_set1_epi32(0x7FC00000));
+  std::size_t i = 0;
+  for (; i + 32 <= n; i += 32)
+  {
+    __m512 lo = _mm512_loadu_ps(in + i), hi = _mm512_loadu_ps(in + i + 16);
+    lo = _mm512_mask_mov_ps(lo, _mm512_cmp_ps_mask(lo, lo, _CMP_UNORD_Q), qnan);
+    hi = _mm512_mask_mov_ps(hi, _mm512_cmp_ps_mask(hi, hi, _CMP_UNORD_Q), qnan);
+    _mm512_storeu_si512(out + i, (__m512i)_mm512_cvtne2ps_pbh(hi, lo));
+  }
+  floats_to_bf16_avx512(in + i, n - i, out + i);
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw") inline void bf16_to_floats_avx512(const std::uint16_t* in, std::size_t n, float* out)
+{
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    __m512i w = _mm512_maskz_cvtepu16_epi32(0xFFFF, _mm256_loadu_si256((const __m256i*)(in + i)));
+    _mm512_storeu_si512(out + i, _mm512_maskz_slli_epi32(0xFFFF, w, 16));
+  }
+  bits_to_floats_scalar<mark_bf16_nan>(in + i, n - i, out + i);
+}
+
+#endif // AK_TOOLKIT_MARKABLE_X86_SIMD
+
+template <typename MP>
+void floats_to_bits(float16_isa isa, const float* in, std::size_t n, std::uint16_t* out)
+{
+  constexpr bool half = std::is_same<MP, mark_half_nan>::value;
+  switch (isa)
+  {
+#if defined AK_TOOLKIT_MARKABLE_X86_SIMD
+    case float16_isa::avx512bf16: return half ? floats_to_half_avx512(in, n, out) : floats_to_bf16_avx512bf16(in, n, out);
+    case float16_isa::avx512:     return half ? floats_to_half_avx512(in, n, out) : floats_to_bf16_avx512(in, n, out);
+    case float16_isa::avx2:       return half ? floats_to_half_avx2(in, n, out) : floats_to_bf16_avx2(in, n, out);
+#endif
+    default:                      return floats_to_bits_scalar<MP>(in, n, out);
+  }
+}
+
+template <typename MP>
+void bits_to_floats(float16_isa isa, const std::uint16_t* in, std::size_t n, float* out)
+{
+  constexpr bool half = std::is_same<MP, mark_half_nan>::value;
+  switch (isa)
+  {
+#if defined AK_TOOLKIT_MARKABLE_X86_SIMD
+    case float16_isa::avx512bf16:
+    case float16_isa::avx512:     return half ? half_to_floats_avx512(in, n, out) : bf16_to_floats_avx512(in, n, out);
+    case float16_isa::avx2:       return half ? half_to_floats_avx2(in, n, out) : bf16_to_floats_avx2(in, n, out);
+#endif
+    default:                      return bits_to_floats_scalar<MP>(in, n, out);
+  }
+}
+
+} // namespace detail_
+
+// Stores in[i] in out[i] for a column of mark_half_nan or mark_bf16_nan, like markable(in[i]):
+// NaNs become marked. The sizes must be equal.
+template <markable_contiguous_range R>
+  requires (detail_::float16_format<detail_::range_policy_t<R>>::value)
+void from_floats(std::span<const float> in, R&& out)
+{
+  typedef detail_::range_policy_t<R> MP;
+  AK_TOOLKIT_ASSERT(in.size() == std::ranges::size(out));
+  detail_::floats_to_bits<MP>(detail_::supported_float16_isa(), in.data(), in.size(),
+                              reinterpret_cast<std::uint16_t*>(std::ranges::data(out)));
+}
+
+// Writes the value of in[i] to out[i], and a quiet NaN for the marked elements. The sizes must be equal.
+template <markable_contiguous_range R>
+  requires (detail_::float16_format<detail_::range_policy_t<R>>::value)
+void to_floats(R&& in, std::span<float> out)
+{
+  typedef detail_::range_policy_t<R> MP;
+  AK_TOOLKIT_ASSERT(out.size() == std::ranges::size(in));
+  detail_::bits_to_floats<MP>(detail_::supported_float16_isa(), reinterpret_cast<const std::uint16_t*>(std::ranges::data(in)),
+                              out.size(), out.data());
+}
+
+} // namespace markable_ns
+
+using markable_ns::mark_half_nan;
+using markable_ns::mark_bf16_nan;
+using markable_ns::from_floats;
+using markable_ns::to_floats;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_FLOAT16_HEADER_GUARD_
@@ -0,0 +1,290 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_MAPPED_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_MAPPED_HEADER_GUARD_
+
+// Arrays of markable<MP> persisted in a file and accessed through mmap (POSIX only).
+//
+// When MP::storage_type is trivially copyable, an array of markable<MP> needs no
+// serialization: the file is a 64-byte header followed by the raw array. The header
+// records the identity of the policy (element size, the bit pattern of the marked value,
+// the marking kind) and the byte order, so that a file written with a different policy
+// or on a different architecture is rejected when it is opened.
+
+#include "markable.hpp"
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+class mapped_array_error : public std::runtime_error
+{
+public:
+  using std::runtime_error::runtime_error;
+};
+
+enum class map_mode { read_only, read_write };
+
+namespace detail_ {
+
+struct mapped_array_header
+{
+  static constexpr std::uint32_t current_version = 1;
+  static constexpr std::uint32_t byte_order_mark = 0x01020304;
+
+  char          magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;     // byte_order_mark as written by the producer
+  std::uint32_t element_size;
+  std::uint32_t marking;        // 0: unknown, 1: bit pattern, 2: NaN, 3: sign bit, 4: integer range
+  std::uint64_t size;           // number of elements
+  unsigned char marked_value[32];
+};
+
+static_assert(sizeof(mapped_array_header) == 64, "header must keep the elements 64-byte aligned");
+
+inline constexpr char mapped_array_magic[8] = {'A', 'K', 'M', 'A', 'R', 'K', 'A', 'R'};
+
+template <typename Marking> inline constexpr std::uint32_t marking_id = 0;
+template <> inline constexpr std::uint32_t marking_id<bit_pattern_marking> = 1;
+template <> inline constexpr std::uint32_t marking_id<nan_marking> = 2;
+template <> inline constexpr std::uint32_t marking_id<sign_bit_marking> = 3;
+template <> inline constexpr std::uint32_t marking_id<int_range_marking> = 4;
+
+// Writes the marked value of the header; a range of marked values is written as its first and last value.
+template <typename MP>
+void store_marked_value(unsigned char (&out)[32])
+{
+  typedef typename MP::storage_type storage_type;
+  const storage_type marked(MP::marked_value());
+  std::memcpy(out, &marked, sizeof(storage_type));
+  if constexpr (std::is_same<typename marking_of<MP>::type, int_range_marking>::value)
+  {
+    const storage_type last(MP::last_marked_value());
+    std::memcpy(out + sizeof(storage_type), &last, sizeof(storage_type));
+  }
+}
+
+template <typename MP>
+mapped_array_header make_mapped_array_header(std::uint64_t size)
+{
+  typedef typename MP::storage_type storage_type;
+  mapped_array_header h {};
+  std::memcpy(h.magic, mapped_array_magic, sizeof(h.magic));
+  h.version = mapped_array_header::current_version;
+  h.byte_order = mapped_array_header::byte_order_mark;
+  h.element_size = sizeof(storage_type);
+  h.marking = marking_id<typename marking_of<MP>::type>;
+  h.size = size;
+  store_marked_value<MP>(h.marked_value);
+  return h;
+}
+
+template <typename MP>
+void check_mapped_array_header(const mapped_array_header& h, std::uint64_t file_size)
+{
+  mapped_array_header expected = make_mapped_array_header<MP>(h.size);
+  if (std::memcmp(h.magic, expected.magic, sizeof(h.magic)) != 0)
+    throw mapped_array_error("not a markable array file");
+  if (h.version != expected.version)
+    throw mapped_array_error("unsupported markable array file version");
+  if (h.byte_order != expected.byte_order)
+    throw mapped_array_error("markable array file has a different byte order");
+  if (h.element_size != expected.element_size || h.marking != expected.marking
+      || std::memcmp(h.marked_value, expected.marked_value, sizeof(h.marked_value)) != 0)
+    throw mapped_array_error("markable array file was written with a different mark policy");
+  if (file_size < sizeof(mapped_array_header) || (file_size - sizeof(mapped_array_header)) / h.element_size < h.size)
+    throw mapped_array_error("markable array file is truncated");
+}
+
+[[noreturn]] inline void throw_errno(const char* what)
+{
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+class file_descriptor
+{
+  int _fd;
+
+public:
+  explicit file_descriptor(int fd) AK_TOOLKIT_NOEXCEPT : _fd(fd) {}
+  file_descriptor(const file_descriptor&) = delete;
+  file_descriptor& operator=(const file_descriptor&) = delete;
+  ~file_descriptor() { if (_fd >= 0) ::close(_fd); }
+  int get() const AK_TOOLKIT_NOEXCEPT { return _fd; }
+};
+
+} // namespace detail_
+
+// A fixed-size array of markable<MP> living in a memory-mapped file.
+// Opening an existing file costs one mmap call regardless of its size; pages are
+// loaded on first access.
+template <AK_TOOLKIT_MARK_POLICY MP>
+class mapped_markable_array
+{
+  static_assert(std::is_trivially_copyable<typename MP::storage_type>::value,
+                "mapped_markable_array requires a trivially copyable storage_type");
+  static_assert(sizeof(markable<MP>) == sizeof(typename MP::storage_type), "markable<MP> must have the layout of its storage");
+  static_assert(sizeof(typename MP::storage_type) <= sizeof(detail_::mapped_array_header::marked_value),
+                "storage_type too large to be recorded in the file header");
+
+public:
+  typedef markable<MP> element_type;
+  typedef std::size_t size_type;
+
+private:
+  void* _map = nullptr;
+  std::size_t _map_size = 0;
+  size_type _size = 0;
+  map_mode _mode = map_mode::read_only;
+
+  mapped_markable_array(void* map, std::size_t map_size, size_type size, map_mode mode) AK_TOOLKIT_NOEXCEPT
+    : _map(map), _map_size(map_size), _size(size), _mode(mode) {}
+
+  static void* map_file(int fd, std::size_t bytes, map_mode mode)
+  {
+    int prot = mode == map_mode::read_write ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* p = ::mmap(nullptr, bytes, prot, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+      detail_::throw_errno("mmap");
+    return p;
+  }
+
+  element_type* elements() const AK_TOOLKIT_NOEXCEPT
+  {
+    return reinterpret_cast<element_type*>(static_cast<unsigned char*>(_map) + sizeof(detail_::mapped_array_header));
+  }
+
+public:
+  // Creates (or truncates) the file at `path` holding `n` elements without a value, mapped for writing.
+  // Throws std::bad_array_new_length, before touching the file, if its size would not fit in off_t.
+  static mapped_markable_array create(const std::string& path, size_type n)
+  {
+    constexpr std::size_t max_bytes = std::size_t(std::numeric_limits<off_t>::max()) < std::numeric_limits<std::size_t>::max()
+                                    ? std::size_t(std::numeric_limits<off_t>::max()) : std::numeric_limits<std::size_t>::max();
+    if (n > (max_bytes - sizeof(detail_::mapped_array_header)) / sizeof(element_type))
+      throw std::bad_array_new_length();
+
+    detail_::file_descriptor fd(::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644));
+    if (fd.get() < 0)
+      detail_::throw_errno("open");
+    std::size_t bytes = sizeof(detail_::mapped_array_header) + n * sizeof(element_type);
+    if (::ftruncate(fd.get(), off_t(bytes)) != 0)
+      detail_::throw_errno("ftruncate");
+
+    mapped_markable_array ans(map_file(fd.get(), bytes, map_mode::read_write), bytes, n, map_mode::read_write);
+    detail_::mapped_array_header h = detail_::make_mapped_array_header<MP>(n);
+    std::memcpy(ans._map, &h, sizeof(h));
+    std::uninitialized_value_construct_n(ans.elements(), n);
+    return ans;
+  }
+
+  // Maps an existing file; throws mapped_array_error if it was not written with policy MP
+  // on a machine with the same byte order.
+  explicit mapped_markable_array(const std::string& path, map_mode mode = map_mode::read_only)
+    : _mode(mode)
+  {
+    detail_::file_descriptor fd(::open(path.c_str(), mode == map_mode::read_write ? O_RDWR : O_RDONLY));
+    if (fd.get() < 0)
+      detail_::throw_errno("open");
+    struct stat st;
+    if (::fstat(fd.get(), &st) != 0)
+      detail_::throw_errno("fstat");
+    std::size_t bytes = std::size_t(st.st_size);
+    if (bytes < sizeof(detail_::mapped_array_header))
+      throw mapped_array_error("not a markable array file");
+
+    _map = map_file(fd.get(), bytes, mode);
+    _map_size = bytes;
+    detail_::mapped_array_header h;
+    std::memcpy(&h, _map, sizeof(h));
+    try {
+      detail_::check_mapped_array_header<MP>(h, bytes);
+    }
+    catch (...) {
+      ::munmap(_map, _map_size);
+      throw;
+    }
+    _size = size_type(h.size);
+  }
+
+  mapped_markable_array(mapped_markable_array&& rhs) AK_TOOLKIT_NOEXCEPT
+    : _map(rhs._map), _map_size(rhs._map_size), _size(rhs._size), _mode(rhs._mode)
+  {
+    rhs._map = nullptr;
+    rhs._map_size = 0;
+    rhs._size = 0;
+  }
+
+  mapped_markable_array& operator=(mapped_markable_array&& rhs) AK_TOOLKIT_NOEXCEPT
+  {
+    mapped_markable_array tmp(std::move(rhs));
+    std::swap(_map, tmp._map);
+    std::swap(_map_size, tmp._map_size);
+    std::swap(_size, tmp._size);
+    std::swap(_mode, tmp._mode);
+    return *this;
+  }
+
+  ~mapped_markable_array()
+  {
+    if (_map)
+      ::munmap(_map, _map_size);
+  }
+
+  size_type size() const AK_TOOLKIT_NOEXCEPT { return _size; }
+  bool empty() const AK_TOOLKIT_NOEXCEPT { return _size == 0; }
+  map_mode mode() const AK_TOOLKIT_NOEXCEPT { return _mode; }
+
+  const element_type* data() const AK_TOOLKIT_NOEXCEPT { return elements(); }
+  const element_type* begin() const AK_TOOLKIT_NOEXCEPT { return elements(); }
+  const element_type* end() const AK_TOOLKIT_NOEXCEPT { return elements() + _size; }
+  const element_type& operator[](size_type i) const { return AK_TOOLKIT_ASSERT(i < _size), elements()[i]; }
+
+  std::span<const element_type> span() const AK_TOOLKIT_NOEXCEPT { return {elements(), _size}; }
+
+  // Throws mapped_array_error unless the array is mapped with map_mode::read_write.
+  std::span<element_type> mutable_span()
+  {
+    if (_mode != map_mode::read_write)
+      throw mapped_array_error("markable array file is mapped read-only");
+    return std::span<element_type>(elements(), _size);
+  }
+
+  // Schedules writing modified pages back to the file; with `wait` blocks until it is done.
+  void flush(bool wait = true) const
+  {
+    if (_map && ::msync(_map, _map_size, wait ? MS_SYNC : MS_ASYNC) != 0)
+      detail_::throw_errno("msync");
+  }
+};
+
+} // namespace markable_ns
+
+using markable_ns::mapped_markable_array;
+using markable_ns::mapped_array_error;
+using markable_ns::map_mode;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_MAPPED_HEADER_GUARD_
@@ -0,0 +1,628 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_REDUCE_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_REDUCE_HEADER_GUARD_
+
+// Count, sum, minimum, maximum and mean of the values present in an array of markable<MP>
+// with an arithmetic value_type; marked elements are skipped.
+//
+// Floating-point sums depend on the order of additions, so the order is fixed: element i
+// is accumulated in lane i % L, where L is the number of values in 64 bytes, and the lanes
+// are combined pairwise at the end. Every instruction set computes exactly this, so results
+// do not depend on the CPU. Minimum and maximum are computed per lane in the same way,
+// which also fixes which of 0.0 and -0.0 is returned.
+
+#include "markable_algorithm.hpp"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+namespace ak_toolkit {
+namespace markable_ns {
+namespace detail_ {
+
+// float sums are accumulated in double
+template <typename T>
+struct reduce_sum_type
+{
+  typedef typename std::conditional<std::is_floating_point<T>::value, double,
+          typename std::conditional<std::is_signed<T>::value, std::int64_t, std::uint64_t>::type>::type type;
+};
+
+// Per-lane state of a reduction: element i goes to lane i % lanes.
+template <typename T>
+struct reduce_lanes
+{
+  typedef typename reduce_sum_type<T>::type sum_type;
+  static constexpr std::size_t lanes = 64 / sizeof(T);
+
+  std::size_t count = 0;
+  sum_type sum[lanes];
+  T min[lanes];
+  T max[lanes];
+
+  static T upper() AK_TOOLKIT_NOEXCEPT
+  {
+    if constexpr (std::is_floating_point<T>::value)
+      return std::numeric_limits<T>::infinity();
+    else
+      return std::numeric_limits<T>::max();
+  }
+
+  static T lower() AK_TOOLKIT_NOEXCEPT
+  {
+    if constexpr (std::is_floating_point<T>::value)
+      return -std::numeric_limits<T>::infinity();
+    else
+      return std::numeric_limits<T>::lowest();
+  }
+
+  // integer sums wrap around instead of overflowing
+  static sum_type add(sum_type s, T v) AK_TOOLKIT_NOEXCEPT
+  {
+    if constexpr (std::is_floating_point<T>::value)
+      return s + sum_type(v);
+    else
+      return sum_type(std::uint64_t(s) + std::uint64_t(sum_type(v)));
+  }
+
+  reduce_lanes() AK_TOOLKIT_NOEXCEPT
+  {
+    for (std::size_t l = 0; l != lanes; ++l)
+    {
+      sum[l] = sum_type(0);
+      min[l] = upper();
+      max[l] = lower();
+    }
+  }
+
+  // The SIMD kernels reproduce these operations exactly: minpd(v, m) is `v < m ? v : m`.
+  void put(std::size_t lane, T v) AK_TOOLKIT_NOEXCEPT
+  {
+    ++count;
+    sum[lane] = add(sum[lane], v);
+    min[lane] = v < min[lane] ? v : min[lane];
+    max[lane] = v > max[lane] ? v : max[lane];
+  }
+
+  sum_type total_sum() const AK_TOOLKIT_NOEXCEPT
+  {
+    sum_type s[lanes];
+    std::memcpy(s, sum, sizeof(s));
+    for (std::size_t w = lanes / 2; w != 0; w /= 2)
+      for (std::size_t l = 0; l != w; ++l)
+        s[l] = std::is_floating_point<T>::value ? s[l] + s[l + w] : sum_type(std::uint64_t(s[l]) + std::uint64_t(s[l + w]));
+    return s[0];
+  }
+
+  T total_min() const AK_TOOLKIT_NOEXCEPT
+  {
+    T m = min[0];
+    for (std::size_t l = 1; l != lanes; ++l)
+      m = min[l] < m ? min[l] : m;
+    return m;
+  }
+
+  T total_max() const AK_TOOLKIT_NOEXCEPT
+  {
+    T m = max[0];
+    for (std::size_t l = 1; l != lanes; ++l)
+      m = max[l] > m ? max[l] : m;
+    return m;
+  }
+};
+
+// The scalar reference, also used for the tail of every SIMD reduction; `first` is the index
+// of p[0] in the whole array, which determines the lanes.
+template <typename Marking, typename T, typename Pattern>
+void reduce_scalar(const unsigned char* p, std::size_t first, std::size_t n, Pattern pattern, reduce_lanes<T>& s)
+{
+  scalar_kernel<Marking, Pattern> k {pattern};
+  for (std::size_t i = 0; i != n; ++i)
+    if (k.present(p + i * sizeof(T)))
+    {
+      T v;
+      std::memcpy(&v, p + i * sizeof(T), sizeof(T));
+      s.put((first + i) % reduce_lanes<T>::lanes, v);
+    }
+}
+
+// Policies without a known marking.
+template <typename MP>
+void reduce_generic(const markable<MP>* data, std::size_t n, reduce_lanes<typename MP::value_type>& s)
+{
+  for (std::size_t i = 0; i != n; ++i)
+    if (data[i].has_value())
+      s.put(i % reduce_lanes<typename MP::value_type>::lanes, data[i].value());
+}
+
+// Runs kernel K over whole 64-byte blocks, then the scalar reference over the rest.
+template <typename K, typename T>
+AK_TOOLKIT_FORCE_INLINE void reduce_blocks(const unsigned char* p, std::size_t n, T pattern, reduce_lanes<T>& s)
+{
+  constexpr std::size_t lanes = reduce_lanes<T>::lanes;
+  typedef typename uint_of_size<sizeof(T)>::type word;
+  K k;
+  k.load(s, pattern);
+  std::size_t i = 0;
+  for (; i + lanes <= n; i += lanes)
+    k.step(p + i * sizeof(T));
+  k.store(s);
+  reduce_scalar<typename K::marking, T>(p + i * sizeof(T), i, n - i, std::bit_cast<word>(pattern), s);
+}
+
+// SIMD kernels: `step` consumes one 64-byte block; lane l of the block goes to lane l of
+// the accumulators. For NaN marking minpd and maxpd return their second operand when the
+// first is a NaN, so marked lanes keep the accumulator, and NaNs are zeroed before adding
+// (lane sums start at +0.0 and cannot become -0.0, so adding +0.0 changes nothing).
+
+template <typename T> struct has_reduce_kernel : std::false_type {};
+template <> struct has_reduce_kernel<double> : std::true_type {};
+template <> struct has_reduce_kernel<float> : std::true_type {};
+template <> struct has_reduce_kernel<std::int32_t> : std::true_type {};
+template <> struct has_reduce_kernel<std::int64_t> : std::true_type {};
+
+#if defined AK_TOOLKIT_MARKABLE_X86_SIMD
+
+namespace avx2_ {
+
+template <typename T> struct reduce_kernel;
+
+template <> struct reduce_kernel<double>
+{
+  typedef nan_marking marking;
+  __m256d sum[2], min[2], max[2];
+  std::size_t count;
+
+  AK_TOOLKIT_TARGET("avx2") void load(const reduce_lanes<double>& s, double)
+  {
+    for (int h = 0; h != 2; ++h)
+    {
+      sum[h] = _mm256_loadu_pd(s.sum + 4 * h);
+      min[h] = _mm256_loadu_pd(s.min + 4 * h);
+      max[h] = _mm256_loadu_pd(s.max + 4 * h);
+    }
+    count = s.count;
+  }
+
+  AK_TOOLKIT_TARGET("avx2") void step(const unsigned char* p)
+  {
+    for (int h = 0; h != 2; ++h)
+    {
+      __m256d v = _mm256_loadu_pd((const double*)(p + 32 * h));
+      __m256d present = _mm256_cmp_pd(v, v, _CMP_ORD_Q);
+      sum[h] = _mm256_add_pd(sum[h], _mm256_and_pd(v, present));
+      min[h] = _mm256_min_pd(v, min[h]);
+      max[h] = _mm256_max_pd(v, max[h]);
+      count += std::popcount(unsigned(_mm256_movemask_pd(present)));
+    }
+  }
+
+  AK_TOOLKIT_TARGET("avx2") void store(reduce_lanes<double>& s) const
+  {
+    for (int h = 0; h != 2; ++h)
+    {
+      _mm256_storeu_pd(s.sum + 4 * h, sum[h]);
+      _mm256_storeu_pd(s.min + 4 * h, min[h]);
+      _mm256_storeu_pd(s.max + 4 * h, max[h]);
+    }
+    s.count = count;
+  }
+};
+
+template <> struct reduce_kernel<float>
+{
+  typedef nan_marking marking;
+  __m256d sum[4];
+  __m256 min[2], max[2];
+  std::size_t count;
+
+  AK_TOOLKIT_TARGET("avx2") void load(const reduce_lanes<float>& s, float)
+  {
+    for (int q = 0; q != 4; ++q)
+      sum[q] = _mm256_loadu_pd(s.sum + 4 * q);
+    for (int h = 0; h != 2; ++h)
+    {
+      min[h] = _mm256_loadu_ps(s.min + 8 * h);
+      max[h] = _mm256_loadu_ps(s.max + 8 * h);
+    }
+    count = s.count;
+  }
+
+  AK_TOOLKIT_TARGET("avx2") void step(const unsigned char* p)
+  {
+    for (int h = 0; h != 2; ++h)
+    {
+      __m256 v = _mm256_loadu_ps((const float*)(p + 32 * h));
+      __m256 present = _mm256_cmp_ps(v, v, _CMP_ORD_Q);
+      __m256 z = _mm256_and_ps(v, present);
+      sum[2 * h] = _mm256_add_pd(sum[2 * h], _mm256_cvtps_pd(_mm256_castps256_ps128(z)));
+      sum[2 * h + 1] = _mm256_add_pd(sum[2 * h + 1], _mm256_cvtps_pd(_mm256_extractf128_ps(z, 1)));
+      min[h] = _mm256_min_ps(v, min[h]);
+      max[h] = _mm256_max_ps(v, max[h]);
+      count += std::popcount(unsigned(_mm256_movemask_ps(present)));
+    }
+  }
+
+  AK_TOOLKIT_TARGET("avx2") void store(reduce_lanes<float>& s) const
+  {
+    for (int q = 0; q != 4; ++q)
+      _mm256_storeu_pd(s.sum + 4 * q, sum[q]);
+    for (int h = 0; h != 2; ++h)
+    {
+      _mm256_storeu_ps(s.min + 8 * h, min[h]);
+      _mm256_storeu_ps(s.max + 8 * h, max[h]);
+    }
+    s.count = count;
+  }
+};
+
+template <> struct reduce_kernel<std::int32_t>
+{
+  typedef bit_pattern_marking marking;
+  __m256i sum[4], min[2], max[2], pattern;
+  std::size_t count;
+
+  AK_TOOLKIT_TARGET("avx2") void load(const reduce_lanes<std::int32_t>& s, std::int32_t marked)
+  {
+    for (int q = 0; q != 4; ++q)
+      sum[q] = _mm256_loadu_si256((const __m256i*)(s.sum + 4 * q));
+    for (int h = 0; h != 2; ++h)
+    {
+      min[h] = _mm256_loadu_si256((const __m256i*)(s.min + 8 * h));
+      max[h] = _mm256_loadu_si256((const __m256i*)(s.max + 8 * h));
+    }
+    pattern = _mm256_set1_epi32(marked);
+    count = s.count;
+  }
+
+  AK_TOOLKIT_TARGET("avx2") void step(const unsigned char* p)
+  {
+    for (int h = 0; h != 2; ++h)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(p + 32 * h));
+      __m256i marked = _mm256_cmpeq_epi32(v, pattern);
+      __m256i z = _mm256_andnot_si256(marked, v);
+      sum[2 * h] = _mm256_add_epi64(sum[2 * h], _mm256_cvtepi32_epi64(_mm256_castsi256_si128(z)));
+      sum[2 * h + 1] = _mm256_add_epi64(sum[2 * h + 1], _mm256_cvtepi32_epi64(_mm256_extracti128_si256(z, 1)));
+      min[h] = _mm256_blendv_epi8(_mm256_min_epi32(v, min[h]), min[h], marked);
+      max[h] = _mm256_blendv_epi8(_mm256_max_epi32(v, max[h]), max[h], marked);
+      count += 8 - std::popcount(unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(marked))));
+    }
+  }
+
+  AK_TOOLKIT_TARGET("avx2") void store(reduce_lanes<std::int32_t>& s) const
+  {
+    for (int q = 0; q != 4; ++q)
+      _mm256_storeu_si256((__m256i*)(s.sum + 4 * q), sum[q]);
+    for (int h = 0; h != 2; ++h)
+    {
+      _mm256_storeu_si256((__m256i*)(s.min + 8 * h), min[h]);
+      _mm256_storeu_si256((__m256i*)(s.max + 8 * h), max[h]);
+    }
+    s.count = count;
+  }
+};
+
+template <> struct reduce_kernel<std::int64_t>
+{
+  typedef bit_pattern_marking marking;
+  __m256i sum[2], min[2], max[2], pattern;
+  std::size_t count;
+
+  AK_TOOLKIT_TARGET("avx2") void load(const reduce_lanes<std::int64_t>& s, std::int64_t marked)
+  {
+    for (int h = 0; h != 2; ++h)
+    {
+      sum[h] = _mm256_loadu_si256((const __m256i*)(s.sum + 4 * h));
+      min[h] = _mm256_loadu_si256((const __m256i*)(s.min + 4 * h));
+      max[h] = _mm256_loadu_si256((const __m256i*)(s.max + 4 * h));
+    }
+    pattern = _mm256_set1_epi64x(marked);
+    count = s.count;
+  }
+
+  AK_TOOLKIT_TARGET("avx2") void step(const unsigned char* p)
+  { // no 64-bit min and max in AVX2: compare and blend
+    for (int h = 0; h != 2; ++h)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(p + 32 * h));
+      __m256i marked = _mm256_cmpeq_epi64(v, pattern);
+      sum[h] = _mm256_add_epi64(sum[h], _mm256_andnot_si256(marked, v));
+      min[h] = _mm256_blendv_epi8(min[h], v, _mm256_andnot_si256(marked, _mm256_cmpgt_epi64(min[h], v)));
+      max[h] = _mm256_blendv_epi8(max[h], v, _mm256_andnot_si256(marked, _mm256_cmpgt_epi64(v, max[h])));
+      count += 4 - std::popcount(unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(marked))));
+    }
+  }
+
+  AK_TOOLKIT_TARGET("avx2") void store(reduce_lanes<std::int64_t>& s) const
+  {
+    for (int h = 0; h != 2; ++h)
+    {
+      _mm256_storeu_si256((__m256i*)(s.sum + 4 * h), sum[h]);
+      _mm256_storeu_si256((__m256i*)(s.min + 4 * h), min[h]);
+      _mm256_storeu_si256((__m256i*)(s.max + 4 * h), max[h]);
+    }
+    s.count = count;
+  }
+};
+
+template <typename T>
+AK_TOOLKIT_TARGET("avx2") void reduce(const unsigned char* p, std::size_t n, T pattern, reduce_lanes<T>& s)
+{
+  reduce_blocks<reduce_kernel<T>>(p, n, pattern, s);
+}
+
+} // namespace avx2_
+
+namespace avx512_ {
+
+template <typename T> struct reduce_kernel;
+
+template <> struct reduce_kernel<double>
+{
+  typedef nan_marking marking;
+  __m512d sum, min, max;
+  std::size_t count;
+
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") void load(const reduce_lanes<double>& s, double)
+  {
+    sum = _mm512_loadu_pd(s.sum);
+    min = _mm512_loadu_pd(s.min);
+    max = _mm512_loadu_pd(s.max);
+    count = s.count;
+  }
+
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") void step(const unsigned char* p)
+  {
+    __m512d v = _mm512_loadu_pd(p);
+    __mmask8 present = _mm512_cmp_pd_mask(v, v, _CMP_ORD_Q);
+    sum = _mm512_mask_add_pd(sum, present, sum, v);
+    min = _mm512_mask_min_pd(min, present, v, min);
+    max = _mm512_mask_max_pd(max, present, v, max);
+    count += std::popcount(unsigned(present));
+  }
+
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") void store(reduce_lanes<double>& s) const
+  {
+    _mm512_storeu_pd(s.sum, sum);
+    _mm512_storeu_pd(s.min, min);
+    _mm512_storeu_pd(s.max, max);
+    s.count = count;
+  }
+};
+
+template <> struct reduce_kernel<float>
+{
+  typedef nan_marking marking;
+  __m512d sum[2];
+  __m512 min, max;
+  std::size_t count;
+
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") void load(const reduce_lanes<float>& s, float)
+  {
+    sum[0] = _mm512_loadu_pd(s.sum);
+    sum[1] = _mm512_loadu_pd(s.sum + 8);
+    min = _mm512_loadu_ps(s.min);
+    max = _mm512_loadu_ps(s.max);
+    count = s.count;
+  }
+
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") void step(const unsigned char* p)
+  {
+    __m512 v = _mm512_loadu_ps(p);
+    __mmask16 present = _mm512_cmp_ps_mask(v, v, _CMP_ORD_Q);
+    // the zero-masking forms avoid GCC's -Wmaybe-uninitialized on the "undefined" sources of the plain ones
+    __m512d lo = _mm512_maskz_cvtps_pd(0xFF, _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xF, _mm512_castps_pd(v), 0)));
+    __m512d hi = _mm512_maskz_cvtps_pd(0xFF, _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xF, _mm512_castps_pd(v), 1)));
+    sum[0] = _mm512_mask_add_pd(sum[0], __mmask8(present), sum[0], lo);
+    sum[1] = _mm512_mask_add_pd(sum[1], __mmask8(present >> 8), sum[1], hi);
+    min = _mm512_mask_min_ps(min, present, v, min);
+    max = _mm512_mask_max_ps(max, present, v, max);
+    count += std::popcount(unsigned(present));
+  }
+
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") void store(reduce_lanes<float>& s) const
+  {
+    _mm512_storeu_pd(s.sum, sum[0]);
+    _mm512_storeu_pd(s.sum + 8, sum[1]);
+    _mm512_storeu_ps(s.min, min);
+    _mm512_storeu_ps(s.max, max);
+    s.count = count;
+  }
+};
+
+template <> struct reduce_kernel<std::int32_t>
+{
+  typedef bit_pattern_marking marking;
+  __m512i sum[2], min, max, pattern;
+  std::size_t count;
+
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") void load(const reduce_lanes<std::int32_t>& s, std::int32_t marked)
+  {
+    sum[0] = _mm512_loadu_si512(s.sum);
+    sum[1] = _mm512_loadu_si512(s.sum + 8);
+    min = _mm512_loadu_si512(s.min);
+    max = _mm512_loadu_si512(s.max);
+    pattern = _mm512_set1_epi32(marked);
+    count = s.count;
+  }
+
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") void step(const unsigned char* p)
+  {
+    __m512i v = _mm512_loadu_si512(p);
+    __mmask16 present = _mm512_cmpneq_epi32_mask(v, pattern);
+    __m512i z = _mm512_maskz_mov_epi32(present, v);
+    sum[0] = _mm512_add_epi64(sum[0], _mm512_maskz_cvtepi32_epi64(0xFF, _mm512_maskz_extracti64x4_epi64(0xF, z, 0)));
+    sum[1] = _mm512_add_epi64(sum[1], _mm512_maskz_cvtepi32_epi64(0xFF, _mm512_maskz_extracti64x4_epi64(0xF, z, 1)));
+    min = _mm512_mask_min_epi32(min, present, v, min);
+    max = _mm512_mask_max_epi32(max, present, v, max);
+    count += std::popcount(unsigned(present));
+  }
+
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") void store(reduce_lanes<std::int32_t>& s) const
+  {
+    _mm512_storeu_si512(s.sum, sum[0]);
+    _mm512_storeu_si512(s.sum + 8, sum[1]);
+    _mm512_storeu_si512(s.min, min);
+    _mm512_storeu_si512(s.max, max);
+    s.count = count;
+  }
+};
+
+template <> struct reduce_kernel<std::int64_t>
+{
+  typedef bit_pattern_marking marking;
+  __m512i sum, min, max, pattern;
+  std::size_t count;
+
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") void load(const reduce_lanes<std::int64_t>& s, std::int64_t marked)
+  {
+    sum = _mm512_loadu_si512(s.sum);
+    min = _mm512_loadu_si512(s.min);
+    max = _mm512_loadu_si512(s.max);
+    pattern = _mm512_set1_epi64(marked);
+    count = s.count;
+  }
+
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") void step(const unsigned char* p)
+  {
+    __m512i v = _mm512_loadu_si512(p);
+    __mmask8 present = _mm512_cmpneq_epi64_mask(v, pattern);
+    sum = _mm512_mask_add_epi64(sum, present, sum, v);
+    min = _mm512_mask_min_epi64(min, present, v, min);
+    max = _mm512_mask_max_epi64(max, present, v, max);
+    count += std::popcount(unsigned(present));
+  }
+
+  AK_TOOLKIT_TARGET("avx512f,avx512bw") void store(reduce_lanes<std::int64_t>& s) const
+  {
+    _mm512_storeu_si512(s.sum, sum);
+    _mm512_storeu_si512(s.min, min);
+    _mm512_storeu_si512(s.max, max);
+    s.count = count;
+  }
+};
+
+template <typename T>
+AK_TOOLKIT_TARGET("avx512f,avx512bw") void reduce(const unsigned char* p, std::size_t n, T pattern, reduce_lanes<T>& s)
+{
+  reduce_blocks<reduce_kernel<T>>(p, n, pattern, s);
+}
+
+} // namespace avx512_
+
+#endif // AK_TOOLKIT_MARKABLE_X86_SIMD
+
+template <typename MP>
+struct is_reducible
+  : std::integral_constant<bool, std::is_arithmetic<typename MP::value_type>::value
+                              && !std::is_same<typename MP::value_type, bool>::value> {};
+
+// SSE2 has neither 64-bit compares nor blends, so it uses the scalar reference.
+template <typename MP>
+reduce_lanes<typename MP::value_type> reduce_present(simd_isa isa, const markable<MP>* data, std::size_t n)
+{
+  typedef typename MP::value_type T;
+  reduce_lanes<T> s;
+  if constexpr (bulk_traits<MP>::vectorizable && std::is_same<typename MP::storage_type, T>::value)
+  {
+    typedef bulk_traits<MP> traits;
+    typedef typename traits::marking marking;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    // the integer kernels compare with one marked value; the floating-point kernels treat every NaN as marked
+    if constexpr (has_reduce_kernel<T>::value && ((std::is_integral<T>::value && std::is_same<marking, bit_pattern_marking>::value)
+                                                 || std::is_same<marking, nan_marking>::value))
+    {
+      T pattern = std::bit_cast<T>(traits::pattern()); // the marked value, or +infinity for NaN marking
+      switch (isa)
+      {
+#if defined AK_TOOLKIT_MARKABLE_X86_SIMD
+        case simd_isa::avx512: avx512_::reduce(p, n, pattern, s); return s;
+        case simd_isa::avx2:   avx2_::reduce(p, n, pattern, s); return s;
+#endif
+        default: break;
+      }
+    }
+    reduce_scalar<marking, T>(p, 0, n, traits::pattern(), s);
+  }
+  else
+  {
+    reduce_generic(data, n, s);
+  }
+  (void)isa;
+  return s;
+}
+
+} // namespace detail_
+
+// Summary of the values present in an array of markable<MP>.
+template <typename MP>
+struct present_summary
+{
+  typedef typename MP::value_type value_type;
+  typedef typename detail_::reduce_sum_type<value_type>::type sum_type; // double, std::int64_t or std::uint64_t
+
+  std::size_t count = 0;
+  sum_type sum = sum_type(0); // integer sums wrap around
+  markable<MP> min;           // marked if count == 0
+  markable<MP> max;
+
+  markable<mark_fp_nan<double>> mean() const
+  {
+    return count ? markable<mark_fp_nan<double>>(double(sum) / double(count)) : markable<mark_fp_nan<double>>();
+  }
+};
+
+template <markable_contiguous_range R>
+  requires (detail_::is_reducible<detail_::range_policy_t<R>>::value)
+present_summary<detail_::range_policy_t<R>> summarize_present(R&& r)
+{
+  typedef detail_::range_policy_t<R> MP;
+  detail_::reduce_lanes<typename MP::value_type> s = detail_::reduce_present(supported_simd_isa(), std::ranges::data(r), std::ranges::size(r));
+  present_summary<MP> ans;
+  ans.count = s.count;
+  ans.sum = s.total_sum();
+  if (s.count)
+  {
+    ans.min = markable<MP>(s.total_min());
+    ans.max = markable<MP>(s.total_max());
+  }
+  return ans;
+}
+
+template <markable_contiguous_range R>
+  requires (detail_::is_reducible<detail_::range_policy_t<R>>::value)
+auto sum_present(R&& r) { return summarize_present(r).sum; }
+
+template <markable_contiguous_range R>
+  requires (detail_::is_reducible<detail_::range_policy_t<R>>::value)
+auto min_present(R&& r) { return summarize_present(r).min; }
+
+template <markable_contiguous_range R>
+  requires (detail_::is_reducible<detail_::range_policy_t<R>>::value)
+auto max_present(R&& r) { return summarize_present(r).max; }
+
+template <markable_contiguous_range R>
+  requires (detail_::is_reducible<detail_::range_policy_t<R>>::value)
+markable<mark_fp_nan<double>> mean_present(R&& r) { return summarize_present(r).mean(); }
+
+} // namespace markable_ns
+
+using markable_ns::present_summary;
+using markable_ns::summarize_present;
+using markable_ns::sum_present;
+using markable_ns::min_present;
+using markable_ns::max_present;
+using markable_ns::mean_present;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_REDUCE_HEADER_GUARD_
@@ -0,0 +1,482 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_STREAM_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_STREAM_HEADER_GUARD_
+
+// Streaming binary serialization of markable<MP> arrays through file descriptors
+// (files, pipes, sockets; POSIX only).
+//
+// A stream is a 64-byte header identifying the policy and the byte order (as in
+// markable_mapped.hpp), followed by chunks, each introduced by a 16-byte chunk header:
+//  - values: `count` elements stored as their raw storage_value() bytes,
+//  - marked run: `count` elements without a value, with no payload,
+//  - end: the last chunk of the stream.
+// Marked runs are only produced when run-length encoding is enabled. The writer gathers
+// chunk headers and the caller's elements into writev calls, and the reader reads element
+// bytes straight into the destination array, so neither makes a call per element.
+
+#include "markable.hpp"
+#include "markable_algorithm.hpp"
+#include "markable_mapped.hpp"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+class markable_stream_error : public std::runtime_error
+{
+public:
+  using std::runtime_error::runtime_error;
+};
+
+struct markable_stream_options
+{
+  // Encode runs of at least `min_marked_run` consecutive elements without a value
+  // as a 16-byte chunk header instead of their storage bytes.
+  bool run_length_marked = false;
+  std::size_t min_marked_run = 16;
+};
+
+namespace detail_ {
+
+struct stream_header
+{
+  static constexpr std::uint32_t current_version = 1;
+  static constexpr std::uint32_t byte_order_mark = 0x01020304;
+  static constexpr std::uint32_t run_length_flag = 1;
+
+  char          magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;     // byte_order_mark as written by the producer
+  std::uint32_t element_size;
+  std::uint32_t marking;        // 0: unknown, 1: bit pattern, 2: NaN, 3: sign bit, 4: integer range
+  std::uint32_t flags;
+  std::uint32_t reserved;
+  unsigned char marked_value[32];
+};
+
+static_assert(sizeof(stream_header) == 64, "");
+
+struct stream_chunk
+{
+  enum kind_type : std::uint32_t { values = 1, marked_run = 2, end = 3 };
+
+  std::uint32_t kind;
+  std::uint32_t reserved;
+  std::uint64_t count;
+};
+
+static_assert(sizeof(stream_chunk) == 16, "");
+
+inline constexpr char stream_magic[8] = {'A', 'K', 'M', 'A', 'R', 'K', 'S', 'T'};
+
+template <typename MP>
+stream_header make_stream_header(std::uint32_t flags)
+{
+  typedef typename MP::storage_type storage_type;
+  stream_header h {};
+  std::memcpy(h.magic, stream_magic, sizeof(h.magic));
+  h.version = stream_header::current_version;
+  h.byte_order = stream_header::byte_order_mark;
+  h.element_size = sizeof(storage_type);
+  h.marking = marking_id<typename marking_of<MP>::type>;
+  h.flags = flags;
+  store_marked_value<MP>(h.marked_value);
+  return h;
+}
+
+template <typename MP>
+void check_stream_header(const stream_header& h)
+{
+  stream_header expected = make_stream_header<MP>(h.flags);
+  if (std::memcmp(h.magic, expected.magic, sizeof(h.magic)) != 0)
+    throw markable_stream_error("not a markable stream");
+  if (h.version != expected.version)
+    throw markable_stream_error("unsupported markable stream version");
+  if (h.byte_order != expected.byte_order)
+    throw markable_stream_error("markable stream has a different byte order");
+  if (h.element_size != expected.element_size || h.marking != expected.marking
+      || std::memcmp(h.marked_value, expected.marked_value, sizeof(h.marked_value)) != 0)
+    throw markable_stream_error("markable stream was written with a different mark policy");
+}
+
+#if defined IOV_MAX
+inline constexpr std::size_t max_iovecs = IOV_MAX;
+#else
+inline constexpr std::size_t max_iovecs = 16; // the POSIX minimum
+#endif
+
+// Advances `iov` past the first `done` bytes; returns the new number of entries.
+inline std::size_t consume_iovecs(iovec*& iov, std::size_t count, std::size_t done) AK_TOOLKIT_NOEXCEPT
+{
+  while (count != 0 && done >= iov->iov_len)
+  {
+    done -= iov->iov_len;
+    ++iov;
+    --count;
+  }
+  if (count != 0)
+  {
+    iov->iov_base = static_cast<unsigned char*>(iov->iov_base) + done;
+    iov->iov_len -= done;
+  }
+  return count;
+}
+
+// Writes all the bytes of `iov`, which it modifies, in as few writev calls as the descriptor allows.
+inline void write_all(int fd, iovec* iov, std::size_t count)
+{
+  while ((count = consume_iovecs(iov, count, 0)) != 0)
+  {
+    ssize_t done = ::writev(fd, iov, int(std::min(count, max_iovecs)));
+    if (done < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      throw_errno("writev");
+    }
+    count = consume_iovecs(iov, count, std::size_t(done));
+  }
+}
+
+// Fills all the bytes of `iov`, which it modifies; throws if the stream ends first.
+inline void read_all(int fd, iovec* iov, std::size_t count)
+{
+  while ((count = consume_iovecs(iov, count, 0)) != 0)
+  {
+    ssize_t done = ::readv(fd, iov, int(std::min(count, max_iovecs)));
+    if (done < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      throw_errno("readv");
+    }
+    if (done == 0)
+      throw markable_stream_error("markable stream is truncated");
+    count = consume_iovecs(iov, count, std::size_t(done));
+  }
+}
+
+// Splits an array into values chunks and marked runs of at least `min_run` elements,
+// using the presence masks of the bulk scan rather than testing elements one by one.
+class run_splitter
+{
+  std::size_t _min_run;
+  std::size_t _values_start = 0;
+  std::size_t _marked_start = 0;
+  bool _in_marked = false;
+
+public:
+  explicit run_splitter(std::size_t min_run) AK_TOOLKIT_NOEXCEPT : _min_run(std::max<std::size_t>(min_run, 1)) {}
+
+  // Calls emit(kind, first, count) for every chunk ending at or before index `end`.
+  template <typename Emit>
+  void end_marked(std::size_t end, Emit& emit)
+  {
+    if (end - _marked_start >= _min_run)
+    {
+      if (_marked_start != _values_start)
+        emit(stream_chunk::values, _values_start, _marked_start - _values_start);
+      emit(stream_chunk::marked_run, _marked_start, end - _marked_start);
+      _values_start = end;
+    }
+    _in_marked = false;
+  }
+
+  template <typename Emit>
+  void put(std::size_t i, std::uint64_t m, std::size_t count, Emit& emit)
+  {
+    std::size_t b = 0;
+    while (b < count)
+    {
+      std::uint64_t rest = m >> b;
+      if (_in_marked)
+      {
+        b += std::min<std::size_t>(rest ? std::countr_zero(rest) : 64, count - b);
+        if (b < count)
+          end_marked(i + b, emit);
+      }
+      else
+      {
+        b += std::min<std::size_t>(std::countr_one(rest), count - b);
+        if (b < count)
+        {
+          _marked_start = i + b;
+          _in_marked = true;
+        }
+      }
+    }
+  }
+
+  template <typename Emit>
+  void finish(std::size_t n, Emit& emit)
+  {
+    if (_in_marked)
+      end_marked(n, emit);
+    if (_values_start != n)
+      emit(stream_chunk::values, _values_start, n - _values_start);
+  }
+};
+
+} // namespace detail_
+
+// Writes markable<MP> elements to a file descriptor, which it does not own.
+// The stream is complete once finish() has been called.
+template <AK_TOOLKIT_MARK_POLICY MP>
+class markable_stream_writer
+{
+  static_assert(std::is_trivially_copyable<typename MP::storage_type>::value,
+                "markable_stream_writer requires a trivially copyable storage_type");
+  static_assert(sizeof(markable<MP>) == sizeof(typename MP::storage_type), "markable<MP> must have the layout of its storage");
+  static_assert(sizeof(typename MP::storage_type) <= sizeof(detail_::stream_header::marked_value),
+                "storage_type too large to be recorded in the stream header");
+
+public:
+  typedef markable<MP> element_type;
+  typedef std::size_t size_type;
+
+private:
+  int _fd;
+  markable_stream_options _options;
+  bool _finished = false;
+  std::vector<detail_::stream_chunk> _chunks;
+  std::vector<const unsigned char*> _payloads;
+
+  void add_chunk(std::uint32_t kind, const element_type* first, size_type count)
+  {
+    _chunks.push_back({kind, 0, count});
+    _payloads.push_back(kind == detail_::stream_chunk::values ? reinterpret_cast<const unsigned char*>(first) : nullptr);
+    if (_chunks.size() == detail_::max_iovecs / 2)
+      flush();
+  }
+
+  void flush()
+  {
+    std::vector<iovec> iov;
+    iov.reserve(2 * _chunks.size());
+    for (std::size_t i = 0; i != _chunks.size(); ++i)
+    {
+      iov.push_back({&_chunks[i], sizeof(detail_::stream_chunk)});
+      if (_payloads[i])
+        iov.push_back({const_cast<unsigned char*>(_payloads[i]), std::size_t(_chunks[i].count) * sizeof(element_type)});
+    }
+    detail_::write_all(_fd, iov.data(), iov.size());
+    _chunks.clear();
+    _payloads.clear();
+  }
+
+public:
+  // Writes the stream header.
+  explicit markable_stream_writer(int fd, markable_stream_options options = {})
+    : _fd(fd), _options(options)
+  {
+    detail_::stream_header h = detail_::make_stream_header<MP>(options.run_length_marked ? detail_::stream_header::run_length_flag : 0);
+    iovec iov {&h, sizeof(h)};
+    detail_::write_all(_fd, &iov, 1);
+  }
+
+  markable_stream_writer(const markable_stream_writer&) = delete;
+  markable_stream_writer& operator=(const markable_stream_writer&) = delete;
+
+  const markable_stream_options& options() const AK_TOOLKIT_NOEXCEPT { return _options; }
+
+  // Appends `n` elements; the bytes are written before the function returns.
+  void write(const element_type* data, size_type n)
+  {
+    AK_TOOLKIT_ASSERT(!_finished);
+    if (n == 0)
+      return;
+    if (!_options.run_length_marked)
+    {
+      add_chunk(detail_::stream_chunk::values, data, n);
+    }
+    else
+    {
+      detail_::run_splitter splitter(_options.min_marked_run);
+      auto emit = [&](std::uint32_t kind, std::size_t first, std::size_t count) { add_chunk(kind, data + first, count); };
+      detail_::scan_present(supported_simd_isa(), data, n, [&](std::size_t i, std::uint64_t m, std::size_t count) {
+        splitter.put(i, m, count, emit);
+        return true;
+      });
+      splitter.finish(n, emit);
+    }
+    flush();
+  }
+
+  template <markable_contiguous_range R>
+    requires std::is_same<detail_::range_policy_t<R>, MP>::value
+  void write(R&& r)
+  {
+    write(std::ranges::data(r), std::ranges::size(r));
+  }
+
+  // Writes the end chunk. No more elements can be written.
+  void finish()
+  {
+    AK_TOOLKIT_ASSERT(!_finished);
+    add_chunk(detail_::stream_chunk::end, nullptr, 0);
+    flush();
+    _finished = true;
+  }
+};
+
+// Reads markable<MP> elements from a file descriptor, which it does not own.
+// It never reads past the end chunk, so other data may follow the stream.
+template <AK_TOOLKIT_MARK_POLICY MP>
+class markable_stream_reader
+{
+  static_assert(std::is_trivially_copyable<typename MP::storage_type>::value,
+                "markable_stream_reader requires a trivially copyable storage_type");
+  static_assert(sizeof(markable<MP>) == sizeof(typename MP::storage_type), "markable<MP> must have the layout of its storage");
+
+public:
+  typedef markable<MP> element_type;
+  typedef std::size_t size_type;
+
+private:
+  int _fd;
+  bool _run_length_marked;
+  detail_::stream_chunk _chunk {};  // the chunk being read
+  std::uint64_t _left = 0;          // elements of _chunk not read yet
+  bool _next_loaded = false;        // whether _chunk holds the header of the next chunk
+  bool _done = false;
+
+  void load_chunk()
+  {
+    if (!_next_loaded)
+    {
+      iovec iov {&_chunk, sizeof(_chunk)};
+      detail_::read_all(_fd, &iov, 1);
+    }
+    _next_loaded = false;
+    switch (_chunk.kind)
+    {
+      case detail_::stream_chunk::values:
+      case detail_::stream_chunk::marked_run:
+        _left = _chunk.count;
+        break;
+      case detail_::stream_chunk::end:
+        _done = true;
+        break;
+      default:
+        throw markable_stream_error("corrupt markable stream chunk");
+    }
+  }
+
+public:
+  // Reads the stream header; throws markable_stream_error if the stream was not written
+  // with policy MP on a machine with the same byte order.
+  explicit markable_stream_reader(int fd)
+    : _fd(fd)
+  {
+    detail_::stream_header h;
+    iovec iov {&h, sizeof(h)};
+    detail_::read_all(_fd, &iov, 1);
+    detail_::check_stream_header<MP>(h);
+    _run_length_marked = (h.flags & detail_::stream_header::run_length_flag) != 0;
+  }
+
+  markable_stream_reader(const markable_stream_reader&) = delete;
+  markable_stream_reader& operator=(const markable_stream_reader&) = delete;
+
+  bool run_length_marked() const AK_TOOLKIT_NOEXCEPT { return _run_length_marked; }
+
+  // Whether the end chunk has been reached.
+  bool done() const AK_TOOLKIT_NOEXCEPT { return _done; }
+
+  // Reads up to `n` elements into `out`; returns the number read, which is less than `n`
+  // only at the end of the stream. Reading the last bytes of a values chunk also reads the
+  // header of the following chunk, in the same readv call.
+  size_type read(element_type* out, size_type n)
+  {
+    size_type ans = 0;
+    while (ans != n && !_done)
+    {
+      if (_left == 0)
+      {
+        load_chunk();
+        continue;
+      }
+      size_type count = size_type(std::min<std::uint64_t>(_left, n - ans));
+      if (_chunk.kind == detail_::stream_chunk::marked_run)
+      {
+        std::fill_n(out + ans, count, element_type());
+      }
+      else
+      {
+        iovec iov[2] = {{out + ans, count * sizeof(element_type)}, {&_chunk, sizeof(_chunk)}};
+        bool last = count == _left;
+        detail_::read_all(_fd, iov, last ? 2 : 1);
+        _next_loaded = last;
+      }
+      _left -= count;
+      ans += count;
+    }
+    return ans;
+  }
+
+  // Reads all the remaining elements. The vector grows by at most 1 MiB per read, so a corrupt
+  // element count is reported as a truncated stream rather than allocated up front.
+  std::vector<element_type> read_all()
+  {
+    constexpr size_type block = (size_type(1) << 20) / sizeof(element_type);
+    std::vector<element_type> ans;
+    while (!_done)
+    {
+      if (_left == 0)
+      {
+        load_chunk();
+        continue;
+      }
+      size_type count = size_type(std::min<std::uint64_t>(_left, block));
+      size_type old_size = ans.size();
+      ans.resize(old_size + count);
+      read(ans.data() + old_size, count);
+    }
+    return ans;
+  }
+};
+
+// Writes the whole of `r` as a complete stream.
+template <markable_contiguous_range R>
+void write_markable_stream(int fd, R&& r, markable_stream_options options = {})
+{
+  markable_stream_writer<detail_::range_policy_t<R>> w(fd, options);
+  w.write(r);
+  w.finish();
+}
+
+template <AK_TOOLKIT_MARK_POLICY MP>
+std::vector<markable<MP>> read_markable_stream(int fd)
+{
+  return markable_stream_reader<MP>(fd).read_all();
+}
+
+} // namespace markable_ns
+
+using markable_ns::markable_stream_error;
+using markable_ns::markable_stream_options;
+using markable_ns::markable_stream_writer;
+using markable_ns::markable_stream_reader;
+using markable_ns::write_markable_stream;
+using markable_ns::read_markable_stream;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_STREAM_HEADER_GUARD_
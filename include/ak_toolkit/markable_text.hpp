@@ -0,0 +1,338 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_TEXT_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_TEXT_HEADER_GUARD_
+
+// Parsing a buffer of delimited text fields (one column of a CSV or TSV file) into an
+// array of markable<MP> with a numeric value_type, and formatting such an array back.
+// Numbers are converted with std::from_chars and std::to_chars, with a faster path for
+// plain decimal digits: no locale, no exceptions and no allocation per field. Fields that
+// are null tokens (by default "" and "NA") become elements without a value; malformed
+// fields are reported by index.
+
+#include "markable.hpp"
+#include "markable_algorithm.hpp"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+struct text_parse_options
+{
+  char delimiter = '\n';
+  bool strip_cr = true;     // ignore a '\r' ending a field, as in "\r\n" line endings
+  std::vector<std::string> null_tokens = {"", "NA"};
+};
+
+struct text_parse_result
+{
+  std::size_t count = 0;            // number of fields parsed into the output
+  std::size_t consumed = 0;         // bytes of text parsed, including the delimiter after the last field
+  std::vector<std::size_t> errors;  // indices of malformed fields; the elements are left without a value
+};
+
+struct text_format_options
+{
+  char delimiter = '\n';
+  std::string_view null_token = "";
+};
+
+namespace detail_ {
+
+template <typename MP>
+constexpr bool is_text_convertible()
+{
+  typedef typename MP::value_type T;
+  return std::is_arithmetic<T>::value && !std::is_same<T, bool>::value;
+}
+
+inline bool is_null_token(std::string_view field, const std::vector<std::string>& tokens) AK_TOOLKIT_NOEXCEPT
+{
+  for (const std::string& t : tokens)
+    if (field == t)
+      return true;
+  return false;
+}
+
+inline constexpr std::uint64_t pow10_table[20] = {
+  1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull, 1000000000ull,
+  10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull, 100000000000000ull,
+  1000000000000000ull, 10000000000000000ull, 100000000000000000ull, 1000000000000000000ull,
+  10000000000000000000ull
+};
+
+// Converts the ASCII digits at the start of the 8 bytes at p, all in a few word operations;
+// returns their number and stores their value in `value`.
+inline unsigned leading_digits8(const char* p, std::uint64_t& value) AK_TOOLKIT_NOEXCEPT
+{
+  std::uint64_t x;
+  std::memcpy(&x, p, 8);
+  if constexpr (std::endian::native == std::endian::big)
+    x = __builtin_bswap64(x);
+  // a byte is a digit iff its high nibble is 3 both before and after adding 6;
+  // a carry out of a non-digit byte only disturbs the bytes after it
+  std::uint64_t m = ((x & 0xF0F0F0F0F0F0F0F0) | (((x + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ^ 0x3333333333333333;
+  unsigned k = m ? unsigned(std::countr_zero(m)) / 8 : 8;
+  if (k == 0)
+    return value = 0, 0;
+  x <<= 8 * (8 - k); // the digits to the top bytes, zeros below
+  x = ((x & 0x0F0F0F0F0F0F0F0F) * 2561) >> 8;
+  x = ((x & 0x00FF00FF00FF00FF) * 6553601) >> 16;
+  value = ((x & 0x0000FFFF0000FFFF) * 42949672960001) >> 32;
+  return k;
+}
+
+// Appends the digits at q to m. Returns false, leaving the work to from_chars, when fewer
+// than 8 bytes remain or m would exceed 19 digits.
+inline bool append_digits(const char*& q, const char* last, std::uint64_t& m, unsigned& digits) AK_TOOLKIT_NOEXCEPT
+{
+  for (;;)
+  {
+    if (last - q < 8)
+      return false;
+    std::uint64_t chunk;
+    unsigned k = leading_digits8(q, chunk);
+    if (digits + k > 19)
+      return false;
+    m = m * pow10_table[k] + chunk;
+    digits += k;
+    q += k;
+    if (k < 8)
+      return true;
+  }
+}
+
+// Fast paths for the common forms of numbers; they return nullptr for anything else
+// (including malformed input), which is then parsed by std::from_chars. When they succeed
+// the result is the same as that of from_chars.
+template <typename T>
+const char* parse_integer_fast(const char* p, const char* last, T& v) AK_TOOLKIT_NOEXCEPT
+{
+  bool negative = false;
+  if constexpr (std::is_signed<T>::value)
+  {
+    negative = p != last && *p == '-';
+    p += negative; // without a branch: signs in a column are unpredictable
+  }
+  std::uint64_t m = 0;
+  unsigned digits = 0;
+  // the magnitude of the minimum of a signed T is its maximum + 1
+  if (!append_digits(p, last, m, digits) || digits == 0 || m > std::uint64_t(std::numeric_limits<T>::max()) + negative)
+    return nullptr;
+  v = T(negative ? 0 - m : m);
+  return p;
+}
+
+// Decimal numbers without an exponent whose digits fit in the mantissa are computed exactly,
+// with a single rounding, as m / 10^k (Clinger's fast path).
+template <typename T>
+const char* parse_floating_fast(const char* p, const char* last, T& v) AK_TOOLKIT_NOEXCEPT
+{
+  constexpr unsigned max_exact_pow10 = std::is_same<T, double>::value ? 22 : 10;
+  if constexpr (!std::is_same<T, double>::value && !std::is_same<T, float>::value)
+    return nullptr;
+  bool negative = p != last && *p == '-';
+  p += negative;
+  std::uint64_t m = 0;
+  unsigned digits = 0;
+  if (!append_digits(p, last, m, digits))
+    return nullptr;
+  unsigned int_digits = digits;
+  if (p != last && *p == '.')
+    if (!append_digits(++p, last, m, digits))
+      return nullptr;
+  unsigned frac_digits = digits - int_digits;
+  if (digits == 0 || (p != last && (*p == 'e' || *p == 'E')) || frac_digits > max_exact_pow10
+      || m > (std::uint64_t(1) << std::numeric_limits<T>::digits))
+    return nullptr;
+  T ans = T(m) / T(pow10_table[frac_digits]);
+  v = negative ? -ans : ans;
+  return p;
+}
+
+template <typename T>
+std::from_chars_result parse_number(const char* p, const char* last, T& v) AK_TOOLKIT_NOEXCEPT
+{
+  const char* q;
+  if constexpr (std::is_integral<T>::value)
+    q = parse_integer_fast(p, last, v);
+  else
+    q = parse_floating_fast(p, last, v);
+  if (q)
+    return {q, std::errc()};
+  return std::from_chars(p, last, v);
+}
+
+// Finds the delimiters of a buffer 64 bytes at a time, so that where the next field starts
+// is known without waiting for the conversion of the current one, and the conversions of
+// consecutive fields can overlap in the CPU.
+class delimiter_scanner
+{
+  const char* _block;    // the current 64-byte block
+  const char* _last;
+  std::uint64_t _mask;   // delimiters in the current block not returned yet
+  char _delimiter;
+
+  void load_block() AK_TOOLKIT_NOEXCEPT
+  {
+    _mask = 0;
+    if (_last - _block >= 64)
+    {
+#if defined AK_TOOLKIT_MARKABLE_X86_SIMD && defined __SSE2__
+      const __m128i d = _mm_set1_epi8(_delimiter);
+      for (unsigned j = 0; j != 4; ++j)
+      {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_block + 16 * j));
+        _mask |= std::uint64_t(unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(x, d)))) << (16 * j);
+      }
+#else
+      for (unsigned j = 0; j != 64; ++j)
+        _mask |= std::uint64_t(_block[j] == _delimiter) << j;
+#endif
+    }
+    else
+    {
+      for (unsigned j = 0; _block + j < _last; ++j)
+        _mask |= std::uint64_t(_block[j] == _delimiter) << j;
+    }
+  }
+
+public:
+  delimiter_scanner(const char* first, const char* last, char delimiter) AK_TOOLKIT_NOEXCEPT
+    : _block(first), _last(last), _delimiter(delimiter)
+  {
+    load_block();
+  }
+
+  // Returns the next delimiter, or `last` if there are no more.
+  const char* next() AK_TOOLKIT_NOEXCEPT
+  {
+    while (_mask == 0)
+    {
+      if (_last - _block <= 64)
+        return _last;
+      _block += 64;
+      load_block();
+    }
+    const char* ans = _block + std::countr_zero(_mask);
+    _mask &= _mask - 1;
+    return ans;
+  }
+};
+
+// A field is a value if its whole text (but a trailing '\r') converts to a number; other
+// fields are compared with the null tokens.
+template <typename MP>
+text_parse_result parse_text(const char* first, const char* last, markable<MP>* out, std::size_t n, const text_parse_options& options)
+{
+  typedef typename MP::value_type value_type;
+  text_parse_result ans;
+  delimiter_scanner delimiters(first, last, options.delimiter);
+  const char* p = first;
+  std::size_t i = 0;
+  for (; i != n && p != last; ++i)
+  {
+    const char* end = delimiters.next();
+    const char* field_end = options.strip_cr && end != p && end[-1] == '\r' ? end - 1 : end;
+    value_type v = value_type();
+    std::from_chars_result r = parse_number(p, last, v);
+    // a value equal to the marked one (e.g. "nan" for mark_fp_nan) is a null only if it is a null token
+    if (r.ec == std::errc() && r.ptr == field_end && !MP::is_marked_value(MP::representation(MP::store_value(v))))
+    {
+      out[i] = markable<MP>(v);
+    }
+    else
+    {
+      out[i] = markable<MP>();
+      if (!is_null_token(std::string_view(p, std::size_t(field_end - p)), options.null_tokens))
+        ans.errors.push_back(i);
+    }
+    p = end == last ? last : end + 1;
+  }
+  ans.count = i;
+  ans.consumed = std::size_t(p - first);
+  return ans;
+}
+
+// The longest text std::to_chars can produce for a T in its shortest round-trip form.
+template <typename T>
+constexpr std::size_t max_chars()
+{
+  if constexpr (std::is_integral<T>::value)
+    return std::numeric_limits<T>::digits10 + 2;
+  else
+    return std::numeric_limits<T>::max_digits10 + 8; // sign, point, "e-" and up to 4 exponent digits
+}
+
+} // namespace detail_
+
+// Returns the number of fields in `text`: a trailing delimiter ends the last field
+// rather than starting an empty one.
+inline std::size_t count_fields(std::string_view text, char delimiter = '\n') AK_TOOLKIT_NOEXCEPT
+{
+  if (text.empty())
+    return 0;
+  return std::size_t(std::count(text.begin(), text.end(), delimiter)) + (text.back() != delimiter);
+}
+
+// Parses the fields of `text` into consecutive elements of `out`, stopping when either runs out.
+// A field is stored without a value when it is one of options.null_tokens, or when it is not
+// a number representable in value_type, in which case its index is also added to the errors.
+template <markable_contiguous_range R>
+  requires (detail_::is_text_convertible<detail_::range_policy_t<R>>())
+text_parse_result parse_markable_column(std::string_view text, R&& out, const text_parse_options& options = {})
+{
+  return detail_::parse_text(text.data(), text.data() + text.size(), std::ranges::data(out), std::ranges::size(out), options);
+}
+
+// Appends the elements of `r` to `out`, each followed by options.delimiter; elements without
+// a value are written as options.null_token. Floating-point values are written in the shortest
+// form that parses back to the same value.
+template <markable_contiguous_range R>
+  requires (detail_::is_text_convertible<detail_::range_policy_t<R>>())
+void format_markable_column(R&& r, std::string& out, const text_format_options& options = {})
+{
+  typedef typename detail_::range_policy_t<R>::value_type value_type;
+  const std::size_t field_chars = std::max(detail_::max_chars<value_type>(), options.null_token.size()) + 1;
+  const std::size_t old_size = out.size();
+  out.resize(old_size + std::ranges::size(r) * field_chars);
+  char* p = out.data() + old_size;
+  char* const last = out.data() + out.size();
+  for (const auto& e : r)
+  {
+    if (e.has_value())
+      p = std::to_chars(p, last, e.value()).ptr;
+    else
+      p = std::copy(options.null_token.begin(), options.null_token.end(), p);
+    *p++ = options.delimiter;
+  }
+  out.resize(std::size_t(p - out.data()));
+}
+
+} // namespace markable_ns
+
+using markable_ns::text_parse_options;
+using markable_ns::text_parse_result;
+using markable_ns::text_format_options;
+using markable_ns::count_fields;
+using markable_ns::parse_markable_column;
+using markable_ns::format_markable_column;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_TEXT_HEADER_GUARD_
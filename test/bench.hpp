@@ -0,0 +1,55 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_BENCH_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_BENCH_HEADER_GUARD_
+
+// Minimal timing helpers for the benchmarks; results are printed as CSV lines:
+// group,name,elements,ns_per_element
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+
+namespace bench {
+
+template <typename T>
+inline void do_not_optimize(T const& v)
+{
+  asm volatile("" : : "r,m"(v) : "memory");
+}
+
+inline void clobber_memory()
+{
+  asm volatile("" : : : "memory");
+}
+
+// Runs f() `reps` times and returns the best wall time of a single run in nanoseconds.
+template <typename F>
+double best_time_ns(F f, int reps = 5)
+{
+  double best = 1e300;
+  for (int r = 0; r != reps; ++r)
+  {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    clobber_memory();
+    auto stop = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+    if (ns < best)
+      best = ns;
+  }
+  return best;
+}
+
+inline void report(const char* group, const char* name, std::size_t elements, double ns)
+{
+  std::printf("%s,%s,%zu,%.4f\n", group, name, elements, ns / double(elements));
+}
+
+} // namespace bench
+
+#endif // AK_TOOLBOX_MARKABLE_BENCH_HEADER_GUARD_
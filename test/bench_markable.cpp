@@ -0,0 +1,719 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable.hpp"
+#include "../include/ak_toolkit/markable_algorithm.hpp"
+#include "../include/ak_toolkit/markable_atomic.hpp"
+#include "../include/ak_toolkit/markable_concurrent_map.hpp"
+#include "../include/ak_toolkit/markable_expected.hpp"
+#include "../include/ak_toolkit/markable_flat_map.hpp"
+#include "../include/ak_toolkit/markable_float16.hpp"
+#include "../include/ak_toolkit/markable_bool_vector.hpp"
+#include "../include/ak_toolkit/markable_reduce.hpp"
+#include "../include/ak_toolkit/markable_text.hpp"
+#include "bench.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace ak_toolkit;
+
+struct interval
+{
+  int first, last;
+};
+
+struct interval_representation
+{
+  int first, last;
+};
+
+struct mark_interval : markable_dual_storage_type<mark_interval, interval, interval_representation>
+{
+  static representation_type marked_value() AK_TOOLKIT_NOEXCEPT { return {0, -1}; }
+  static bool is_marked_value(const representation_type& v) { return v.first > v.last; }
+};
+
+typedef markable<mark_interval> opt_interval;
+static_assert(std::is_trivially_copyable<opt_interval>::value, "");
+
+// dual storage of trivially copyable types: vector growth and bulk copy should be as fast as for raw PODs
+void bench_dual_storage_copy(std::size_t n)
+{
+  std::vector<opt_interval> src;
+  for (std::size_t i = 0; i != n; ++i)
+    src.push_back(i % 2 ? opt_interval(interval{int(i), int(i)}) : opt_interval());
+  std::vector<opt_interval> dst(n);
+  std::vector<interval_representation> raw_src(n), raw_dst(n);
+
+  bench::report("dual_storage_copy", "std_copy_markable", n, bench::best_time_ns([&] {
+    std::copy(src.begin(), src.end(), dst.begin());
+    bench::do_not_optimize(dst.data());
+  }));
+
+  bench::report("dual_storage_copy", "memcpy_raw", n, bench::best_time_ns([&] {
+    std::memcpy(raw_dst.data(), raw_src.data(), n * sizeof(interval_representation));
+    bench::do_not_optimize(raw_dst.data());
+  }));
+
+  bench::report("dual_storage_copy", "vector_growth_markable", n, bench::best_time_ns([&] {
+    std::vector<opt_interval> v;
+    for (std::size_t i = 0; i != n; ++i)
+      v.push_back(src[i]);
+    bench::do_not_optimize(v.data());
+  }));
+
+  bench::report("dual_storage_copy", "vector_growth_raw", n, bench::best_time_ns([&] {
+    std::vector<interval_representation> v;
+    for (std::size_t i = 0; i != n; ++i)
+      v.push_back(raw_src[i]);
+    bench::do_not_optimize(v.data());
+  }));
+}
+
+// value_or over a column with 50% nulls: the explicit branch mispredicts, value_or selects
+void bench_value_or(std::size_t n)
+{
+  typedef markable<mark_int<int, -1>> opt_int;
+  std::vector<opt_int> src;
+  unsigned seed = 1;
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    seed = seed * 1103515245u + 12345u;
+    src.push_back((seed >> 16) & 1 ? opt_int(int(i)) : opt_int());
+  }
+  std::vector<int> dst(n);
+
+  bench::report("value_or", "branch", n, bench::best_time_ns([&] {
+    for (std::size_t i = 0; i != n; ++i)
+    {
+      if (src[i].has_value())
+        dst[i] = src[i].value();
+      else
+        dst[i] = 0;
+      bench::clobber_memory();
+    }
+    bench::do_not_optimize(dst.data());
+  }));
+
+  bench::report("value_or", "value_or", n, bench::best_time_ns([&] {
+    for (std::size_t i = 0; i != n; ++i)
+    {
+      dst[i] = src[i].value_or(0);
+      bench::clobber_memory();
+    }
+    bench::do_not_optimize(dst.data());
+  }));
+
+  bench::report("value_or", "value_or_each", n, bench::best_time_ns([&] {
+    value_or_each(src, 0, dst.data());
+    bench::do_not_optimize(dst.data());
+  }));
+}
+
+template <typename Map>
+void bench_hash_map(const char* name, std::size_t n)
+{
+  std::mt19937_64 rng(1);
+  std::vector<std::uint64_t> keys(n), misses(n);
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    keys[i] = rng() | 1;    // odd keys are present
+    misses[i] = rng() & ~std::uint64_t(1); // even keys are absent (never 0: the marked value)
+    misses[i] += misses[i] == 0 ? 2 : 0;
+  }
+
+  Map m;
+  bench::report("hash_map_insert", name, n, bench::best_time_ns([&] {
+    Map t;
+    for (std::uint64_t k : keys)
+      t[k] = k;
+    bench::do_not_optimize(t.size());
+  }, 3));
+
+  for (std::uint64_t k : keys)
+    m[k] = k;
+
+  bench::report("hash_map_lookup_hit", name, n, bench::best_time_ns([&] {
+    std::uint64_t sum = 0;
+    for (std::uint64_t k : keys)
+      sum += m.find(k) != decltype(m.find(k))();
+    bench::do_not_optimize(sum);
+  }, 3));
+
+  bench::report("hash_map_lookup_miss", name, n, bench::best_time_ns([&] {
+    std::uint64_t sum = 0;
+    for (std::uint64_t k : misses)
+      sum += m.find(k) != decltype(m.find(k))();
+    bench::do_not_optimize(sum);
+  }, 3));
+
+  // a sliding window of n / 16 keys: every insert is paired with an erase
+  std::size_t window = n / 16;
+  bench::report("hash_map_erase_heavy", name, n, bench::best_time_ns([&] {
+    Map t;
+    for (std::size_t i = 0; i != n; ++i)
+    {
+      t[keys[i]] = i;
+      if (i >= window)
+        t.erase(keys[i - window]);
+    }
+    bench::do_not_optimize(t.size());
+  }, 3));
+}
+
+// tri-state AND of two rule masks: one char per element vs two bit planes
+void bench_kleene_and(std::size_t n)
+{
+  typedef markable<mark_bool> opt_bool;
+  std::mt19937_64 rng(1);
+  std::vector<opt_bool> a(n), b(n), c(n);
+  markable_bool_vector pa, pb;
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    unsigned x = unsigned(rng() % 3), y = unsigned(rng() % 3);
+    a[i] = x == 2 ? opt_bool() : opt_bool(bool(x));
+    b[i] = y == 2 ? opt_bool() : opt_bool(bool(y));
+    pa.push_back(a[i]);
+    pb.push_back(b[i]);
+  }
+
+  bench::report("kleene_and", "markable_bool_array", n, bench::best_time_ns([&] {
+    for (std::size_t i = 0; i != n; ++i)
+    {
+      bool f = (a[i].has_value() && !a[i].value()) || (b[i].has_value() && !b[i].value());
+      bool t = a[i].value_or(false) && b[i].value_or(false);
+      c[i] = f ? opt_bool(false) : t ? opt_bool(true) : opt_bool();
+    }
+    bench::do_not_optimize(c.data());
+  }));
+
+  bench::report("kleene_and", "markable_bool_vector", n, bench::best_time_ns([&] {
+    markable_bool_vector pc = kleene_and(pa, pb);
+    bench::do_not_optimize(pc.has_words());
+  }));
+}
+
+// sorting a column with 10% nulls: comparator sort vs partition + radix sort
+void bench_sort(std::size_t n)
+{
+  typedef markable<mark_int<std::int64_t, std::numeric_limits<std::int64_t>::min()>> opt_int;
+  std::mt19937_64 rng(1);
+  std::vector<opt_int> src(n);
+  for (opt_int& e : src)
+    e = rng() % 10 ? opt_int(std::int64_t(rng() >> 1) - (std::int64_t(1) << 62)) : opt_int();
+  std::vector<opt_int> v;
+
+  bench::report("sort", "std_sort_operator_less", n, bench::best_time_ns([&] {
+    v = src;
+    std::sort(v.begin(), v.end());
+    bench::do_not_optimize(v.data());
+  }, 3));
+
+  bench::report("sort", "std_sort_nulls_last", n, bench::best_time_ns([&] {
+    v = src;
+    std::sort(v.begin(), v.end(), markable_less<null_order::last>{});
+    bench::do_not_optimize(v.data());
+  }, 3));
+
+  bench::report("sort", "radix_sort", n, bench::best_time_ns([&] {
+    v = src;
+    radix_sort(v);
+    bench::do_not_optimize(v.data());
+  }, 3));
+}
+
+// sum, min and max of the present values: a has_value() loop vs summarize_present
+template <typename MP>
+void bench_reduce(const char* type, std::size_t n)
+{
+  typedef typename MP::value_type T;
+  std::mt19937_64 rng(1);
+  for (int null_percent : {0, 1, 50, 99})
+  {
+    std::vector<markable<MP>> v(n);
+    for (markable<MP>& e : v)
+      if (int(rng() % 100) >= null_percent)
+        e = markable<MP>(T(rng() % 1000));
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "%s_loop_%d%%_null", type, null_percent);
+    bench::report("reduce", name, n, bench::best_time_ns([&] {
+      typename present_summary<MP>::sum_type sum = 0;
+      T mn = std::numeric_limits<T>::max(), mx = std::numeric_limits<T>::lowest();
+      for (const markable<MP>& e : v)
+        if (e.has_value())
+        {
+          sum += e.value();
+          mn = std::min(mn, e.value());
+          mx = std::max(mx, e.value());
+        }
+      bench::do_not_optimize(sum);
+      bench::do_not_optimize(mn);
+      bench::do_not_optimize(mx);
+    }));
+
+    std::snprintf(name, sizeof(name), "%s_summarize_present_%d%%_null", type, null_percent);
+    bench::report("reduce", name, n, bench::best_time_ns([&] {
+      present_summary<MP> s = summarize_present(v);
+      bench::do_not_optimize(s);
+    }));
+  }
+}
+
+// parsing a text column with 5% "NA" fields (random int32s, or prices with 2 decimals):
+// std::stod/stoll per line vs parse_markable_column; the column sizes in bytes are printed to
+// stderr, out of the CSV output, so that throughput can be derived
+template <typename MP>
+void bench_parse(const char* type, std::size_t n)
+{
+  typedef typename MP::value_type T;
+  std::mt19937_64 rng(1);
+  std::vector<markable<MP>> src(n);
+  for (markable<MP>& e : src)
+    if (rng() % 20)
+      e = markable<MP>(std::is_integral<T>::value ? T(std::int32_t(rng())) : T(double(std::int64_t(rng() % 100000000) - 50000000) / 100));
+  text_format_options format_options;
+  format_options.null_token = "NA";
+  std::string text;
+  format_markable_column(src, text, format_options);
+  std::fprintf(stderr, "%s column: %zu bytes\n", type, text.size());
+  std::vector<markable<MP>> dst(n);
+
+  char name[64];
+  std::snprintf(name, sizeof(name), "%s_std_sto", type);
+  bench::report("parse", name, n, bench::best_time_ns([&] {
+    std::size_t i = 0, p = 0;
+    while (p != text.size())
+    {
+      std::size_t e = text.find('\n', p);
+      std::string field = text.substr(p, e - p);
+      if (field == "NA")
+        dst[i] = markable<MP>();
+      else if constexpr (std::is_integral<T>::value)
+        dst[i] = markable<MP>(T(std::stoll(field)));
+      else
+        dst[i] = markable<MP>(T(std::stod(field)));
+      ++i;
+      p = e + 1;
+    }
+    bench::do_not_optimize(dst.data());
+  }, 3));
+
+  std::snprintf(name, sizeof(name), "%s_parse_markable_column", type);
+  bench::report("parse", name, n, bench::best_time_ns([&] {
+    text_parse_result r = parse_markable_column(text, dst);
+    bench::do_not_optimize(r.count);
+    bench::do_not_optimize(dst.data());
+  }, 3));
+
+  std::snprintf(name, sizeof(name), "%s_format_markable_column", type);
+  bench::report("parse", name, n, bench::best_time_ns([&] {
+    std::string out;
+    format_markable_column(src, out, format_options);
+    bench::do_not_optimize(out.data());
+  }, 3));
+}
+
+// conversion of a float column with 1% NaNs to 16-bit storage and back: one markable at a
+// time vs from_floats and to_floats
+template <typename MP>
+void bench_float16(const char* type, std::size_t n)
+{
+  std::mt19937_64 rng(1);
+  std::vector<float> in(n), out(n);
+  for (float& f : in)
+    f = rng() % 100 ? float(std::int32_t(rng() % 2000000) - 1000000) / 64 : std::numeric_limits<float>::quiet_NaN();
+  std::vector<markable<MP>> column(n);
+
+  char name[64];
+  std::snprintf(name, sizeof(name), "%s_store_each", type);
+  bench::report("float16", name, n, bench::best_time_ns([&] {
+    for (std::size_t i = 0; i != n; ++i)
+      column[i] = markable<MP>(in[i]);
+    bench::do_not_optimize(column.data());
+  }));
+
+  std::snprintf(name, sizeof(name), "%s_from_floats", type);
+  bench::report("float16", name, n, bench::best_time_ns([&] {
+    from_floats(in, column);
+    bench::do_not_optimize(column.data());
+  }));
+
+  std::snprintf(name, sizeof(name), "%s_value_or_each", type);
+  bench::report("float16", name, n, bench::best_time_ns([&] {
+    for (std::size_t i = 0; i != n; ++i)
+      out[i] = column[i].value_or(std::numeric_limits<float>::quiet_NaN());
+    bench::do_not_optimize(out.data());
+  }));
+
+  std::snprintf(name, sizeof(name), "%s_to_floats", type);
+  bench::report("float16", name, n, bench::best_time_ns([&] {
+    to_floats(column, out);
+    bench::do_not_optimize(out.data());
+  }));
+}
+
+// a 3-point stencil over a column with 1% missing values: doubles with a validity array beside
+// them vs mark_fp_nan_payload, where the marked value propagates through the arithmetic; and
+// count_nans, which tells marked elements from computed NaNs
+void bench_nan_payload(std::size_t n)
+{
+  typedef markable<mark_fp_nan_payload<double, 1>> opt_double;
+  std::mt19937_64 rng(1);
+  std::vector<double> values(n), out(n);
+  std::vector<unsigned char> valid(n), out_valid(n);
+  std::vector<opt_double> column(n), out_column(n);
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    values[i] = double(rng() % 1000);
+    valid[i] = rng() % 100 != 0;
+    column[i] = valid[i] ? opt_double(values[i]) : opt_double();
+  }
+
+  bench::report("nan_payload", "stencil_validity_array", n, bench::best_time_ns([&] {
+    for (std::size_t i = 1; i + 1 < n; ++i)
+    {
+      out[i] = (values[i - 1] + values[i] + values[i + 1]) * (1.0 / 3);
+      out_valid[i] = valid[i - 1] & valid[i] & valid[i + 1];
+    }
+    bench::do_not_optimize(out.data());
+    bench::do_not_optimize(out_valid.data());
+  }));
+
+  const double* in = reinterpret_cast<const double*>(column.data());
+  double* res = reinterpret_cast<double*>(out_column.data());
+  bench::report("nan_payload", "stencil_payload_marking", n, bench::best_time_ns([&] {
+    for (std::size_t i = 1; i + 1 < n; ++i)
+      res[i] = (in[i - 1] + in[i] + in[i + 1]) * (1.0 / 3);
+    bench::do_not_optimize(res);
+  }));
+
+  bench::report("nan_payload", "count_nans", n, bench::best_time_ns([&] {
+    nan_counts c = count_nans(out_column);
+    bench::do_not_optimize(c);
+  }));
+}
+
+// presence tests of an int32 column with 10% missing values, marked by one value (mark_int), by
+// the sign bit, or by a range of values: count_present and presence_bitmap, and a scalar loop
+// summing the present values. The column fits in the L2 cache; larger ones are bandwidth-bound.
+template <typename MP>
+void bench_marking(const char* policy, std::size_t n)
+{
+  std::mt19937_64 rng(1);
+  std::vector<markable<MP>> column(n);
+  for (markable<MP>& e : column)
+    if (rng() % 10)
+      e = markable<MP>(std::int32_t(rng() % 1000000));
+  std::vector<std::uint8_t> bitmap((n + 7) / 8);
+
+  char name[64];
+  std::snprintf(name, sizeof(name), "%s_count_present", policy);
+  bench::report("marking", name, n, bench::best_time_ns([&] {
+    std::size_t c = count_present(column);
+    bench::do_not_optimize(c);
+  }));
+
+  std::snprintf(name, sizeof(name), "%s_presence_bitmap", policy);
+  bench::report("marking", name, n, bench::best_time_ns([&] {
+    presence_bitmap(column, bitmap.data());
+    bench::do_not_optimize(bitmap.data());
+  }));
+
+  std::snprintf(name, sizeof(name), "%s_sum_loop", policy);
+  bench::report("marking", name, n, bench::best_time_ns([&] {
+    std::int64_t sum = 0;
+    for (const markable<MP>& e : column)
+      if (e.has_value())
+        sum += e.value();
+    bench::do_not_optimize(sum);
+  }));
+}
+
+// classifying a column of parse results with 2% errors of 4 kinds: a value and an error code
+// with an engaged flag, laid out like std::expected<uint32_t, E> (8 bytes), counted in a loop,
+// vs markable_expected<uint32_t, E> (4 bytes) and count_errors
+void bench_expected(std::size_t n)
+{
+  enum class parse_error : std::uint8_t { empty, not_a_number, overflow, not_applicable };
+  struct expected_u32
+  {
+    std::uint32_t value;
+    parse_error error;
+    bool has_value;
+  };
+  static_assert(sizeof(expected_u32) == 8, "");
+
+  std::mt19937_64 rng(1);
+  std::vector<expected_u32> plain(n);
+  std::vector<markable_expected<std::uint32_t, parse_error>> packed(n);
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    if (rng() % 50 == 0)
+    {
+      parse_error e = parse_error(rng() % 4);
+      plain[i] = {0, e, false};
+      packed[i] = markable_unexpected(e);
+    }
+    else
+    {
+      std::uint32_t v = std::uint32_t(rng() % 1000000);
+      plain[i] = {v, parse_error::empty, true};
+      packed[i] = v;
+    }
+  }
+
+  bench::report("expected", "flag_count_loop", n, bench::best_time_ns([&] {
+    std::size_t counts[5] = {};
+    for (const expected_u32& e : plain)
+      ++counts[e.has_value ? 4 : std::size_t(e.error)];
+    bench::do_not_optimize(counts);
+  }));
+
+  bench::report("expected", "markable_count_errors", n, bench::best_time_ns([&] {
+    error_counts<256> c = count_errors(packed);
+    bench::do_not_optimize(c);
+  }));
+}
+
+// creating a 1 GiB array of marked elements, then reading one element per 4 KiB page so that
+// lazily zeroed pages are paid for: std::vector's constructor (a constructor call per element) vs
+// make_marked_array (a memset, or calloc when the marked byte is 0); and resetting it to marked
+// in a loop vs fill_marked
+template <typename MP>
+void bench_fill(const char* policy)
+{
+  typedef markable<MP> opt;
+  const std::size_t n = (std::size_t(1) << 30) / sizeof(opt), page = 4096 / sizeof(opt);
+  auto touch = [&](const opt* a) {
+    std::size_t present = 0;
+    for (std::size_t i = 0; i < n; i += page)
+      present += a[i].has_value();
+    bench::do_not_optimize(present);
+  };
+
+  char name[64];
+  std::snprintf(name, sizeof(name), "%s_vector_ctor", policy);
+  bench::report("fill", name, n, bench::best_time_ns([&] {
+    std::vector<opt> v(n);
+    touch(v.data());
+  }, 3));
+
+  std::snprintf(name, sizeof(name), "%s_make_marked_array", policy);
+  bench::report("fill", name, n, bench::best_time_ns([&] {
+    marked_array<MP> a = make_marked_array<MP>(n);
+    touch(a.get());
+  }, 3));
+
+  marked_array<MP> a = make_marked_array<MP>(n);
+  std::snprintf(name, sizeof(name), "%s_reset_loop", policy);
+  bench::report("fill", name, n, bench::best_time_ns([&] {
+    for (std::size_t i = 0; i != n; ++i)
+      a[i] = opt();
+    bench::do_not_optimize(a.get());
+  }, 3));
+
+  std::snprintf(name, sizeof(name), "%s_fill_marked", policy);
+  bench::report("fill", name, n, bench::best_time_ns([&] {
+    fill_marked(a.get(), n);
+    bench::do_not_optimize(a.get());
+  }, 3));
+}
+
+// packing the present values of a column with 50% of marked elements, with their indices: a
+// branchy loop vs compact_present; and expanding them back with expand_present
+template <typename MP, typename Gen>
+void bench_compact(const char* policy, std::size_t n, Gen gen)
+{
+  typedef typename MP::value_type value_type;
+  std::mt19937_64 rng(1);
+  std::vector<markable<MP>> column(n);
+  for (markable<MP>& e : column)
+    if (rng() % 2)
+      e = markable<MP>(gen(rng));
+  std::unique_ptr<value_type[]> values(new value_type[n]);
+  std::vector<std::uint32_t> idx(n);
+
+  char name[64];
+  std::snprintf(name, sizeof(name), "%s_branchy_loop", policy);
+  bench::report("compact", name, n, bench::best_time_ns([&] {
+    std::size_t k = 0;
+    for (std::size_t i = 0; i != n; ++i)
+      if (column[i].has_value())
+      {
+        values[k] = column[i].value();
+        idx[k++] = std::uint32_t(i);
+      }
+    bench::do_not_optimize(k);
+  }));
+
+  std::snprintf(name, sizeof(name), "%s_compact_present", policy);
+  std::size_t count = 0;
+  bench::report("compact", name, n, bench::best_time_ns([&] {
+    count = compact_present(column, values.get(), idx.data());
+    bench::do_not_optimize(count);
+  }));
+
+  std::snprintf(name, sizeof(name), "%s_expand_present", policy);
+  bench::report("compact", name, n, bench::best_time_ns([&] {
+    expand_present(column, values.get(), idx.data(), count);
+    bench::do_not_optimize(column.data());
+  }));
+}
+
+// a memo table of 4096 lazily computed entries read by 1 to 8 threads (after the first pass,
+// lookups hit): atomic_markable::get_or_compute vs a markable guarded by a mutex per entry
+void bench_atomic(std::size_t n)
+{
+  typedef mark_int<std::int64_t, -1> policy;
+  const std::size_t slots = 4096;
+  std::mt19937_64 rng(1);
+  std::vector<std::uint32_t> keys(n);
+  for (std::uint32_t& k : keys)
+    k = std::uint32_t(rng() % slots);
+  auto compute = [](std::uint32_t k) { return std::int64_t(k) * 3 + 1; };
+
+  struct locked_entry
+  {
+    std::mutex mutex;
+    markable<policy> value;
+  };
+
+  for (unsigned threads : {1u, 2u, 4u, 8u})
+  {
+    auto run = [&](auto lookup) {
+      std::vector<std::thread> pool;
+      for (unsigned t = 0; t != threads; ++t)
+        pool.emplace_back([&, t] {
+          std::int64_t sum = 0;
+          for (std::size_t i = t; i < n; i += threads)
+            sum += lookup(keys[i]);
+          bench::do_not_optimize(sum);
+        });
+      for (std::thread& th : pool)
+        th.join();
+    };
+
+    char name[64];
+    std::unique_ptr<atomic_markable<policy>[]> atomic_table(new atomic_markable<policy>[slots]);
+    std::snprintf(name, sizeof(name), "atomic_markable_%u_threads", threads);
+    bench::report("memo_table", name, n, bench::best_time_ns([&] {
+      run([&](std::uint32_t k) { return atomic_table[k].get_or_compute([&] { return compute(k); }); });
+    }));
+
+    std::unique_ptr<locked_entry[]> locked_table(new locked_entry[slots]);
+    std::snprintf(name, sizeof(name), "mutex_markable_%u_threads", threads);
+    bench::report("memo_table", name, n, bench::best_time_ns([&] {
+      run([&](std::uint32_t k) {
+        std::lock_guard<std::mutex> lock(locked_table[k].mutex);
+        if (!locked_table[k].value.has_value())
+          locked_table[k].value = markable<policy>(compute(k));
+        return locked_table[k].value.value();
+      });
+    }));
+  }
+}
+
+// dedup of n 64-bit IDs (about half of them repeated) split between 1, 2, 4, ... threads up to
+// the number of cores: markable_concurrent_set vs markable_flat_set guarded by a mutex
+void bench_concurrent_set(std::size_t n)
+{
+  typedef mark_int_tombstone<std::uint64_t, 0, std::uint64_t(-1)> policy;
+  std::mt19937_64 rng(1);
+  std::vector<std::uint64_t> ids(n);
+  for (std::uint64_t& id : ids)
+    id = 1 + rng() % (n / 2) * 0x9E3779B97F4A7C15ull % (std::uint64_t(-1) - 1);
+
+  std::vector<unsigned> thread_counts;
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned t = 1; t < cores; t *= 2)
+    thread_counts.push_back(t);
+  thread_counts.push_back(cores);
+
+  for (unsigned threads : thread_counts)
+  {
+    auto run = [&](auto insert) {
+      std::vector<std::thread> pool;
+      for (unsigned t = 0; t != threads; ++t)
+        pool.emplace_back([&, t] {
+          std::size_t fresh = 0;
+          for (std::size_t i = n * t / threads; i != n * (t + 1) / threads; ++i)
+            fresh += insert(ids[i]);
+          bench::do_not_optimize(fresh);
+        });
+      for (std::thread& th : pool)
+        th.join();
+    };
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "markable_concurrent_set_%u_threads", threads);
+    bench::report("concurrent_set_insert", name, n, bench::best_time_ns([&] {
+      markable_concurrent_set<policy> s(n);
+      run([&](std::uint64_t id) { return s.insert(id); });
+      bench::do_not_optimize(s.capacity());
+    }, 3));
+
+    std::snprintf(name, sizeof(name), "mutex_markable_flat_set_%u_threads", threads);
+    bench::report("concurrent_set_insert", name, n, bench::best_time_ns([&] {
+      markable_flat_set<policy> s(n);
+      std::mutex mutex;
+      run([&](std::uint64_t id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return s.insert(id);
+      });
+      bench::do_not_optimize(s.size());
+    }, 3));
+  }
+}
+
+void bench_vs_optional(); // bench_optional.cpp
+
+// With no arguments runs every benchmark; "features" runs only those of the companion
+// headers above, "optional" only the comparison with std::optional.
+int main(int argc, char** argv)
+{
+  std::string only = argc > 1 ? argv[1] : "";
+  std::printf("group,name,elements,ns_per_element\n");
+  if (only.empty() || only == "features")
+  {
+    bench_dual_storage_copy(1 << 20);
+    bench_value_or(1 << 20);
+    bench_kleene_and(1 << 20);
+    bench_sort(1 << 22);
+    bench_reduce<mark_fp_nan<double>>("double", 1 << 20);
+    bench_reduce<mark_int<std::int32_t, std::numeric_limits<std::int32_t>::min()>>("int32", 1 << 20);
+    bench_parse<mark_int<std::int32_t, std::numeric_limits<std::int32_t>::min()>>("int32", 1 << 20);
+    bench_parse<mark_fp_nan<double>>("double", 1 << 20);
+    bench_hash_map<markable_flat_map<mark_int_tombstone<std::uint64_t, 0, std::uint64_t(-1)>, std::uint64_t>>("markable_flat_map", 1 << 20);
+    bench_hash_map<std::unordered_map<std::uint64_t, std::uint64_t>>("std_unordered_map", 1 << 20);
+    bench_marking<mark_int<std::int32_t, -1>>("mark_int", 1 << 14);
+    bench_marking<mark_sign_bit<std::int32_t>>("mark_sign_bit", 1 << 14);
+    bench_marking<mark_int_range<std::int32_t, -256, -1>>("mark_int_range", 1 << 14);
+    bench_expected(1 << 22);
+    bench_nan_payload(1 << 22);
+    bench_compact<mark_int<std::int32_t, -1>>("mark_int", 1 << 20, [](std::mt19937_64& r) { return std::int32_t(r() % 1000000); });
+    bench_compact<mark_fp_nan<double>>("mark_fp_nan", 1 << 20, [](std::mt19937_64& r) { return double(r() % 1000000) * 0.5; });
+    bench_compact<mark_bool>("mark_bool", 1 << 20, [](std::mt19937_64& r) { return bool(r() % 2); });
+    bench_fill<mark_int<std::int32_t, -1>>("mark_int_minus1");
+    bench_fill<mark_int<std::int32_t, 0>>("mark_int_zero");
+    bench_fill<mark_fp_nan<double>>("mark_fp_nan");
+    bench_float16<mark_half_nan>("half", 1 << 22);
+    bench_float16<mark_bf16_nan>("bf16", 1 << 22);
+    bench_atomic(1 << 22);
+    bench_concurrent_set(1 << 22);
+  }
+  if (only.empty() || only == "optional")
+    bench_vs_optional();
+}
@@ -0,0 +1,215 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// markable<MP> against std::optional<T> (and boost::optional<T> when Boost is found) for the
+// basic operations, at working-set sizes meant to fit L1, L2, the last-level cache and DRAM.
+// Lines are printed as group,name,elements,ns_per_element with
+//   group: <operation>_<level>, e.g. has_value_L2
+//   name:  <policy>_<implementation>, e.g. mark_int_markable, mark_int_std_optional
+// The level is the size of the std::optional array; the markable array has the same number
+// of elements, so it is smaller when markable saves space.
+
+#include "../include/ak_toolkit/markable.hpp"
+#include "bench.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+#if defined AK_TOOLKIT_BENCH_WITH_BOOST
+#  include <boost/optional.hpp>
+#endif
+
+using namespace ak_toolkit;
+
+namespace {
+
+struct interval
+{
+  int first, last;
+  friend auto operator<=>(const interval&, const interval&) = default;
+};
+
+struct interval_representation
+{
+  int first, last;
+};
+
+struct mark_interval : markable_dual_storage_type<mark_interval, interval, interval_representation>
+{
+  static representation_type marked_value() AK_TOOLKIT_NOEXCEPT { return {0, -1}; }
+  static bool is_marked_value(const representation_type& v) { return v.first > v.last; }
+};
+
+enum class color { red, green, blue, none };
+
+// Uniform access to the three kinds of optional object.
+template <typename O> struct optional_traits;
+
+template <typename MP>
+struct optional_traits<markable<MP>>
+{
+  typedef typename MP::value_type value_type;
+  static markable<MP> make(const value_type& v) { return markable<MP>(v); }
+  static typename MP::reference_type get(const markable<MP>& o) { return o.value(); }
+};
+
+template <typename T>
+struct optional_traits<std::optional<T>>
+{
+  typedef T value_type;
+  static std::optional<T> make(const T& v) { return std::optional<T>(v); }
+  static const T& get(const std::optional<T>& o) { return *o; }
+};
+
+#if defined AK_TOOLKIT_BENCH_WITH_BOOST
+template <typename T>
+struct optional_traits<boost::optional<T>>
+{
+  typedef T value_type;
+  static boost::optional<T> make(const T& v) { return boost::optional<T>(v); }
+  static const T& get(const boost::optional<T>& o) { return *o; }
+};
+#endif
+
+// Something to sum, so that the values are read.
+unsigned key(std::int32_t v) { return unsigned(v); }
+unsigned key(double v) { return unsigned(v); }
+unsigned key(bool v) { return v; }
+unsigned key(color v) { return unsigned(v); }
+unsigned key(interval v) { return unsigned(v.first); }
+
+std::int32_t random_int(std::mt19937_64& rng) { return std::int32_t(rng() % 1000000); }
+double random_double(std::mt19937_64& rng) { return double(rng() % 1000000) / 8; }
+bool random_bool(std::mt19937_64& rng) { return rng() & 1; }
+color random_color(std::mt19937_64& rng) { return color(rng() % 3); }
+interval random_interval(std::mt19937_64& rng) { int f = int(rng() % 1000000); return {f, f + int(rng() % 100)}; }
+
+struct level
+{
+  const char* name;
+  std::size_t bytes;
+};
+
+const level levels[] = {{"L1", 16 << 10}, {"L2", 256 << 10}, {"LLC", 8 << 20}, {"DRAM", 256 << 20}};
+
+// Enough repetitions to time small arrays reliably, few for the big ones.
+int reps_for(std::size_t bytes) { return bytes <= (256 << 10) ? 200 : bytes <= (8 << 20) ? 10 : 3; }
+
+void report(const char* op, const level& l, const char* policy, const char* impl, std::size_t n, double ns)
+{
+  char group[64], name[96];
+  std::snprintf(group, sizeof(group), "%s_%s", op, l.name);
+  std::snprintf(name, sizeof(name), "%s_%s", policy, impl);
+  bench::report(group, name, n, ns);
+}
+
+// 10% of the elements have no value.
+template <typename O, typename Gen>
+void run(const level& l, const char* policy, const char* impl, std::size_t n, Gen gen)
+{
+  typedef optional_traits<O> traits;
+  const int reps = reps_for(l.bytes);
+
+  std::mt19937_64 rng(1);
+  std::vector<typename traits::value_type> values(n);
+  std::vector<char> present(n);
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    values[i] = gen(rng);
+    present[i] = rng() % 10 != 0;
+  }
+  std::vector<std::uint32_t> indices(n);
+  for (std::uint32_t& i : indices)
+    i = std::uint32_t(rng() % n);
+
+  std::vector<O> v(n), w(n);
+  report("construct", l, policy, impl, n, bench::best_time_ns([&] {
+    for (std::size_t i = 0; i != n; ++i)
+      ::new (&v[i]) O(present[i] ? traits::make(values[i]) : O());
+    bench::do_not_optimize(v.data());
+  }, reps));
+
+  report("has_value", l, policy, impl, n, bench::best_time_ns([&] {
+    std::size_t count = 0;
+    for (const O& o : v)
+      count += bool(o.has_value());
+    bench::do_not_optimize(count);
+  }, reps));
+
+  report("value", l, policy, impl, n, bench::best_time_ns([&] {
+    unsigned sum = 0;
+    for (std::size_t i = 0; i != n; ++i)
+      if (present[i])
+        sum += key(traits::get(v[i]));
+    bench::do_not_optimize(sum);
+  }, reps));
+
+  report("traverse", l, policy, impl, n, bench::best_time_ns([&] {
+    unsigned sum = 0;
+    for (const O& o : v)
+      if (o.has_value())
+        sum += key(traits::get(o));
+    bench::do_not_optimize(sum);
+  }, reps));
+
+  report("random_access", l, policy, impl, n, bench::best_time_ns([&] {
+    unsigned sum = 0;
+    for (std::uint32_t i : indices)
+      if (v[i].has_value())
+        sum += key(traits::get(v[i]));
+    bench::do_not_optimize(sum);
+  }, reps));
+
+  report("assign", l, policy, impl, n, bench::best_time_ns([&] {
+    for (std::size_t i = 0; i != n; ++i)
+      w[i] = v[i];
+    bench::do_not_optimize(w.data());
+  }, reps));
+
+  report("swap", l, policy, impl, n, bench::best_time_ns([&] {
+    using std::swap;
+    for (std::size_t i = 0; i != n; ++i)
+      swap(w[i], w[n - 1 - i]);
+    bench::do_not_optimize(w.data());
+  }, reps));
+
+  if (l.bytes <= (8 << 20)) // sorting the DRAM arrays would dominate the run time
+    report("sort", l, policy, impl, n, bench::best_time_ns([&] {
+      w = v;
+      std::sort(w.begin(), w.end());
+      bench::do_not_optimize(w.data());
+    }, std::min(reps, 10)));
+}
+
+template <typename MP, typename Gen>
+void compare(const char* policy, Gen gen)
+{
+  typedef typename MP::value_type T;
+  for (const level& l : levels)
+  {
+    std::size_t n = l.bytes / sizeof(std::optional<T>);
+    run<markable<MP>>(l, policy, "markable", n, gen);
+    run<std::optional<T>>(l, policy, "std_optional", n, gen);
+#if defined AK_TOOLKIT_BENCH_WITH_BOOST
+    run<boost::optional<T>>(l, policy, "boost_optional", n, gen);
+#endif
+  }
+}
+
+} // namespace
+
+void bench_vs_optional()
+{
+  compare<mark_int<std::int32_t, -1>>("mark_int", random_int);
+  compare<mark_fp_nan<double>>("mark_fp_nan", random_double);
+  compare<mark_bool>("mark_bool", random_bool);
+  compare<mark_enum<color, int(color::none)>>("mark_enum", random_color);
+  compare<mark_interval>("dual_storage", random_interval);
+}
@@ -0,0 +1,156 @@
+# Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+#
+# Use, modification, and distribution is subject to the Boost Software
+# License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+# http://www.boost.org/LICENSE_1_0.txt)
+
+# Disassembles the probe functions of codegen_probes.cpp and checks them against
+# instruction budgets (x86-64, optimized, NDEBUG).
+#
+#   cmake -DOBJDUMP=<objdump> -DOBJECTS=<codegen_probes.o> -P check_codegen.cmake
+#
+# Every instruction up to the next symbol is counted, including those after a `ret`
+# (where the cold branch of a failed assertion goes), leaving out alignment padding and
+# `endbr64`. No probe may call or jump to another function or to a `.cold` part of its
+# own, and probes with a budget of one instruction plus `ret` may not branch at all.
+
+# probe, maximum number of instructions
+set(budgets
+  mark_int_has_value          3   # cmp, setne, ret
+  mark_int_value              2   # mov, ret
+  mark_int_value_or           5
+  mark_int_assign             2
+  mark_int_reset              2
+  mark_sign_bit_has_value     4   # load, not, shr, ret
+  mark_sign_bit_value         2
+  mark_int_range_has_value    3   # cmp, setb, ret (a range reaching the maximum)
+  mark_int_range_value        2
+  mark_fp_nan_has_value       4   # load, ucomisd, setnp, ret
+  mark_fp_nan_value           2
+  mark_fp_nan_value_or        7
+  mark_bool_has_value         3
+  mark_bool_value             3   # char to bool
+  mark_enum_has_value         3
+  mark_enum_value             2
+  mark_value_init_has_value   4
+  mark_value_init_value       2
+  mark_optional_has_value     2
+  mark_optional_value         2
+  mark_pointer_has_value      3
+  mark_pointer_value          2
+  mark_unique_ptr_has_value   3
+  mark_unique_ptr_value       2
+  mark_stl_empty_has_value    3
+  mark_stl_empty_value        2
+  mark_member_has_value       3
+  mark_member_value           2
+  dual_storage_has_value      4
+  dual_storage_value          2
+)
+
+# markable probe, std::optional probe, instructions markable may use above std::optional
+# (a compare with the marked value against loading the engaged flag)
+set(comparisons
+  mark_int_has_value      std_optional_int_has_value      1
+  mark_int_value          std_optional_int_value          0
+  mark_int_value_or       std_optional_int_value_or       0
+  mark_int_assign         std_optional_int_assign         0
+  mark_int_reset          std_optional_int_reset          0
+  mark_sign_bit_has_value std_optional_int_has_value      2
+  mark_int_range_has_value std_optional_int_has_value     1
+  mark_fp_nan_has_value   std_optional_double_has_value   2
+  mark_fp_nan_value       std_optional_double_value       0
+  mark_bool_has_value     std_optional_bool_has_value     1
+  mark_bool_value         std_optional_bool_value         1
+  mark_enum_has_value     std_optional_enum_has_value     1
+  mark_enum_value         std_optional_enum_value         0
+  mark_pointer_has_value  std_optional_pointer_has_value  1
+  mark_pointer_value      std_optional_pointer_value      0
+  mark_member_has_value   std_optional_order_has_value    1
+  mark_member_value       std_optional_order_value        0
+  dual_storage_has_value  std_optional_interval_has_value 2
+  dual_storage_value      std_optional_interval_value     0
+)
+
+execute_process(COMMAND ${OBJDUMP} -d --no-show-raw-insn ${OBJECTS}
+                OUTPUT_VARIABLE disassembly RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "${OBJDUMP} failed on ${OBJECTS}")
+endif()
+
+# AT&T syntax has no ';' or '[', which would upset CMake lists.
+string(REPLACE "\n" ";" lines "${disassembly}")
+set(errors "")
+set(probes "")
+set(current "")
+foreach(line IN LISTS lines)
+  if(line MATCHES "^[0-9a-f]+ <probe_([A-Za-z0-9_]+)>:$")
+    set(current ${CMAKE_MATCH_1})
+    set(count_${current} 0)
+    set(branches_${current} "")
+    list(APPEND probes ${current})
+  elseif(line MATCHES "^[0-9a-f]+ <probe_([A-Za-z0-9_]+)\\.")
+    list(APPEND errors "${CMAKE_MATCH_1}: has a separate part: ${line}")
+    set(current "")
+  elseif(line MATCHES "^[0-9a-f]+ <")
+    set(current "")
+  elseif(current AND line MATCHES "^ +[0-9a-f]+:\t(.*)$")
+    set(insn "${CMAKE_MATCH_1}")
+    if(insn MATCHES "nop|int3|endbr64|xchg +%ax,%ax")
+      continue()
+    endif()
+    math(EXPR count_${current} "${count_${current}} + 1")
+    if(insn MATCHES "^call")
+      list(APPEND errors "${current}: calls a function: ${insn}")
+    elseif(insn MATCHES "^j[a-z]+ .*<([A-Za-z0-9_.]+)" AND NOT CMAKE_MATCH_1 STREQUAL "probe_${current}")
+      list(APPEND errors "${current}: jumps out of the function: ${insn}")
+    elseif(insn MATCHES "^j[a-z]+ +\\*")
+      list(APPEND errors "${current}: jumps indirectly: ${insn}")
+    elseif(insn MATCHES "^j" AND NOT insn MATCHES "^jmp")
+      list(APPEND branches_${current} "${insn}")
+    endif()
+  endif()
+endforeach()
+
+if(NOT probes)
+  message(FATAL_ERROR "no probe functions found in ${OBJECTS}")
+endif()
+
+list(LENGTH budgets n)
+math(EXPR last "${n} - 1")
+foreach(i RANGE 0 ${last} 2)
+  math(EXPR j "${i} + 1")
+  list(GET budgets ${i} probe)
+  list(GET budgets ${j} budget)
+  if(NOT DEFINED count_${probe})
+    list(APPEND errors "${probe}: probe not found")
+  elseif(count_${probe} GREATER budget)
+    list(APPEND errors "${probe}: ${count_${probe}} instructions, budget ${budget}")
+  elseif(budget LESS_EQUAL 2 AND branches_${probe})
+    list(APPEND errors "${probe}: branches: ${branches_${probe}}")
+  endif()
+endforeach()
+
+list(LENGTH comparisons n)
+math(EXPR last "${n} - 1")
+foreach(i RANGE 0 ${last} 3)
+  math(EXPR j "${i} + 1")
+  math(EXPR k "${i} + 2")
+  list(GET comparisons ${i} probe)
+  list(GET comparisons ${j} reference)
+  list(GET comparisons ${k} slack)
+  if(NOT DEFINED count_${probe} OR NOT DEFINED count_${reference})
+    list(APPEND errors "${probe}: probe or ${reference} not found")
+    continue()
+  endif()
+  math(EXPR limit "${count_${reference}} + ${slack}")
+  message(STATUS "${probe}: ${count_${probe}} instructions, ${reference}: ${count_${reference}}")
+  if(count_${probe} GREATER limit)
+    list(APPEND errors "${probe}: ${count_${probe}} instructions, more than ${reference} (${count_${reference}}) + ${slack}")
+  endif()
+endforeach()
+
+if(errors)
+  string(REPLACE ";" "\n  " errors "${errors}")
+  message(FATAL_ERROR "codegen budgets exceeded:\n  ${errors}")
+endif()
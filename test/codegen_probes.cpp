@@ -0,0 +1,112 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Probe functions for the codegen test: each exercises one accessor of one policy, or the
+// equivalent std::optional code, and is compiled with optimizations and NDEBUG. The object
+// file is disassembled by check_codegen.cmake, which holds the instruction budgets.
+// Names are extern "C" so that they appear unmangled in the disassembly.
+
+#include "../include/ak_toolkit/markable.hpp"
+#include <memory>
+#include <optional>
+#include <string>
+
+using namespace ak_toolkit;
+
+namespace {
+
+enum class color { red, green, blue, none };
+
+struct interval
+{
+  int first, last;
+};
+
+struct interval_representation
+{
+  int first, last;
+};
+
+struct mark_interval : markable_dual_storage_type<mark_interval, interval, interval_representation>
+{
+  static representation_type marked_value() AK_TOOLKIT_NOEXCEPT { return {0, -1}; }
+  static bool is_marked_value(const representation_type& v) { return v.first > v.last; }
+};
+
+struct order
+{
+  markable<mark_int<long, -1>> id;
+  double px;
+  int qty;
+};
+
+typedef markable<mark_int<int, -1>>                       m_int;
+typedef markable<mark_sign_bit<int>>                      m_sign_bit;
+typedef markable<mark_int_range<unsigned, 0xFFFFFF00u, 0xFFFFFFFFu>> m_int_range;
+typedef markable<mark_fp_nan<double>>                     m_double;
+typedef markable<mark_bool>                               m_bool;
+typedef markable<mark_enum<color, int(color::none)>>      m_enum;
+typedef markable<mark_value_init<int>>                    m_value_init;
+typedef markable<mark_optional<std::optional<int>>>       m_optional;
+typedef markable<mark_pointer<int>>                       m_pointer;
+typedef markable<mark_unique_ptr<int>>                    m_unique_ptr;
+typedef markable<mark_stl_empty<std::string>>             m_string;
+typedef markable<mark_member<&order::id>>                 m_member;
+
+} // namespace
+
+#define AK_TOOLKIT_PROBE(NAME, RET, PARAM, EXPR) extern "C" RET probe_##NAME(PARAM) { return EXPR; }
+
+AK_TOOLKIT_PROBE(mark_int_has_value,          bool,   const m_int* p,        p->has_value())
+AK_TOOLKIT_PROBE(mark_int_value,              int,    const m_int* p,        p->value())
+AK_TOOLKIT_PROBE(mark_int_value_or,           int,    const m_int* p,        p->value_or(0))
+AK_TOOLKIT_PROBE(mark_int_assign,             void,   m_int* p,              p->assign(7))
+AK_TOOLKIT_PROBE(mark_int_reset,              void,   m_int* p,              void(*p = m_int()))
+AK_TOOLKIT_PROBE(mark_sign_bit_has_value,     bool,   const m_sign_bit* p,   p->has_value())
+AK_TOOLKIT_PROBE(mark_sign_bit_value,         int,    const m_sign_bit* p,   p->value())
+AK_TOOLKIT_PROBE(mark_int_range_has_value,    bool,   const m_int_range* p,  p->has_value())
+AK_TOOLKIT_PROBE(mark_int_range_value,        unsigned, const m_int_range* p, p->value())
+AK_TOOLKIT_PROBE(mark_fp_nan_has_value,       bool,   const m_double* p,     p->has_value())
+AK_TOOLKIT_PROBE(mark_fp_nan_value,           double, const m_double* p,     p->value())
+AK_TOOLKIT_PROBE(mark_fp_nan_value_or,        double, const m_double* p,     p->value_or(0.0))
+AK_TOOLKIT_PROBE(mark_bool_has_value,         bool,   const m_bool* p,       p->has_value())
+AK_TOOLKIT_PROBE(mark_bool_value,             bool,   const m_bool* p,       p->value())
+AK_TOOLKIT_PROBE(mark_enum_has_value,         bool,   const m_enum* p,       p->has_value())
+AK_TOOLKIT_PROBE(mark_enum_value,             color,  const m_enum* p,       p->value())
+AK_TOOLKIT_PROBE(mark_value_init_has_value,   bool,   const m_value_init* p, p->has_value())
+AK_TOOLKIT_PROBE(mark_value_init_value,       int,    const m_value_init* p, p->value())
+AK_TOOLKIT_PROBE(mark_optional_has_value,     bool,   const m_optional* p,   p->has_value())
+AK_TOOLKIT_PROBE(mark_optional_value,         int,    const m_optional* p,   p->value())
+AK_TOOLKIT_PROBE(mark_pointer_has_value,      bool,   const m_pointer* p,    p->has_value())
+AK_TOOLKIT_PROBE(mark_pointer_value,          int*,   const m_pointer* p,    p->value())
+AK_TOOLKIT_PROBE(mark_unique_ptr_has_value,   bool,   const m_unique_ptr* p, p->has_value())
+AK_TOOLKIT_PROBE(mark_unique_ptr_value,       int*,   const m_unique_ptr* p, p->value().get())
+AK_TOOLKIT_PROBE(mark_stl_empty_has_value,    bool,   const m_string* p,     p->has_value())
+AK_TOOLKIT_PROBE(mark_stl_empty_value,        std::size_t, const m_string* p, p->value().size())
+AK_TOOLKIT_PROBE(mark_member_has_value,       bool,   const m_member* p,     p->has_value())
+AK_TOOLKIT_PROBE(mark_member_value,           double, const m_member* p,     p->value().px)
+AK_TOOLKIT_PROBE(dual_storage_has_value,      bool,   const markable<mark_interval>* p, p->has_value())
+AK_TOOLKIT_PROBE(dual_storage_value,          int,    const markable<mark_interval>* p, p->value().first)
+
+// the std::optional counterparts
+AK_TOOLKIT_PROBE(std_optional_int_has_value,    bool,   const std::optional<int>* p,    p->has_value())
+AK_TOOLKIT_PROBE(std_optional_int_value,        int,    const std::optional<int>* p,    **p)
+AK_TOOLKIT_PROBE(std_optional_int_value_or,     int,    const std::optional<int>* p,    p->value_or(0))
+AK_TOOLKIT_PROBE(std_optional_int_assign,       void,   std::optional<int>* p,          void(*p = 7))
+AK_TOOLKIT_PROBE(std_optional_int_reset,        void,   std::optional<int>* p,          p->reset())
+AK_TOOLKIT_PROBE(std_optional_double_has_value, bool,   const std::optional<double>* p, p->has_value())
+AK_TOOLKIT_PROBE(std_optional_double_value,     double, const std::optional<double>* p, **p)
+AK_TOOLKIT_PROBE(std_optional_double_value_or,  double, const std::optional<double>* p, p->value_or(0.0))
+AK_TOOLKIT_PROBE(std_optional_bool_has_value,   bool,   const std::optional<bool>* p,   p->has_value())
+AK_TOOLKIT_PROBE(std_optional_bool_value,       bool,   const std::optional<bool>* p,   **p)
+AK_TOOLKIT_PROBE(std_optional_enum_has_value,   bool,   const std::optional<color>* p,  p->has_value())
+AK_TOOLKIT_PROBE(std_optional_enum_value,       color,  const std::optional<color>* p,  **p)
+AK_TOOLKIT_PROBE(std_optional_pointer_has_value, bool,  const std::optional<int*>* p,   p->has_value())
+AK_TOOLKIT_PROBE(std_optional_pointer_value,    int*,   const std::optional<int*>* p,   **p)
+AK_TOOLKIT_PROBE(std_optional_interval_has_value, bool, const std::optional<interval>* p, p->has_value())
+AK_TOOLKIT_PROBE(std_optional_order_has_value, bool,   const std::optional<order>* p,  p->has_value())
+AK_TOOLKIT_PROBE(std_optional_order_value,     double, const std::optional<order>* p,  (**p).px)
+AK_TOOLKIT_PROBE(std_optional_interval_value,   int,    const std::optional<interval>* p, (**p).first)
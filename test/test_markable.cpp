@@ -11,6 +11,12 @@
 #include <cassert>
 #include <utility>
 #include <string>
+#include <cstring>
+#include <array>
+#include <memory>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
 
 
 
@@ -153,6 +159,78 @@ void test_mark_fp_nan()
   assert (v != v);
 }
 
+void test_mark_fp_nan_payload()
+{
+  typedef mark_fp_nan_payload<double, 0x4D4B> policy;
+  typedef markable<policy> opt_double;
+  [[maybe_unused]] typedef markable<mark_fp_nan_payload<float, 1>> opt_float;
+  static_assert(sizeof(opt_double) == sizeof(double), "");
+  static_assert(!opt_double().has_value(), "");
+  static_assert(policy::marked_bits == 0x7FF8000000004D4Bull, "");
+
+  volatile double zero = 0.0;
+  opt_double o_, o1 (1.0), oNan (zero / zero), oQNan (std::numeric_limits<double>::quiet_NaN());
+  assert (!o_.has_value());
+  assert (o1.has_value() && o1.value() == 1.0);
+  assert (oNan.has_value());  // a computed NaN is a value
+  assert (oQNan.has_value());
+  [[maybe_unused]] double v = oNan.value();
+  assert (v != v);
+
+  [[maybe_unused]] double m = o_.storage_value();
+  assert (m != m);
+  assert (!opt_double(m).has_value());
+#if defined __x86_64__
+  assert (!opt_double(m * 2.0 + 1.0).has_value()); // the payload propagates
+#endif
+
+  assert (!opt_float().has_value());
+  assert (opt_float(float(zero / zero)).has_value());
+  assert (opt_float(-2.5f).value() == -2.5f);
+}
+
+void test_mark_sign_bit()
+{
+  typedef markable<mark_sign_bit<int>> opt_int;
+  static_assert(sizeof(opt_int) == sizeof(int), "");
+  static_assert(!opt_int().has_value(), "");
+  static_assert(opt_int(0).has_value(), "");
+
+  opt_int o_, o0 (0), oMax (std::numeric_limits<int>::max()), oMinus (-7), oMin (std::numeric_limits<int>::min());
+  assert (!o_.has_value());
+  assert (o_.storage_value() == -1);
+  assert (o0.has_value() && o0.value() == 0);
+  assert (oMax.has_value() && oMax.value() == std::numeric_limits<int>::max());
+  assert (!oMinus.has_value()); // any negative value is marked
+  assert (!oMin.has_value());
+  assert (o_ == oMinus);        // and all of them compare equal
+  assert (!markable<mark_sign_bit<std::int8_t>>(std::int8_t(-128)).has_value());
+}
+
+void test_mark_int_range()
+{
+  typedef mark_int_range<std::uint32_t, 0xFFFFFF00u, 0xFFFFFFFFu> policy;
+  typedef markable<policy> opt_uint;
+  static_assert(sizeof(opt_uint) == sizeof(std::uint32_t), "");
+  static_assert(!opt_uint().has_value(), "");
+  static_assert(opt_uint().storage_value() == 0xFFFFFF00u, "");
+
+  assert (opt_uint(0).has_value());
+  assert (opt_uint(0xFFFFFEFFu).has_value());
+  assert (!opt_uint(0xFFFFFF00u).has_value());
+  assert (!opt_uint(0xFFFFFF7Fu).has_value());
+  assert (!opt_uint(0xFFFFFFFFu).has_value());
+
+  [[maybe_unused]] typedef markable<mark_int_range<int, -3, 2>> opt_int; // straddles zero
+  assert (opt_int(-4).has_value() && opt_int(3).has_value());
+  assert (opt_int(std::numeric_limits<int>::min()).has_value() && opt_int(std::numeric_limits<int>::max()).has_value());
+  for (int i = -3; i <= 2; ++i)
+    assert (!opt_int(i).has_value());
+
+  [[maybe_unused]] typedef markable<mark_int_range<std::int64_t, std::numeric_limits<std::int64_t>::min(), std::numeric_limits<std::int64_t>::max()>> opt_none; // nothing is a value
+  assert (!opt_none(0).has_value() && !opt_none(std::numeric_limits<std::int64_t>::max()).has_value());
+}
+
 void test_mark_value_init()
 {
   {
@@ -463,6 +541,61 @@ void test_mark_dual_storage()
 void test_mark_dual_storage_1() { test_mark_dual_storage<range, mark_range>(); }
 void test_mark_dual_storage_2() { test_mark_dual_storage<range2, mark_range2>(); }
 
+struct trivial_range
+{
+  int min_, max_;
+  friend bool operator==(const trivial_range& l, const trivial_range& r) { return l.min_ == r.min_ && l.max_ == r.max_; }
+};
+
+struct trivial_range_representation
+{
+  int min_, max_;
+};
+
+struct mark_trivial_range : markable_dual_storage_type<mark_trivial_range, trivial_range, trivial_range_representation>
+{
+  static constexpr representation_type marked_value() AK_TOOLKIT_NOEXCEPT { return {0, -1}; }
+  static constexpr bool is_marked_value(const representation_type& v) { return v.min_ > v.max_; }
+};
+
+void test_dual_storage_trivially_copyable()
+{
+  typedef markable<mark_trivial_range> opt_range;
+  static_assert (std::is_trivially_copyable<opt_range>::value, "dual storage of trivial types must be trivially copyable");
+  static_assert (std::is_trivially_destructible<opt_range>::value, "dual storage of trivial types must be trivially destructible");
+  static_assert (std::is_trivially_copy_constructible<opt_range>::value, "");
+  static_assert (std::is_trivially_move_constructible<opt_range>::value, "");
+  static_assert (std::is_trivially_copy_assignable<opt_range>::value, "");
+  static_assert (std::is_trivially_move_assignable<opt_range>::value, "");
+
+  static_assert (!std::is_trivially_copyable<markable<mark_range>>::value, "range has a non-trivial copy constructor");
+  static_assert (!std::is_trivially_destructible<markable<mark_range>>::value, "range has a non-trivial destructor");
+
+  const trivial_range r12 {1, 2};
+  opt_range o_, o12(r12);
+  assert (!o_.has_value());
+  assert (o12.has_value());
+
+  opt_range c = o12;
+  assert (c.has_value());
+  assert (c.value() == r12);
+
+  c = o_;
+  assert (!c.has_value());
+
+  swap(c, o12);
+  assert (c.has_value());
+  assert (c.value() == r12);
+  assert (!o12.has_value());
+
+  opt_range buf[2];
+  std::memcpy(static_cast<void*>(buf), &c, sizeof(c));
+  std::memcpy(static_cast<void*>(buf + 1), &o12, sizeof(o12));
+  assert (buf[0].has_value());
+  assert (buf[0].value() == r12);
+  assert (!buf[1].has_value());
+}
+
 
 /*
 class Date
@@ -603,6 +736,421 @@ void test_dual_storage_with_tuple_init_state_mutation()
 
 
 
+typedef markable<mark_trivial_range> opt_trivial_range;
+
+constexpr std::array<opt_trivial_range, 4> make_range_table()
+{
+  std::array<opt_trivial_range, 4> t {};
+  t[0] = opt_trivial_range(trivial_range{1, 2});
+  t[1].assign(trivial_range{3, 4});
+  swap(t[0], t[2]);
+  t[3] = t[1];
+  t[1] = opt_trivial_range();
+  return t;
+}
+
+constexpr std::array<opt_trivial_range, 4> range_table = make_range_table(); // in .rodata
+constexpr opt_trivial_range range_literals[] = { opt_trivial_range(trivial_range{5, 6}), opt_trivial_range() };
+
+void test_constexpr_dual_storage()
+{
+  // compile-time inspection of the active union members
+  static_assert (range_table[0].storage_value().representation().min_ == 0, "marked");
+  static_assert (range_table[2].storage_value().as_value().max_ == 2, "");
+  static_assert (range_table[3].storage_value().as_value().min_ == 3, "");
+  static_assert (range_literals[0].storage_value().as_value().min_ == 5, "");
+  static_assert (!range_literals[1].has_value(), "marked state can be checked in constant expressions");
+
+  assert (!range_table[0].has_value());
+  assert (!range_table[1].has_value());
+  assert ( range_table[2].has_value());
+  assert ( range_table[3].has_value());
+  assert (range_table[2].value() == (trivial_range{1, 2}));
+  assert (range_table[3].value() == (trivial_range{3, 4}));
+  assert (range_literals[0].value() == (trivial_range{5, 6}));
+}
+
+class heap_int
+{
+  int* p_;
+
+public:
+  static int live;
+  heap_int() noexcept : p_(nullptr) {}
+  explicit heap_int(int v) : p_(new int(v)) { ++live; }
+  heap_int(heap_int const& rhs) : p_(rhs.p_ ? new int(*rhs.p_) : nullptr) { live += !!p_; }
+  heap_int(heap_int&& rhs) noexcept : p_(rhs.p_) { rhs.p_ = nullptr; }
+  heap_int& operator=(heap_int rhs) noexcept { std::swap(p_, rhs.p_); return *this; }
+  ~heap_int() { if (p_) { delete p_; --live; } }
+  bool is_null() const { return !p_; }
+  int get() const { return *p_; }
+};
+
+int heap_int::live = 0;
+
+struct mark_heap_int : markable_type<heap_int>
+{
+  typedef void is_trivially_relocatable_mark_policy; // only owns a pointer
+  static heap_int marked_value() noexcept { return heap_int(); }
+  static bool is_marked_value(const heap_int& v) { return v.is_null(); }
+};
+
+template <typename MP>
+constexpr bool is_nothrow_regular()
+{
+  typedef markable<MP> opt;
+  return std::is_nothrow_move_constructible<opt>::value
+      && std::is_nothrow_move_assignable<opt>::value
+      && std::is_nothrow_swappable<opt>::value;
+}
+
+void test_nothrow_and_relocation_traits()
+{
+  static_assert (is_nothrow_regular<mark_int<int, -1>>(), "");
+  static_assert (is_nothrow_regular<mark_fp_nan<double>>(), "");
+  static_assert (is_nothrow_regular<mark_bool>(), "");
+  static_assert (is_nothrow_regular<mark_enum<Dir, -1>>(), "");
+  static_assert (is_nothrow_regular<mark_value_init<int>>(), "");
+  static_assert (is_nothrow_regular<mark_stl_empty<std::string>>(), "");
+  static_assert (is_nothrow_regular<mark_trivial_range>(), "");
+  static_assert (is_nothrow_regular<mark_heap_int>(), "");
+  static_assert (std::is_nothrow_copy_constructible<markable<mark_trivial_range>>::value, "");
+
+  // range has a throwing copy constructor and no move constructor
+  static_assert (!std::is_nothrow_move_constructible<markable<mark_range>>::value, "");
+  static_assert (!std::is_nothrow_copy_constructible<markable<mark_range2>>::value, "");
+
+  static_assert (is_trivially_relocatable<markable<mark_int<int, -1>>>::value, "");
+  static_assert (is_trivially_relocatable<markable<mark_fp_nan<double>>>::value, "");
+  static_assert (is_trivially_relocatable<markable<mark_bool>>::value, "");
+  static_assert (is_trivially_relocatable<markable<mark_enum<Dir, -1>>>::value, "");
+  static_assert (is_trivially_relocatable<markable<mark_value_init<int>>>::value, "");
+  static_assert (is_trivially_relocatable<markable<mark_trivial_range>>::value, "");
+  static_assert (is_trivially_relocatable<markable<mark_heap_int>>::value, "opted in");
+  static_assert (!is_trivially_relocatable<markable<mark_stl_empty<std::string>>>::value, "");
+  static_assert (!is_trivially_relocatable<markable<mark_range>>::value, "");
+}
+
+void test_uninitialized_relocate()
+{
+  typedef markable<mark_heap_int> opt_int;
+  {
+    alignas(opt_int) unsigned char src_buf[3 * sizeof(opt_int)], dst_buf[3 * sizeof(opt_int)];
+    opt_int* src = reinterpret_cast<opt_int*>(src_buf);
+    opt_int* dst = reinterpret_cast<opt_int*>(dst_buf);
+    ::new (src + 0) opt_int(heap_int(1));
+    ::new (src + 1) opt_int();
+    ::new (src + 2) opt_int(heap_int(3));
+    assert (heap_int::live == 2);
+
+    [[maybe_unused]] opt_int* end = uninitialized_relocate_n(src, 3, dst);
+    assert (end == dst + 3);
+    assert (heap_int::live == 2); // nothing copied or destroyed
+    assert (dst[0].has_value() && dst[0].value().get() == 1);
+    assert (!dst[1].has_value());
+    assert (dst[2].has_value() && dst[2].value().get() == 3);
+    std::destroy_n(dst, 3);
+  }
+  assert (heap_int::live == 0);
+
+  reset_globals();
+  {
+    typedef markable<mark_range> opt_range;
+    alignas(opt_range) unsigned char src_buf[2 * sizeof(opt_range)], dst_buf[2 * sizeof(opt_range)];
+    opt_range* src = reinterpret_cast<opt_range*>(src_buf);
+    opt_range* dst = reinterpret_cast<opt_range*>(dst_buf);
+    ::new (src + 0) opt_range(range(1, 2));
+    ::new (src + 1) opt_range();
+    uninitialized_relocate_n(src, 2, dst); // move-construct and destroy
+    assert (dst[0].has_value() && dst[0].value() == range(1, 2));
+    assert (!dst[1].has_value());
+    std::destroy_n(dst, 2);
+  }
+  assert (objects_created == objects_destroyed);
+}
+
+struct pixel
+{
+  unsigned char r, g, b, alpha;
+};
+
+struct mark_transparent : markable_type<pixel>
+{
+  static constexpr int marked_byte = 0; // not deduced for class types
+  static constexpr pixel marked_value() AK_TOOLKIT_NOEXCEPT { return {0, 0, 0, 0}; }
+  static constexpr bool is_marked_value(const pixel& p) { return p.alpha == 0; }
+};
+
+void test_marked_fill()
+{
+  static_assert (repeated_marked_byte<mark_int<int, -1>>::value == 0xFF, "");
+  static_assert (repeated_marked_byte<mark_int<std::uint64_t, 0>>::value == 0, "");
+  static_assert (repeated_marked_byte<mark_int<int, 0x01010101>>::value == 0x01, "");
+  static_assert (repeated_marked_byte<mark_int<int, 1>>::value == -1, "");
+  static_assert (repeated_marked_byte<mark_int<char, 'x'>>::value == 'x', "");
+  static_assert (repeated_marked_byte<mark_sign_bit<short>>::value == 0xFF, "the byte of marked_value() first");
+  static_assert (repeated_marked_byte<mark_int_range<int, -5, 5>>::value == 0, "zero first");
+  static_assert (repeated_marked_byte<mark_fp_nan<double>>::value == 0xFF, "a NaN");
+  static_assert (repeated_marked_byte<mark_fp_nan<float>>::value == 0xFF, "");
+  static_assert (repeated_marked_byte<mark_fp_nan_payload<double, 1>>::value == -1, "");
+  static_assert (repeated_marked_byte<mark_bool>::value == 2, "");
+  static_assert (repeated_marked_byte<mark_enum<Dir, -1>>::value == 0xFF, "");
+  static_assert (repeated_marked_byte<mark_value_init<double>>::value == 0, "");
+  static_assert (repeated_marked_byte<mark_transparent>::value == 0, "");
+  static_assert (repeated_marked_byte<mark_trivial_range>::value == -1, "");
+  static_assert (repeated_marked_byte<mark_stl_empty<std::string>>::value == -1, "");
+
+  {
+    typedef markable<mark_int<int, -1>> opt_int;
+    alignas(opt_int) unsigned char buf[5 * sizeof(opt_int)];
+    std::memset(buf, 0x12, sizeof(buf));
+    opt_int* a = reinterpret_cast<opt_int*>(buf);
+    [[maybe_unused]] opt_int* end = uninitialized_fill_marked(a, 5);
+    assert (end == a + 5);
+    for (int i = 0; i != 5; ++i)
+      assert (!a[i].has_value() && a[i].storage_value() == -1);
+    a[2] = opt_int(7);
+    fill_marked(a, 5);
+    assert (!a[2].has_value());
+  }
+  {
+    marked_array<mark_fp_nan<double>> a = make_marked_array<mark_fp_nan<double>>(1000);
+    for (int i = 0; i != 1000; ++i)
+      assert (!a[i].has_value());
+    assert (a[999] == markable<mark_fp_nan<double>>());
+
+    marked_array<mark_int_range<int, -5, 5>> z = make_marked_array<mark_int_range<int, -5, 5>>(3); // calloc
+    assert (!z[0].has_value() && z[2].storage_value() == 0);
+
+    fill_marked(static_cast<markable<mark_int<int, -1>>*>(nullptr), 0);
+    uninitialized_fill_marked(static_cast<markable<mark_int<int, -1>>*>(nullptr), 0);
+
+    marked_array<mark_transparent> p = make_marked_array<mark_transparent>(4);
+    assert (!p[3].has_value());
+
+    marked_array<mark_trivial_range> r = make_marked_array<mark_trivial_range>(2); // one constructor call each
+    assert (!r[0].has_value() && !r[1].has_value());
+  }
+  {
+    alignas(std::string) unsigned char buf[2 * sizeof(markable<mark_stl_empty<std::string>>)];
+    markable<mark_stl_empty<std::string>>* a = reinterpret_cast<markable<mark_stl_empty<std::string>>*>(buf);
+    uninitialized_fill_marked(a, 2);
+    assert (!a[0].has_value() && !a[1].has_value());
+    a[1] = markable<mark_stl_empty<std::string>>(std::string("x"));
+    fill_marked(a, 2);
+    assert (!a[1].has_value());
+    std::destroy_n(a, 2);
+  }
+}
+
+void test_monadic_operations()
+{
+  typedef markable<mark_int<int, -1>> opt_int;
+  [[maybe_unused]] typedef markable<mark_fp_nan<double>> opt_double;
+  typedef markable<mark_stl_empty<std::string>> opt_string;
+
+  assert (opt_int(3).value_or(7) == 3);
+  assert (opt_int().value_or(7) == 7);
+  assert (opt_double().value_or(1) == 1.0);
+  assert (opt_string().value_or("none") == "none");
+  assert (opt_string("a").value_or("none") == "a");
+
+  [[maybe_unused]] auto half = [](int i) { return i / 2.0; };
+  assert (opt_int(3).transform<mark_fp_nan<double>>(half).value() == 1.5);
+  assert (!opt_int().transform<mark_fp_nan<double>>(half).has_value());
+  assert (opt_int(3).transform([](int i) { return i + 1; }).value() == 4);
+
+  [[maybe_unused]] auto positive = [](int i) { return i > 0 ? opt_int(i) : opt_int(); };
+  assert (opt_int(3).and_then(positive).value() == 3);
+  assert (!opt_int(0).and_then(positive).has_value());
+  assert (!opt_int().and_then(positive).has_value());
+  [[maybe_unused]] auto name = [](int i) { return opt_string(std::string(std::size_t(i), 'x')); };
+  assert (opt_int(2).and_then(name).value() == "xx");
+
+  int calls = 0;
+  [[maybe_unused]] auto zero = [&] { ++calls; return opt_int(0); };
+  assert (opt_int(5).or_else(zero).value() == 5);
+  assert (calls == 0);
+  assert (opt_int().or_else(zero).value() == 0);
+  assert (calls == 1);
+
+  static_assert(opt_int(4).value_or(0) == 4, "");
+  static_assert(opt_int(4).transform([](int i) { return i * 2; }).value() == 8, "");
+}
+
+struct counted
+{
+  static int live;
+  int v;
+  explicit counted(int v) : v(v) { ++live; }
+  ~counted() { --live; }
+};
+int counted::live = 0;
+
+void test_mark_pointer()
+{
+  typedef markable<mark_pointer<int>> opt_ptr;
+  typedef markable<mark_pointer<int, 1>> opt_nullable_ptr;
+  static_assert(sizeof(opt_ptr) == sizeof(int*), "");
+  static_assert(sizeof(opt_nullable_ptr) == sizeof(int*), "");
+  static_assert(std::is_trivially_copyable<opt_nullable_ptr>::value, "");
+
+  [[maybe_unused]] int i = 1;
+  assert (!opt_ptr().has_value());
+  assert (!opt_ptr(nullptr).has_value());
+  assert (opt_ptr(&i).value() == &i);
+
+  assert (!opt_nullable_ptr().has_value());
+  assert (opt_nullable_ptr(nullptr).has_value());
+  assert (opt_nullable_ptr(nullptr).value() == nullptr);
+  assert (opt_nullable_ptr(&i).value() == &i);
+  assert (opt_nullable_ptr().value_or(&i) == &i);
+}
+
+void test_mark_unique_ptr()
+{
+  typedef markable<mark_unique_ptr<counted>> opt_ptr;
+  typedef markable<mark_unique_ptr<counted, 1>> opt_nullable_ptr;
+  static_assert(sizeof(opt_ptr) == sizeof(counted*), "");
+  static_assert(sizeof(opt_nullable_ptr) == sizeof(counted*), "");
+  static_assert(!std::is_copy_constructible<opt_nullable_ptr>::value, "");
+  static_assert(std::is_nothrow_move_constructible<opt_nullable_ptr>::value, "");
+  static_assert(is_trivially_relocatable<opt_nullable_ptr>::value, "");
+
+  {
+    opt_nullable_ptr a, b(std::make_unique<counted>(1)), c(std::unique_ptr<counted>{});
+    assert (!a.has_value());
+    assert (b.has_value() && b.value()->v == 1);
+    assert (c.has_value() && c.value() == nullptr);
+    assert (counted::live == 1);
+
+    a = std::move(b);
+    assert (a.value()->v == 1);
+    assert (counted::live == 1);
+
+    b = opt_nullable_ptr(std::make_unique<counted>(2));
+    swap(a, b);
+    assert (a.value()->v == 2 && b.value()->v == 1);
+    assert (counted::live == 2);
+
+    a = opt_nullable_ptr();
+    assert (!a.has_value());
+    assert (counted::live == 1);
+  }
+  assert (counted::live == 0);
+
+  {
+    opt_ptr a(std::make_unique<counted>(3));
+    opt_ptr b(std::move(a));
+    assert (b.value()->v == 3);
+    assert (!a.has_value()); // moved-from unique_ptr is null: the marked value
+  }
+  assert (counted::live == 0);
+
+  {
+    std::vector<opt_nullable_ptr> v;
+    for (int k = 0; k != 100; ++k)
+      v.push_back(k % 3 ? opt_nullable_ptr(std::make_unique<counted>(k)) : opt_nullable_ptr());
+    assert (counted::live == 66);
+  }
+  assert (counted::live == 0);
+}
+
+struct Order
+{
+  markable<mark_int<std::int64_t, -1>> id;
+  double px;
+  int qty;
+};
+
+struct Fill
+{
+  Order order;
+  int venue;
+};
+
+struct Book
+{
+  markable<mark_member<&Order::id>> best_bid; // a nested markable
+  int depth;
+};
+
+struct Quote
+{
+  markable<mark_int<int, 0>> size = markable<mark_int<int, 0>>(100); // the default has a value
+  int px;
+};
+
+void test_mark_member()
+{
+  typedef markable<mark_member<&Order::id>> opt_order;
+  typedef markable<mark_member<&Fill::order, &Order::id>> opt_fill;
+  typedef markable<mark_member<&Book::best_bid>> opt_book;
+  [[maybe_unused]] typedef markable<mark_member<&Quote::size>> opt_quote;
+  static_assert(sizeof(opt_order) == sizeof(Order), "");
+  static_assert(sizeof(opt_fill) == sizeof(Fill), "");
+  static_assert(sizeof(opt_book) == sizeof(Book), "");
+  static_assert(std::is_trivially_copyable<opt_order>::value, "");
+  static_assert(!opt_order().has_value(), "");
+
+  typedef markable<mark_int<std::int64_t, -1>> opt_id;
+  Order o {opt_id(7), 1.5, 10};
+  assert (!opt_order().has_value());
+  assert (opt_order(o).has_value());
+  assert (opt_order(o).value().px == 1.5);
+  assert (!opt_order(Order{opt_id(), 1.5, 10}).has_value());
+
+  assert (!opt_fill().has_value());
+  assert (opt_fill(Fill{o, 3}).value().order.id.value() == 7);
+  assert (!opt_fill(Fill{Order{}, 3}).has_value());
+
+  assert (!opt_book().has_value());
+  assert (!opt_book(Book{opt_order(), 5}).has_value());
+  assert (opt_book(Book{opt_order(o), 5}).value().best_bid.value().qty == 10);
+
+  assert (Quote().size.has_value());
+  assert (!opt_quote().has_value());
+  assert (opt_quote(Quote()).value().size.value() == 100);
+
+  std::vector<opt_order> book(3);
+  book[1] = opt_order(o);
+  assert (!book[0].has_value() && book[1].value().id.value() == 7 && !book[2].has_value());
+}
+
+void test_comparisons()
+{
+  typedef markable<mark_int<int, -1>> opt_int;
+  [[maybe_unused]] typedef markable<mark_fp_nan<double>> opt_double;
+  [[maybe_unused]] typedef markable<mark_stl_empty<std::string>> opt_string;
+
+  assert (opt_int(1) == opt_int(1));
+  assert (opt_int(1) != opt_int(2));
+  assert (opt_int() == opt_int());
+  assert (opt_int() != opt_int(1));
+  assert (opt_double() == opt_double()); // unlike NaN == NaN
+  assert (opt_string("a") == opt_string("a"));
+
+  assert (opt_int() < opt_int(-5));
+  assert (opt_int(1) < opt_int(2));
+  assert (!(opt_int() < opt_int()));
+  assert (opt_double() < opt_double(-1e300));
+  assert ((opt_double(1.0) <=> opt_double(1.0)) == std::partial_ordering::equivalent);
+  assert (opt_string() < opt_string("a") && opt_string("a") < opt_string("b"));
+
+  assert (markable_less<null_order::last>{}(opt_int(5), opt_int()));
+  assert (!markable_less<null_order::last>{}(opt_int(), opt_int(5)));
+  assert (markable_less<null_order::last>{}(opt_int(1), opt_int(2)));
+  assert (markable_compare<null_order::last>{}(opt_int(), opt_int()) == 0);
+
+  std::vector<opt_int> v {opt_int(3), opt_int(), opt_int(1), opt_int(), opt_int(2)};
+  std::sort(v.begin(), v.end());
+  assert ((v == std::vector<opt_int>{opt_int(), opt_int(), opt_int(1), opt_int(2), opt_int(3)}));
+  std::sort(v.begin(), v.end(), markable_less<null_order::last>{});
+  assert ((v == std::vector<opt_int>{opt_int(1), opt_int(2), opt_int(3), opt_int(), opt_int()}));
+
+  static_assert(opt_int(1) < opt_int(2), "");
+}
+
 int main()
 {
   test_value_ctor();
@@ -612,6 +1160,9 @@ int main()
   test_bool_storage();
   test_storage_value();
   test_mark_fp_nan();
+  test_mark_fp_nan_payload();
+  test_mark_sign_bit();
+  test_mark_int_range();
   test_mark_value_init();
   test_mark_stl_empty();
   test_mark_enum();
@@ -622,6 +1173,16 @@ int main()
 
   test_mark_dual_storage_1();
   test_mark_dual_storage_2();
+  test_dual_storage_trivially_copyable();
+  test_nothrow_and_relocation_traits();
+  test_uninitialized_relocate();
+  test_marked_fill();
+  test_constexpr_dual_storage();
+  test_monadic_operations();
+  test_mark_pointer();
+  test_mark_unique_ptr();
+  test_mark_member();
+  test_comparisons();
 /*  test_dual_storage_with_tuple_default_and_move_ctor();
   test_dual_storage_with_tuple_copy_ctor();
   test_dual_storage_with_tuple_init_state_mutation();
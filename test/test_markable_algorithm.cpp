@@ -0,0 +1,353 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_algorithm.hpp"
+#include "test_support.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace ak_toolkit;
+namespace detail_ = ak_toolkit::markable_ns::detail_;
+
+template <typename MP>
+bool same_element(const markable<MP>& a, const markable<MP>& b)
+{
+  if (!a.has_value() || !b.has_value()) // marked elements of ranges of values differ in their bits
+    return a.has_value() == b.has_value();
+  if constexpr (std::is_trivially_copyable<markable<MP>>::value)
+    return std::memcmp(&a, &b, sizeof(a)) == 0; // NaN values compare by their bits
+  else
+    return a.value() == b.value();
+}
+
+template <typename MP>
+void check_compaction(const std::vector<markable<MP>>& v, std::size_t count)
+{
+  typedef typename MP::value_type value_type;
+  const std::uint32_t guard = 0xDEADBEEF;
+  std::vector<std::uint32_t> expected_idx;
+  for (std::size_t i = 0; i != v.size(); ++i)
+    if (v[i].has_value())
+      expected_idx.push_back(std::uint32_t(i));
+
+  for (simd_isa isa : testable_isas())
+  {
+    std::unique_ptr<value_type[]> out(new value_type[count + 1]);
+    std::vector<std::uint32_t> idx(count + 1, guard);
+    [[maybe_unused]] std::size_t written = detail_::compact_present<MP, true>(isa, v.data(), v.size(), out.get(), idx.data());
+    assert (written == count);
+    assert (std::equal(expected_idx.begin(), expected_idx.end(), idx.begin()));
+    assert (idx[count] == guard); // no write past the output
+    for (std::size_t k = 0; k != count; ++k)
+      assert (same_element(markable<MP>(out[k]), v[idx[k]]));
+
+    std::unique_ptr<value_type[]> values_only(new value_type[count + 1]);
+    written = detail_::compact_present<MP, false>(isa, v.data(), v.size(), values_only.get(), nullptr);
+    assert (written == count);
+    for (std::size_t k = 0; k != count; ++k)
+      assert (same_element(markable<MP>(values_only[k]), markable<MP>(out[k])));
+  }
+
+  std::unique_ptr<value_type[]> out(new value_type[count]);
+  std::vector<std::uint32_t> idx(count);
+  [[maybe_unused]] std::size_t written = compact_present(v, out.get(), idx.data());
+  assert (written == count);
+
+  std::vector<markable<MP>> back(v.size(), v.empty() || count == 0 ? markable<MP>() : markable<MP>(out[0]));
+  expand_present(back, out.get(), idx.data(), count);
+  for (std::size_t i = 0; i != v.size(); ++i)
+    assert (same_element(back[i], v[i]));
+}
+
+template <typename MP>
+void check_scans(const std::vector<markable<MP>>& v)
+{
+  std::size_t count = 0, first = v.size();
+  std::vector<std::uint8_t> bitmap((v.size() + 7) / 8);
+  for (std::size_t i = 0; i != v.size(); ++i)
+    if (v[i].has_value())
+    {
+      ++count;
+      if (first == v.size())
+        first = i;
+      bitmap[i / 8] |= std::uint8_t(1u << (i % 8));
+    }
+
+  for (simd_isa isa : testable_isas())
+  {
+    assert (detail_::count_present(isa, v.data(), v.size()) == count);
+    assert (detail_::find_first_present(isa, v.data(), v.size()) == first);
+
+    std::vector<std::uint8_t> out(bitmap.size() + 1, 0xAA);
+    detail_::presence_bitmap(isa, v.data(), v.size(), out.data());
+    assert (std::equal(bitmap.begin(), bitmap.end(), out.begin()));
+    assert (out.back() == 0xAA); // no write past the bitmap
+  }
+
+  assert (count_present(v) == count);
+  assert (find_first_present(v) == first);
+  check_compaction(v, count);
+}
+
+template <typename MP, typename Gen>
+void test_scans_for(Gen gen)
+{
+  for (double density : {0.0, 0.01, 0.5, 0.99, 1.0})
+    for (std::size_t n : {0, 1, 2, 3, 7, 8, 15, 16, 31, 33, 63, 64, 65, 127, 200, 1000})
+      check_scans(random_markables<MP>(rng, n, density, gen));
+}
+
+enum class Color : int { red, green, blue };
+
+struct mark_string_empty : markable_type<std::string>
+{
+  static std::string marked_value() { return std::string(); }
+  static bool is_marked_value(const std::string& v) { return v.empty(); }
+};
+
+void test_bulk_traits()
+{
+  static_assert (detail_::bulk_traits<mark_int<int, -1>>::vectorizable, "");
+  static_assert (detail_::bulk_traits<mark_int<std::int8_t, 0>>::vectorizable, "");
+  static_assert (detail_::bulk_traits<mark_fp_nan<double>>::vectorizable, "");
+  static_assert (detail_::bulk_traits<mark_bool>::vectorizable, "");
+  static_assert (detail_::bulk_traits<mark_enum<Color, -1>>::vectorizable, "");
+  static_assert (detail_::bulk_traits<mark_sign_bit<std::int16_t>>::vectorizable, "");
+  static_assert (detail_::bulk_traits<mark_int_range<std::uint32_t, 0xFFFFFF00u, 0xFFFFFFFFu>>::vectorizable, "");
+  static_assert (!detail_::bulk_traits<mark_fp_nan<long double>>::vectorizable, "");
+  static_assert (!detail_::bulk_traits<mark_value_init<int>>::vectorizable, "");
+  static_assert (!detail_::bulk_traits<mark_string_empty>::vectorizable, "");
+}
+
+void test_scans_int()
+{
+  std::uniform_int_distribution<int> d(-3, 3);
+  test_scans_for<mark_int<std::int8_t, -1>>([&]{ return std::int8_t(d(rng)); });
+  test_scans_for<mark_int<std::int16_t, 0>>([&]{ return std::int16_t(d(rng)); });
+  test_scans_for<mark_int<std::int32_t, std::numeric_limits<std::int32_t>::min()>>([&]{ return std::int32_t(d(rng)); });
+  test_scans_for<mark_int<std::int64_t, -1>>([&]{ return std::int64_t(d(rng)) << 32; });
+  test_scans_for<mark_int<std::uint64_t, 0>>([&]{ return std::uint64_t(d(rng)) << 32; });
+}
+
+// Values near the bounds of [lo, hi] (wrapping around) and anywhere else: elements with values in the range are marked.
+template <typename T>
+auto near_bounds(T lo, T hi)
+{
+  typedef typename std::make_unsigned<T>::type U;
+  return [=]{
+    switch (rng() % 4)
+    {
+      case 0:  return T(U(U(lo) + U(rng() % 3) - 1u));
+      case 1:  return T(U(U(hi) + U(rng() % 3) - 1u));
+      case 2:  return T(rng() % 2 ? std::numeric_limits<T>::min() : std::numeric_limits<T>::max());
+      default: return T(rng());
+    }
+  };
+}
+
+// every negative value is marked, not only marked_value()
+void test_scans_sign_bit()
+{
+  test_scans_for<mark_sign_bit<std::int8_t>>(near_bounds<std::int8_t>(-128, 0));
+  test_scans_for<mark_sign_bit<std::int16_t>>(near_bounds<std::int16_t>(-32768, 0));
+  test_scans_for<mark_sign_bit<std::int32_t>>(near_bounds<std::int32_t>(-1, 0));
+  test_scans_for<mark_sign_bit<std::int64_t>>(near_bounds<std::int64_t>(std::numeric_limits<std::int64_t>::min(), 0));
+}
+
+void test_scans_int_range()
+{
+  test_scans_for<mark_int_range<std::int8_t, -2, 3>>(near_bounds<std::int8_t>(-2, 3));
+  test_scans_for<mark_int_range<std::uint8_t, 200, 255>>(near_bounds<std::uint8_t>(200, 255));
+  test_scans_for<mark_int_range<std::int16_t, -32768, -100>>(near_bounds<std::int16_t>(-32768, -100));
+  test_scans_for<mark_int_range<std::uint16_t, 0, 0>>(near_bounds<std::uint16_t>(0, 0));
+  test_scans_for<mark_int_range<std::uint32_t, 0xFFFFFF00u, 0xFFFFFFFFu>>(near_bounds<std::uint32_t>(0xFFFFFF00u, 0xFFFFFFFFu));
+  test_scans_for<mark_int_range<std::int32_t, -5, 70000>>(near_bounds<std::int32_t>(-5, 70000));
+  test_scans_for<mark_int_range<std::int64_t, -1, 1>>(near_bounds<std::int64_t>(-1, 1));
+  test_scans_for<mark_int_range<std::uint64_t, 1ull << 63, (1ull << 63) + 9>>(near_bounds<std::uint64_t>(1ull << 63, (1ull << 63) + 9));
+}
+
+void test_scans_fp_nan()
+{
+  // values contain only non-NaNs, but the marked slots get NaNs with various bit patterns
+  std::uniform_int_distribution<int> d(-3, 3);
+  std::vector<double> specials {0.0, -0.0, std::numeric_limits<double>::infinity(),
+                                -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::denorm_min()};
+  test_scans_for<mark_fp_nan<double>>([&]{ return d(rng) == 0 ? specials[rng() % specials.size()] : d(rng) * 0.5; });
+  test_scans_for<mark_fp_nan<float>>([&]{ return d(rng) == 0 ? -std::numeric_limits<float>::infinity() : d(rng) * 0.5f; });
+
+  std::vector<markable<mark_fp_nan<double>>> v(70, markable<mark_fp_nan<double>>(1.0));
+  v[5]  = markable<mark_fp_nan<double>>(-std::numeric_limits<double>::quiet_NaN());
+  v[40] = markable<mark_fp_nan<double>>(std::numeric_limits<double>::signaling_NaN());
+  v[69] = markable<mark_fp_nan<double>>(std::bit_cast<double>(std::uint64_t(0x7FF0000000000001)));
+  check_scans(v);
+  assert (count_present(v) == 67);
+}
+
+// computed NaNs are values, and only the marked bit pattern is marked
+void test_fp_nan_payload()
+{
+  typedef mark_fp_nan_payload<double, 7> policy;
+  typedef mark_fp_nan_payload<float, 7> float_policy;
+  static_assert (detail_::bulk_traits<policy>::vectorizable, "");
+  std::uniform_int_distribution<int> d(-3, 3);
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  test_scans_for<policy>([&]{ return d(rng) == 0 ? (rng() & 1 ? nan : -nan) : d(rng) * 0.5; });
+  test_scans_for<float_policy>([&]{ return d(rng) == 0 ? std::numeric_limits<float>::quiet_NaN() : d(rng) * 0.5f; });
+
+  for (std::size_t n : {0, 1, 9, 64, 100, 1000})
+    for (double density : {0.0, 0.1, 0.9})
+    {
+      std::vector<markable<policy>> v = random_markables<policy>(rng, n, density, [&]{ return d(rng) == 0 ? nan : 1.0; });
+      nan_counts expected;
+      std::size_t first = n;
+      for (std::size_t i = 0; i != n; ++i)
+        if (!v[i].has_value())
+          ++expected.marked;
+        else if (std::isnan(v[i].value()))
+        {
+          ++expected.computed;
+          first = std::min(first, i);
+        }
+      [[maybe_unused]] nan_counts c = count_nans(v);
+      assert (c.marked == expected.marked && c.computed == expected.computed);
+      assert (find_first_computed_nan(v) == first);
+      assert (c.marked + count_present(v) == n);
+    }
+}
+
+void test_scans_bool_enum()
+{
+  test_scans_for<mark_bool>([&]{ return bool(rng() & 1); });
+  test_scans_for<mark_enum<Color, -1>>([&]{ return Color(rng() % 3); });
+}
+
+void test_scans_generic_policy()
+{
+  test_scans_for<mark_string_empty>([&]{ return std::string(1 + rng() % 3, 'a'); });
+  test_scans_for<mark_value_init<int>>([&]{ return int(1 + rng() % 3); });
+}
+
+void test_monadic_each()
+{
+  typedef mark_int<int, -1> int_policy;
+  typedef mark_fp_nan<double> double_policy;
+  std::vector<markable<int_policy>> v = random_markables<int_policy>(rng, 1000, 0.3, [&]{ return int(rng() % 1000); });
+
+  std::vector<int> values(v.size());
+  value_or_each(v, 42, values.data());
+  std::vector<markable<double_policy>> halves(v.size());
+  transform_each<double_policy>(v, halves.data(), [](int i) { return i / 2.0; });
+  std::vector<markable<int_policy>> evens(v.size()), filled(v.size());
+  and_then_each(v, evens.data(), [](int i) { return i % 2 ? markable<int_policy>() : markable<int_policy>(i); });
+  or_else_each(v, filled.data(), [] { return markable<int_policy>(0); });
+
+  for (std::size_t i = 0; i != v.size(); ++i)
+  {
+    assert (values[i] == v[i].value_or(42));
+    assert (halves[i].has_value() == v[i].has_value());
+    assert (!v[i].has_value() || halves[i].value() == v[i].value() / 2.0);
+    assert (evens[i].has_value() == (v[i].has_value() && v[i].value() % 2 == 0));
+    assert (filled[i].value() == v[i].value_or(0));
+  }
+
+  // f is never invoked with the mark
+  typedef mark_int<int, std::numeric_limits<int>::min()> min_policy;
+  std::vector<markable<min_policy>> w = random_markables<min_policy>(rng, 100, 0.5, [&]{ return int(rng() % 1000) - 500; });
+  std::vector<markable<min_policy>> negated(w.size());
+  transform_each(w, negated.data(), [](int x) {
+    if (x == std::numeric_limits<int>::min())
+      std::abort(); // -x would overflow
+    return -x;
+  });
+  for (std::size_t i = 0; i != w.size(); ++i)
+    assert (negated[i].has_value() ? negated[i].value() == -w[i].value() : !w[i].has_value());
+
+  int ints[] = {1, 2, 3};
+  typedef markable<mark_pointer<int>> opt_ptr;
+  std::vector<opt_ptr> p {opt_ptr(&ints[0]), opt_ptr(), opt_ptr(&ints[2]), opt_ptr()};
+  std::vector<markable<int_policy>> pointees(p.size());
+  transform_each<int_policy>(p, pointees.data(), [](int* q) { return *q; }); // would crash on the null mark
+  assert (pointees[0].value() == 1 && !pointees[1].has_value() && pointees[2].value() == 3 && !pointees[3].has_value());
+
+  typedef markable<mark_string_empty> opt_string;
+  std::vector<opt_string> s {opt_string("a"), opt_string(), opt_string("bc")};
+  std::vector<std::string> strings(s.size());
+  value_or_each(s, "-", strings.data());
+  assert ((strings == std::vector<std::string>{"a", "-", "bc"}));
+  std::vector<opt_string> doubled(s.size());
+  transform_each(s, doubled.data(), [](const std::string& x) { return x + x; });
+  assert (doubled[0].value() == "aa" && !doubled[1].has_value() && doubled[2].value() == "bcbc");
+}
+
+template <typename R>
+concept radix_sortable = requires (R& r) { radix_sort(r); };
+
+template <typename MP, typename Gen>
+void test_radix_sort_for(Gen gen)
+{
+  for (std::size_t n : {0, 1, 2, 255, 256, 5000})
+    for (double null_density : {0.0, 0.2, 1.0})
+      for (null_order order : {null_order::first, null_order::last})
+      {
+        std::vector<markable<MP>> v = random_markables<MP>(rng, n, null_density, gen), expected = v;
+        if (order == null_order::first)
+          std::sort(expected.begin(), expected.end(), markable_less<null_order::first>{});
+        else
+          std::sort(expected.begin(), expected.end(), markable_less<null_order::last>{});
+        radix_sort(v, order);
+        assert (v == expected);
+      }
+}
+
+void test_radix_sort()
+{
+  test_radix_sort_for<mark_int<int, -1>>([&]{ return int(rng()); });
+  test_radix_sort_for<mark_int<int, 0>>([&]{ return int(rng() % 7) - 3 + (rng() % 7 == 0); });
+  test_radix_sort_for<mark_int<std::int64_t, 0>>([&]{ return std::int64_t(rng() | 1); });
+  test_radix_sort_for<mark_int<std::uint8_t, 255>>([&]{ return std::uint8_t(rng() % 255); });
+  test_radix_sort_for<mark_int<std::uint64_t, 0>>([&]{ return std::uint64_t(1 + rng() % 1000); }); // equal high bytes
+  test_radix_sort_for<mark_int<short, -1>>([&]{ return short(rng() % 1000); });
+  test_radix_sort_for<mark_enum<Color, -1>>([&]{ return Color(rng() % 3); });
+  test_radix_sort_for<mark_bool>([&]{ return bool(rng() % 2); });
+
+  std::uniform_real_distribution<double> real(-1e6, 1e6);
+  test_radix_sort_for<mark_fp_nan<double>>([&]{
+    switch (rng() % 8) {
+      case 0: return 0.0;
+      case 1: return std::numeric_limits<double>::infinity();
+      case 2: return -std::numeric_limits<double>::infinity();
+      case 3: return -std::numeric_limits<double>::denorm_min();
+      default: return real(rng);
+    }
+  });
+  test_radix_sort_for<mark_fp_nan<float>>([&]{ return float(real(rng)); });
+
+  static_assert(radix_sortable<std::vector<markable<mark_int<int, -1>>>>, "");
+  static_assert(!radix_sortable<std::vector<markable<mark_string_empty>>>, "");
+}
+
+int main()
+{
+  test_bulk_traits();
+  test_scans_int();
+  test_scans_sign_bit();
+  test_scans_int_range();
+  test_scans_fp_nan();
+  test_fp_nan_payload();
+  test_scans_bool_enum();
+  test_scans_generic_policy();
+  test_monadic_each();
+  test_radix_sort();
+}
@@ -0,0 +1,160 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_arrow.hpp"
+#include "test_support.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace ak_toolkit;
+namespace detail_ = ak_toolkit::markable_ns::detail_;
+
+bool bit(const std::vector<std::uint8_t>& bitmap, std::size_t i)
+{
+  return (bitmap[i / 8] >> (i % 8)) & 1u;
+}
+
+template <typename MP>
+bool same_state(const markable<MP>& l, const markable<MP>& r)
+{
+  return l.has_value() == r.has_value() && (!l.has_value() || l.value() == r.value());
+}
+
+template <typename MP, typename Gen>
+void test_round_trip(Gen gen)
+{
+  typedef markable<MP> opt;
+  typedef typename MP::storage_type storage_type;
+
+  for (double density : {0.0, 0.05, 0.5, 0.95, 1.0})
+    for (std::size_t n : {0, 1, 5, 8, 17, 64, 100, 1000})
+    {
+      std::bernoulli_distribution is_null(density);
+      std::vector<opt> src;
+      for (std::size_t i = 0; i != n; ++i)
+        if (is_null(rng)) src.emplace_back(); else src.emplace_back(gen());
+
+      // export: zero-copy values, computed bitmap
+      std::span<const storage_type> values = arrow_values(src);
+      assert (static_cast<const void*>(values.data()) == static_cast<const void*>(src.data()));
+      assert (values.size() == n);
+
+      std::vector<std::uint8_t> validity((n + 7) / 8);
+      [[maybe_unused]] std::size_t nulls = arrow_validity(src, validity.data());
+      std::size_t expected_nulls = 0;
+      for (std::size_t i = 0; i != n; ++i)
+      {
+        expected_nulls += !src[i].has_value();
+        assert (bit(validity, i) == src[i].has_value());
+        if (src[i].has_value())
+          assert (values[i] == src[i].storage_value());
+      }
+      assert (nulls == expected_nulls);
+
+      // Arrow producers leave arbitrary garbage in null slots
+      std::vector<storage_type> arrow_buffer(values.begin(), values.end());
+      for (std::size_t i = 0; i != n; ++i)
+        if (!bit(validity, i))
+          std::memset(&arrow_buffer[i], 0x5A, sizeof(storage_type));
+
+      for (simd_isa isa : testable_isas())
+      {
+        std::vector<opt> dst(n, opt(gen()));
+        detail_::import_arrow(isa, arrow_buffer.data(), validity.data(), dst.data(), n);
+        for (std::size_t i = 0; i != n; ++i)
+          assert (same_state(dst[i], src[i]));
+
+        // in place
+        std::vector<opt> in_place(n);
+        if (n != 0) // the buffers may be null then
+          std::memcpy(static_cast<void*>(in_place.data()), arrow_buffer.data(), n * sizeof(storage_type));
+        detail_::import_arrow(isa, arrow_values(in_place).data(), validity.data(), in_place.data(), n);
+        for (std::size_t i = 0; i != n; ++i)
+          assert (same_state(in_place[i], src[i]));
+      }
+
+      std::vector<opt> dst(n);
+      import_arrow(arrow_buffer.data(), nullptr, dst);
+      for (std::size_t i = 0; i != n; ++i)
+        assert (bit(validity, i) ? same_state(dst[i], src[i]) : dst[i].storage_value() == arrow_buffer[i]);
+      import_arrow_validity(validity.data(), dst);
+      for (std::size_t i = 0; i != n; ++i)
+        assert (same_state(dst[i], src[i]));
+    }
+}
+
+enum class Side { buy, sell };
+
+void test_round_trips()
+{
+  std::uniform_int_distribution<int> d(-100, 100);
+  test_round_trip<mark_int<std::int8_t, -128>>([&]{ return std::int8_t(d(rng)); });
+  test_round_trip<mark_int<std::uint16_t, 0xFFFF>>([&]{ return std::uint16_t(d(rng) + 100); });
+  test_round_trip<mark_int<std::int32_t, -1>>([&]{ return std::int32_t(d(rng)) * 1000; });
+  test_round_trip<mark_int<std::int64_t, -1>>([&]{ return std::int64_t(d(rng)) << 40; });
+  test_round_trip<mark_fp_nan<float>>([&]{ return d(rng) * 0.25f; });
+  test_round_trip<mark_fp_nan<double>>([&]{ return d(rng) * 0.25; });
+  test_round_trip<mark_enum<Side, -1>>([&]{ return Side(rng() % 2); });
+}
+
+void test_bool_round_trip()
+{
+  typedef markable<mark_bool> opt_bool;
+  for (double density : {0.0, 0.3, 1.0})
+    for (std::size_t n : {0, 3, 64, 65, 300})
+    {
+      std::bernoulli_distribution is_null(density);
+      std::vector<opt_bool> src;
+      for (std::size_t i = 0; i != n; ++i)
+        if (is_null(rng)) src.emplace_back(); else src.emplace_back(bool(rng() & 1));
+
+      std::vector<std::uint8_t> values((n + 7) / 8), validity((n + 7) / 8);
+      arrow_validity(src, validity.data());
+      for (simd_isa isa : testable_isas())
+      {
+        std::fill(values.begin(), values.end(), 0xFF);
+        detail_::export_arrow_bool(isa, src.data(), n, values.data());
+        for (std::size_t i = 0; i != n; ++i)
+          assert (bit(values, i) == (src[i].has_value() && src[i].value()));
+      }
+
+      std::vector<opt_bool> dst(n, opt_bool(true));
+      import_arrow_bool(values.data(), validity.data(), dst);
+      for (std::size_t i = 0; i != n; ++i)
+        assert (same_state(dst[i], src[i]));
+    }
+}
+
+// a valid value equal to the marked value cannot be told from a null: it is imported as one
+void test_valid_marked_value()
+{
+  typedef markable<mark_int<int, -1>> opt_int;
+  const int values[3] = {5, -1, 7};
+  const std::uint8_t validity[1] = {0x7}; // all valid
+  std::vector<opt_int> out(3, opt_int(0));
+  import_arrow(values, validity, out);
+  assert (out[0].has_value() && out[0].value() == 5);
+  assert (!out[1].has_value());
+  assert (out[2].has_value() && out[2].value() == 7);
+
+  typedef markable<mark_fp_nan<double>> opt_double;
+  const double doubles[2] = {1.5, std::numeric_limits<double>::quiet_NaN()};
+  std::vector<opt_double> out_doubles(2);
+  import_arrow(doubles, nullptr, out_doubles);
+  assert (out_doubles[0].has_value() && !out_doubles[1].has_value());
+}
+
+int main()
+{
+  test_round_trips();
+  test_bool_round_trip();
+  test_valid_marked_value();
+}
@@ -0,0 +1,185 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_atomic.hpp"
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace ak_toolkit;
+
+typedef markable<mark_int<int, -1>> opt_int;
+
+struct interval
+{
+  short first, last;
+};
+
+struct interval_representation
+{
+  short first, last;
+};
+
+struct mark_interval : markable_dual_storage_type<mark_interval, interval, interval_representation>
+{
+  static representation_type marked_value() AK_TOOLKIT_NOEXCEPT { return {0, -1}; }
+  static bool is_marked_value(const representation_type& v) { return v.first > v.last; }
+};
+
+static_assert(sizeof(atomic_markable<mark_int<int, -1>>) == sizeof(int), "");
+static_assert(atomic_markable<mark_fp_nan<double>>::is_always_lock_free, "");
+
+void test_single_thread()
+{
+  atomic_markable<mark_int<int, -1>> a;
+  assert (!a.has_value());
+  assert (!a.load().has_value());
+
+  a.store(opt_int(3));
+  assert (a.load() == opt_int(3));
+  [[maybe_unused]] opt_int old = a.exchange(opt_int());
+  assert (old == opt_int(3));
+  assert (!a.has_value());
+
+  [[maybe_unused]] bool set = a.try_set(5);
+  assert (set);
+  opt_int current;
+  set = a.try_set(6, current);
+  assert (!set);
+  assert (current == opt_int(5));
+  assert (a.load() == opt_int(5));
+
+  opt_int expected(4);
+  [[maybe_unused]] bool exchanged = a.compare_exchange_strong(expected, opt_int(8));
+  assert (!exchanged);
+  assert (expected == opt_int(5));
+  exchanged = a.compare_exchange_strong(expected, opt_int());
+  assert (exchanged);
+  assert (!a.has_value());
+  while (!a.compare_exchange_weak(expected = opt_int(), opt_int(9))) {}
+  assert (a.load() == opt_int(9));
+
+  atomic_markable<mark_int<int, -1>> b(7);
+  int calls = 0;
+  [[maybe_unused]] int v = b.get_or_compute([&] { ++calls; return 1; });
+  assert (v == 7);
+  assert (calls == 0);
+  v = b.wait_for_value();
+  assert (v == 7);
+}
+
+void test_fp_nan()
+{
+  atomic_markable<mark_fp_nan<double>> a;
+  assert (!a.has_value());
+  [[maybe_unused]] double v = a.get_or_compute([] { return 2.5; });
+  assert (v == 2.5);
+  v = a.get_or_compute([] { return 3.5; });
+  assert (v == 2.5);
+  markable<mark_fp_nan<double>> expected(2.5);
+  [[maybe_unused]] bool exchanged = a.compare_exchange_strong(expected, markable<mark_fp_nan<double>>());
+  assert (exchanged);
+  assert (std::isnan(a.load().storage_value()));
+  [[maybe_unused]] bool set = a.try_set(1.0);
+  assert (set);
+}
+
+void test_dual_storage()
+{
+  atomic_markable<mark_interval> a;
+  assert (!a.has_value());
+  [[maybe_unused]] bool set = a.try_set(interval{1, 2});
+  assert (set);
+  set = a.try_set(interval{3, 4});
+  assert (!set);
+  assert (a.load().value().first == 1);
+  [[maybe_unused]] interval v = a.get_or_compute([] { return interval{5, 6}; });
+  assert (v.last == 2);
+}
+
+void test_exception_publishes_nothing()
+{
+  atomic_markable<mark_int<int, -1>> a;
+  try
+  {
+    a.get_or_compute([]() -> int { throw 1; });
+    assert (false);
+  }
+  catch (int) {}
+  assert (!a.has_value());
+  [[maybe_unused]] int v = a.get_or_compute([] { return 2; });
+  assert (v == 2);
+}
+
+// Many threads race to initialize each slot with a thread-specific value: exactly one
+// value per slot must be published, and every thread must have observed that one.
+void test_get_or_compute_race()
+{
+  const int threads = 8, slots = 20011, rounds = 3; // prime, so that every visiting order below is a permutation
+  std::unique_ptr<atomic_markable<mark_int<int, -1>>[]> table(new atomic_markable<mark_int<int, -1>>[slots]);
+  std::vector<std::vector<int>> seen(threads, std::vector<int>(slots * rounds));
+  std::atomic<int> computed(0);
+  std::atomic<bool> go(false);
+
+  std::vector<std::thread> pool;
+  for (int t = 0; t != threads; ++t)
+    pool.emplace_back([&, t] {
+      while (!go.load()) {}
+      for (int r = 0; r != rounds; ++r)
+        for (int s = 0; s != slots; ++s)
+        {
+          int i = (s * (t + 1) * 7919) % slots; // every thread visits the slots in another order
+          seen[t][r * slots + i] = table[i].get_or_compute([&] { computed.fetch_add(1); return i * threads + t; });
+        }
+    });
+  go.store(true);
+  for (std::thread& th : pool)
+    th.join();
+
+  assert (computed.load() >= slots);
+  for (int i = 0; i != slots; ++i)
+  {
+    [[maybe_unused]] opt_int published = table[i].load();
+    assert (published.has_value());
+    assert (published.value() / threads == i);
+    for (int t = 0; t != threads; ++t)
+      for (int r = 0; r != rounds; ++r)
+        assert (seen[t][r * slots + i] == published.value());
+  }
+}
+
+void test_wait_notify()
+{
+  atomic_markable<mark_int<int, -1>> a, b;
+  std::atomic<int> got(0);
+  std::vector<std::thread> waiters;
+  for (int t = 0; t != 4; ++t)
+    waiters.emplace_back([&] { got.fetch_add(a.wait_for_value()); });
+  std::thread publisher([&] { a.get_or_compute([] { return 10; }); });
+  publisher.join();
+  for (std::thread& th : waiters)
+    th.join();
+  assert (got.load() == 40);
+
+  std::thread waiter([&] { b.wait(opt_int()); assert (b.load() == opt_int(1)); });
+  b.store(opt_int(1));
+  b.notify_one();
+  waiter.join();
+}
+
+int main()
+{
+  test_single_thread();
+  test_fp_nan();
+  test_dual_storage();
+  test_exception_publishes_nothing();
+  test_get_or_compute_race();
+  test_wait_notify();
+}
@@ -0,0 +1,126 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_bool_vector.hpp"
+#include "test_support.hpp"
+#include <cassert>
+#include <random>
+#include <vector>
+
+using namespace ak_toolkit;
+
+typedef markable<mark_bool> opt_bool;
+
+opt_bool random_opt_bool()
+{
+  switch (rng() % 3)
+  {
+  case 0: return opt_bool(false);
+  case 1: return opt_bool(true);
+  default: return opt_bool();
+  }
+}
+
+bool same(const opt_bool& l, const opt_bool& r)
+{
+  return l.has_value() == r.has_value() && (!l.has_value() || l.value() == r.value());
+}
+
+opt_bool kleene_and(const opt_bool& a, const opt_bool& b)
+{
+  if ((a.has_value() && !a.value()) || (b.has_value() && !b.value()))
+    return opt_bool(false);
+  if (a.has_value() && b.has_value())
+    return opt_bool(true);
+  return opt_bool();
+}
+
+opt_bool kleene_or(const opt_bool& a, const opt_bool& b)
+{
+  if ((a.has_value() && a.value()) || (b.has_value() && b.value()))
+    return opt_bool(true);
+  if (a.has_value() && b.has_value())
+    return opt_bool(false);
+  return opt_bool();
+}
+
+void test_element_access()
+{
+  markable_bool_vector v(3);
+  assert (v.size() == 3);
+  assert (!v[0].has_value() && !v[2].has_value());
+
+  v[0] = opt_bool(true);
+  v[1].assign(false);
+  assert (v[0].has_value() && v[0].value());
+  assert (v[1].has_value() && !v[1].value());
+  assert (v[2].value_or(true));
+
+  v[2] = v[0];
+  assert (v[2].value());
+  v[0].reset();
+  assert (!v[0].has_value() && v[2].value());
+
+  [[maybe_unused]] opt_bool b = v[1];
+  assert (same(b, opt_bool(false)));
+
+  [[maybe_unused]] const markable_bool_vector& cv = v;
+  assert (same(cv[2], opt_bool(true)));
+}
+
+void test_against_reference(std::size_t n)
+{
+  std::vector<opt_bool> ra, rb;
+  markable_bool_vector a, b;
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    ra.push_back(random_opt_bool());
+    rb.push_back(random_opt_bool());
+    a.push_back(ra.back());
+    b.push_back(rb.back());
+  }
+  assert (a.size() == n && a.word_count() == (n + 63) / 64);
+
+  std::size_t t = 0, f = 0, u = 0;
+  for (const opt_bool& e : ra)
+    (!e.has_value() ? u : e.value() ? t : f) += 1;
+  assert (a.count_true() == t && a.count_false() == f && a.count_unset() == u);
+
+  markable_bool_vector c = kleene_and(a, b), d = kleene_or(a, b), e = kleene_not(a);
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    assert (same(a[i], ra[i]));
+    assert (same(c[i], kleene_and(ra[i], rb[i])));
+    assert (same(d[i], kleene_or(ra[i], rb[i])));
+    assert (same(e[i], ra[i].has_value() ? opt_bool(!ra[i].value()) : opt_bool()));
+  }
+  assert (kleene_not(e) == a);
+}
+
+void test_resize()
+{
+  markable_bool_vector v(100, opt_bool(true));
+  assert (v.count_true() == 100);
+  v.resize(70);
+  assert (v.count_true() == 70 && v.count_unset() == 0);
+  v.resize(130, opt_bool(false));
+  assert (v.count_true() == 70 && v.count_false() == 60);
+  v.resize(200);
+  assert (v.count_unset() == 70);
+  assert (v[69].value() && !v[70].value() && !v[199].has_value());
+  v.clear();
+  assert (v.empty() && v.count_unset() == 0);
+}
+
+int main()
+{
+  test_element_access();
+  test_against_reference(0);
+  test_against_reference(1);
+  test_against_reference(64);
+  test_against_reference(1000);
+  test_resize();
+}
@@ -0,0 +1,77 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_column.hpp"
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+using namespace ak_toolkit;
+
+void test_column_basics()
+{
+  typedef markable_column<mark_int<std::int64_t, -1>> column;
+  static_assert (sizeof(column::element_type) == sizeof(std::int64_t), "size waste");
+
+  column c(3);
+  assert (c.size() == 3);
+  assert (c.count_present() == 0);
+  assert (c.find_first_present() == 3);
+
+  c.assign(1, 7);
+  assert (c.has_value(1));
+  assert (c.value(1) == 7);
+  assert (c.count_present() == 1);
+  assert (c.count_marked() == 2);
+  assert (c.find_first_present() == 1);
+  assert (c.find_first_present(2) == 3);
+
+  c.push_back_value(-1); // stored as the marked value
+  c.push_back_value(5);
+  c.push_back_marked();
+  assert (c.size() == 6);
+  assert (!c.has_value(3));
+  assert (c.count_present() == 2);
+  assert (c.find_first_present(2) == 4);
+
+  c.reset(1);
+  assert (!c.has_value(1));
+  assert (c.find_first_present() == 4);
+  assert (c.find_first_present(100) == 6);
+
+  c.reset_all();
+  assert (c.size() == 6 && c.count_present() == 0);
+}
+
+void test_column_bitmap()
+{
+  typedef markable_column<mark_fp_nan<double>> column;
+  column c;
+  for (int i = 0; i != 130; ++i)
+    if (i % 3 == 0)
+      c.push_back_value(i);
+    else
+      c.push_back_marked();
+
+  std::vector<std::uint8_t> bitmap = c.presence_bitmap();
+  assert (bitmap.size() == 17);
+  for (int i = 0; i != 130; ++i)
+    assert (bool(bitmap[i / 8] & (1u << (i % 8))) == (i % 3 == 0));
+
+  assert (c.count_present() == 44);
+  assert (c.find_first_present(1) == 3);
+
+  std::size_t count = 0;
+  for (const markable<mark_fp_nan<double>>& e : c)
+    count += e.has_value();
+  assert (count == c.count_present());
+}
+
+int main()
+{
+  test_column_basics();
+  test_column_bitmap();
+}
@@ -0,0 +1,173 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_concurrent_map.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace ak_toolkit;
+
+typedef mark_int<std::uint64_t, 0> id_policy;
+typedef mark_int<std::int64_t, -1> count_policy;
+
+struct bad_hash // every key collides: exercises long probe sequences and wrap-around
+{
+  std::size_t operator()(std::uint64_t) const { return 0; }
+};
+
+void test_set_basics()
+{
+  markable_concurrent_set<id_policy> s(100);
+  assert (s.capacity() >= 134);
+  assert (s.size() == 0);
+  assert (!s.contains(1));
+  [[maybe_unused]] bool inserted = s.insert(1);
+  assert (inserted);
+  inserted = s.insert(1);
+  assert (!inserted);
+  inserted = s.insert(2);
+  assert (inserted);
+  assert (s.contains(1) && s.contains(2) && !s.contains(3));
+  assert (s.size() == 2);
+
+  std::uint64_t sum = 0;
+  s.for_each([&](std::uint64_t k) { sum += k; });
+  assert (sum == 3);
+}
+
+void test_full()
+{
+  markable_concurrent_set<id_policy, bad_hash> s(1);
+  std::size_t c = s.capacity();
+  for (std::uint64_t k = 1; k <= c; ++k)
+  {
+    [[maybe_unused]] bool inserted = s.insert(k);
+    assert (inserted);
+  }
+  [[maybe_unused]] bool inserted = s.insert(c);
+  assert (!inserted);
+  assert (!s.contains(c + 1));
+  try
+  {
+    s.insert(c + 1);
+    assert (false);
+  }
+  catch (std::length_error&) {}
+}
+
+void test_map_basics()
+{
+  markable_concurrent_map<id_policy, count_policy> m(10);
+  assert (!m.find(1).has_value());
+  [[maybe_unused]] bool inserted = m.insert(1, 10);
+  assert (inserted);
+  inserted = m.insert(1, 11);
+  assert (!inserted);
+  assert (m.find(1) == markable<count_policy>(10));
+  m.insert_or_assign(1, 12);
+  m.insert_or_assign(2, 20);
+  assert (m.find(1) == markable<count_policy>(12));
+  [[maybe_unused]] std::int64_t v = m.get_or_compute(2, [] { return 0; });
+  assert (v == 20);
+  v = m.get_or_compute(3, [] { return 30; });
+  assert (v == 30);
+
+  [[maybe_unused]] atomic_markable<count_policy>& slot = m.value_slot(4);
+  assert (!slot.has_value());
+  assert (m.size() == 4 && m.contains(4) && !m.find(4).has_value());
+
+  std::int64_t sum = 0;
+  m.for_each([&](std::uint64_t, std::int64_t v) { sum += v; });
+  assert (sum == 62);
+}
+
+// Threads insert overlapping ranges of keys: every key must be reported as new by exactly
+// one thread, and the set must end up holding exactly the union.
+template <typename Hash>
+void test_concurrent_set(std::size_t keys_per_thread)
+{
+  const int threads = 8;
+  markable_concurrent_set<id_policy, Hash> s(keys_per_thread * threads);
+  std::vector<std::vector<std::uint64_t>> inserted(threads);
+  std::atomic<bool> go(false);
+
+  std::vector<std::thread> pool;
+  for (int t = 0; t != threads; ++t)
+    pool.emplace_back([&, t] {
+      std::mt19937_64 rng(t);
+      while (!go.load()) {}
+      for (std::size_t i = 0; i != keys_per_thread; ++i)
+      {
+        std::uint64_t k = 1 + rng() % (keys_per_thread * threads / 2); // about half are duplicates
+        if (s.insert(k))
+          inserted[t].push_back(k);
+        assert (s.contains(k));
+      }
+    });
+  go.store(true);
+  for (std::thread& th : pool)
+    th.join();
+
+  std::set<std::uint64_t> expected, reported;
+  for (int t = 0; t != threads; ++t)
+  {
+    std::mt19937_64 rng(t);
+    for (std::size_t i = 0; i != keys_per_thread; ++i)
+      expected.insert(1 + rng() % (keys_per_thread * threads / 2));
+    for (std::uint64_t k : inserted[t])
+    {
+      [[maybe_unused]] bool is_new = reported.insert(k).second;
+      assert (is_new); // no key is new twice
+    }
+  }
+  assert (reported == expected);
+  assert (s.size() == expected.size());
+  std::set<std::uint64_t> contents;
+  s.for_each([&](std::uint64_t k) { contents.insert(k); });
+  assert (contents == expected);
+}
+
+// Threads count occurrences of keys in a shared map with compare-exchange loops on the value slots.
+void test_concurrent_map()
+{
+  const int threads = 8, ops = 20000, key_range = 1000;
+  markable_concurrent_map<id_policy, count_policy> m(key_range);
+  std::vector<std::thread> pool;
+  for (int t = 0; t != threads; ++t)
+    pool.emplace_back([&, t] {
+      for (int i = 0; i != ops; ++i)
+      {
+        std::uint64_t k = 1 + (std::uint64_t(i) * (t + 1)) % key_range;
+        atomic_markable<count_policy>& slot = m.value_slot(k);
+        markable<count_policy> old = slot.load(std::memory_order_relaxed);
+        while (!slot.compare_exchange_weak(old, markable<count_policy>(old.has_value() ? old.value() + 1 : 1),
+                                           std::memory_order_relaxed)) {}
+      }
+    });
+  for (std::thread& th : pool)
+    th.join();
+
+  std::int64_t total = 0;
+  m.for_each([&](std::uint64_t, std::int64_t v) { total += v; });
+  assert (total == std::int64_t(threads) * ops);
+  assert (m.size() == std::size_t(key_range));
+}
+
+int main()
+{
+  test_set_basics();
+  test_full();
+  test_map_basics();
+  test_concurrent_set<std::hash<std::uint64_t>>(20000);
+  test_concurrent_set<bad_hash>(300);
+  test_concurrent_map();
+}
@@ -0,0 +1,176 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_expected.hpp"
+#include "test_support.hpp"
+#include <cassert>
+#include <cstdint>
+#include <random>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+using namespace ak_toolkit;
+namespace detail_ = ak_toolkit::markable_ns::detail_;
+
+enum class parse_error : std::uint8_t { empty, not_a_number, overflow, not_applicable };
+
+typedef markable_expected<std::uint32_t, parse_error> parsed_u32;
+
+static_assert(sizeof(parsed_u32) == sizeof(std::uint32_t), "");
+static_assert(sizeof(markable_expected<std::int64_t, std::errc>) == sizeof(std::int64_t), "");
+static_assert(std::is_trivially_copyable<parsed_u32>::value, "");
+static_assert(parsed_u32::first_error_value == 0xFFFFFF00u, "");
+static_assert(markable_expected<std::int8_t, int, 127>::first_error_value == 1, "");
+static_assert(markable_expected<std::uint8_t, parse_error>::error_count == 128, "half of the values of a byte");
+static_assert(markable_expected<std::int8_t, parse_error>::error_count == 64, "half of the non-negative values");
+static_assert(markable_expected<std::int8_t, parse_error>::first_error_value == 64, "");
+static_assert(markable_expected<std::uint8_t, parse_error>::first_error_value == 128, "");
+
+parsed_u32 parse(std::string_view s)
+{
+  if (s.empty())
+    return markable_unexpected(parse_error::empty);
+  if (s == "-")
+    return markable_unexpected(parse_error::not_applicable);
+  std::uint64_t v = 0;
+  for (char c : s)
+  {
+    if (c < '0' || c > '9')
+      return markable_unexpected(parse_error::not_a_number);
+    v = v * 10 + unsigned(c - '0');
+    if (v >= parsed_u32::first_error_value) // the reserved values are out of range as well
+      return markable_unexpected(parse_error::overflow);
+  }
+  return std::uint32_t(v);
+}
+
+void test_basics()
+{
+  parsed_u32 d;
+  assert (d.has_value() && d.value() == 0);
+
+  [[maybe_unused]] parsed_u32 v = parse("1234"), e = parse("12x");
+  assert (v.has_value() && bool(v) && *v == 1234);
+  assert (!e.has_value() && !bool(e));
+  assert (e.error() == parse_error::not_a_number);
+  assert (e.value_or(7) == 7 && v.value_or(7) == 1234);
+  assert (v.error_or(parse_error::empty) == parse_error::empty);
+  assert (e.error_or(parse_error::empty) == parse_error::not_a_number);
+
+  assert (parse("").error() == parse_error::empty);
+  assert (parse("-").error() == parse_error::not_applicable);
+  assert (parse("4294967040").error() == parse_error::overflow);
+  assert (parse("4294967039").value() == 0xFFFFFEFFu);
+
+  assert (v == parsed_u32(1234));
+  assert (!(v == e));
+  assert (e == parsed_u32(markable_unexpected(parse_error::not_a_number)));
+  assert (!(e == parsed_u32(markable_unexpected(parse_error::overflow))));
+  assert (!e.as_markable().has_value());
+  assert (e.storage_value() == 0xFFFFFF01u);
+}
+
+void test_error_range()
+{
+  typedef markable_expected<int, std::errc> checked_int;
+  [[maybe_unused]] checked_int ok(-5), bad = markable_unexpected(std::errc::result_out_of_range);
+  assert (ok.value() == -5);
+  assert (bad.error() == std::errc::result_out_of_range);
+  assert (checked_int(std::numeric_limits<int>::max() - 256).has_value());
+
+  typedef markable_expected<std::uint8_t, parse_error> small;
+  [[maybe_unused]] small s, s_error = markable_unexpected(parse_error::overflow);
+  assert (s.has_value() && s.value() == 0);
+  assert (small(127).value() == 127);
+  assert (s_error.error() == parse_error::overflow && s_error.storage_value() == 130);
+
+  typedef markable_expected<std::int8_t, parse_error> small_signed;
+  [[maybe_unused]] small_signed t, t_error = markable_unexpected(parse_error::empty);
+  assert (t.has_value() && t.value() == 0);
+  assert (small_signed(std::int8_t(5)).value() == 5);
+  assert (small_signed(std::int8_t(-128)).value() == -128);
+  assert (small_signed(std::int8_t(63)).has_value());
+  assert (t_error.error() == parse_error::empty && t_error.storage_value() == 64);
+
+  [[maybe_unused]] typedef markable_expected<std::uint16_t, int, 1> one_error; // a single reserved value
+  assert (one_error(0xFFFE).has_value());
+  assert (one_error(markable_unexpected(0)).storage_value() == 0xFFFF);
+}
+
+void test_monadic()
+{
+  [[maybe_unused]] auto half = [](std::uint32_t x) -> parsed_u32 {
+    if (x % 2)
+      return markable_unexpected(parse_error::not_applicable);
+    return x / 2;
+  };
+  assert (parse("10").and_then(half).value() == 5);
+  assert (parse("11").and_then(half).error() == parse_error::not_applicable);
+  assert (parse("1x").and_then(half).error() == parse_error::not_a_number);
+
+  [[maybe_unused]] markable_expected<std::uint64_t, parse_error> wide = parse("7").transform([](std::uint32_t x) { return std::uint64_t(x) << 40; });
+  assert (wide.value() == std::uint64_t(7) << 40);
+  assert (parse("").transform([](std::uint32_t x) { return std::uint64_t(x); }).error() == parse_error::empty);
+
+  assert (parse("").or_else([](parse_error) { return parsed_u32(0); }).value() == 0);
+  assert (parse("3").or_else([](parse_error) { return parsed_u32(0); }).value() == 3);
+  assert (parse("x").or_else([](parse_error e) -> parsed_u32 { return markable_unexpected(e); }).error() == parse_error::not_a_number);
+
+  [[maybe_unused]] markable_expected<std::uint32_t, int> coded = parse("x").transform_error([](parse_error e) { return int(e) + 100; });
+  assert (coded.error() == 101);
+  assert (parse("9").transform_error([](parse_error e) { return int(e); }).value() == 9);
+}
+
+void test_count_errors()
+{
+  for (std::size_t n : {0, 1, 15, 16, 17, 63, 64, 65, 1000})
+  {
+    std::vector<parsed_u32> v(n);
+    error_counts<256> expected;
+    std::size_t first = n;
+    for (std::size_t i = 0; i != n; ++i)
+    {
+      if (rng() % 3 == 0)
+      {
+        parse_error e = parse_error(rng() % 4);
+        v[i] = markable_unexpected(e);
+        ++expected.errors[std::size_t(e)];
+        first = first == n ? i : first;
+      }
+      else
+      {
+        v[i] = rng() % 2 ? 0xFFFFFEFFu : rng() % 1000; // next to the reserved values
+        ++expected.values;
+      }
+    }
+
+    [[maybe_unused]] error_counts<256> c = count_errors(v);
+    assert (c.values == expected.values);
+    assert (c.errors == expected.errors);
+    assert (c[parse_error::overflow] == expected.errors[2]);
+    assert (find_first_error(v) == first);
+
+    for (simd_isa isa : testable_isas())
+    {
+      std::size_t errors = 0;
+      detail_::for_each_error(isa, v.data(), v.size(), [&]([[maybe_unused]] std::size_t i, [[maybe_unused]] parse_error e) {
+        assert (!v[i].has_value() && v[i].error() == e);
+        ++errors;
+        return true;
+      });
+      assert (errors == n - expected.values);
+    }
+  }
+}
+
+int main()
+{
+  test_basics();
+  test_error_range();
+  test_monadic();
+  test_count_errors();
+}
@@ -0,0 +1,250 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_flat_map.hpp"
+#include "test_support.hpp"
+#include <cassert>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace ak_toolkit;
+
+typedef mark_int_tombstone<std::uint64_t, 0, std::uint64_t(-1)> id_policy;
+
+struct bad_hash // every key collides: exercises probing across cache lines
+{
+  std::size_t operator()(std::uint64_t) const { return 0; }
+};
+
+void test_set_basics()
+{
+  markable_flat_set<id_policy> s;
+  assert (s.empty());
+  assert (!s.contains(1));
+  [[maybe_unused]] bool erased = s.erase(1);
+  assert (!erased);
+
+  [[maybe_unused]] bool inserted = s.insert(1);
+  assert (inserted);
+  inserted = s.insert(1);
+  assert (!inserted);
+  inserted = s.insert(2);
+  assert (inserted);
+  assert (s.size() == 2);
+  assert (s.contains(1) && s.contains(2) && !s.contains(3));
+
+  erased = s.erase(1);
+  assert (erased);
+  assert (!s.contains(1) && s.size() == 1);
+  inserted = s.insert(1);
+  assert (inserted);
+
+  markable_flat_set<id_policy> t = s;
+  s.clear();
+  assert (s.empty() && !s.contains(2));
+  assert (t.size() == 2 && t.contains(1) && t.contains(2));
+
+  std::uint64_t sum = 0;
+  t.for_each([&](std::uint64_t k) { sum += k; });
+  assert (sum == 3);
+}
+
+template <typename Hash>
+void test_against_reference(std::size_t key_range, int ops)
+{
+  markable_flat_map<id_policy, std::string, Hash> m;
+  std::unordered_map<std::uint64_t, std::string> ref;
+
+  for (int n = 0; n != ops; ++n)
+  {
+    std::uint64_t k = 1 + rng() % key_range;
+    switch (rng() % 4)
+    {
+    case 0:
+    case 1:
+    {
+      [[maybe_unused]] bool inserted = m.insert(k, std::to_string(n));
+      [[maybe_unused]] bool expected = ref.emplace(k, std::to_string(n)).second;
+      assert (inserted == expected);
+      break;
+    }
+    case 2:
+    {
+      [[maybe_unused]] bool erased = m.erase(k);
+      [[maybe_unused]] bool expected = ref.erase(k) == 1;
+      assert (erased == expected);
+      break;
+    }
+    case 3:
+    {
+      [[maybe_unused]] bool inserted = m.insert_or_assign(k, std::to_string(n));
+      assert (inserted == !ref.count(k));
+      ref[k] = std::to_string(n);
+      break;
+    }
+    }
+    assert (m.size() == ref.size());
+  }
+
+  for (std::uint64_t k = 1; k <= key_range; ++k)
+  {
+    const std::string* v = m.find(k);
+    [[maybe_unused]] auto it = ref.find(k);
+    assert ((v != nullptr) == (it != ref.end()));
+    if (v)
+      assert (*v == it->second);
+  }
+
+  std::size_t visited = 0;
+  m.for_each([&]([[maybe_unused]] std::uint64_t k, [[maybe_unused]] const std::string& v) { ++visited; assert (ref.at(k) == v); });
+  assert (visited == ref.size());
+}
+
+void test_map_access()
+{
+  markable_flat_map<id_policy, int> m(100);
+  [[maybe_unused]] std::size_t capacity = m.capacity();
+  assert (capacity >= 100);
+  for (std::uint64_t k = 1; k <= 100; ++k)
+    m[k] += int(k);
+  assert (m.capacity() == capacity); // reserved up front
+  assert (m.size() == 100 && *m.find(7) == 7);
+  [[maybe_unused]] bool inserted = m.try_emplace(7, 0);
+  assert (!inserted && m[7] == 7);
+
+  markable_flat_map<id_policy, int> n = std::move(m);
+  assert (n.size() == 100 && m.size() == 0 && !m.find(7));
+  m = n;
+  assert (m.size() == 100 && m[100] == 100);
+}
+
+void test_tombstones_do_not_accumulate()
+{
+  markable_flat_set<id_policy> s;
+  for (std::uint64_t k = 1; k <= 1000; ++k)
+    s.insert(k);
+  [[maybe_unused]] std::size_t capacity = s.capacity();
+  for (std::uint64_t k = 1001; k <= 100000; ++k) // sliding window of 1000 keys
+  {
+    s.insert(k);
+    s.erase(k - 1000);
+  }
+  assert (s.size() == 1000);
+  assert (s.capacity() <= 2 * capacity);
+  for (std::uint64_t k = 100000 - 999; k <= 100000; ++k)
+    assert (s.contains(k));
+}
+
+struct armed_hash // throws for key 13 once armed
+{
+  const bool* armed;
+  std::size_t operator()(std::uint64_t k) const
+  {
+    if (k == 13 && *armed)
+      throw std::runtime_error("hash");
+    return std::hash<std::uint64_t>()(k);
+  }
+};
+
+struct armed_value // its copy throws once armed; its move may throw, so the table copies it
+{
+  static inline bool armed = false;
+  int v;
+
+  explicit armed_value(int v) : v(v) {}
+  armed_value(const armed_value& rhs) : v(rhs.v)
+  {
+    if (armed)
+      throw std::runtime_error("copy");
+  }
+  armed_value(armed_value&& rhs) noexcept(false) : v(rhs.v) { rhs.v = -1; }
+};
+
+template <typename Map>
+bool has_keys_1_to_100(const Map& m)
+{
+  if (m.size() != 100)
+    return false;
+  for (std::uint64_t k = 1; k <= 100; ++k)
+    if (!m.contains(k))
+      return false;
+  return true;
+}
+
+void test_rehash_is_exception_safe()
+{
+  bool armed = false;
+  markable_flat_map<id_policy, int, armed_hash> m(0, armed_hash{&armed});
+  for (std::uint64_t k = 1; k <= 100; ++k)
+    m.insert(k, int(k));
+  std::size_t capacity = m.capacity();
+
+  armed = true;
+  [[maybe_unused]] bool thrown = false;
+  try {
+    m.reserve(4 * capacity);
+  }
+  catch (std::runtime_error const&) {
+    thrown = true;
+  }
+  armed = false;
+  assert (thrown);
+  assert (m.capacity() == capacity);
+  assert (has_keys_1_to_100(m) && *m.find(13) == 13);
+
+  markable_flat_map<id_policy, armed_value> n;
+  for (std::uint64_t k = 1; k <= 100; ++k)
+    n.insert(k, armed_value(int(k)));
+  capacity = n.capacity();
+
+  armed_value::armed = true;
+  thrown = false;
+  try {
+    n.reserve(4 * capacity);
+  }
+  catch (std::runtime_error const&) {
+    thrown = true;
+  }
+  armed_value::armed = false;
+  assert (thrown);
+  assert (n.capacity() == capacity);
+  assert (has_keys_1_to_100(n));
+  for (std::uint64_t k = 1; k <= 100; ++k)
+    assert (n.find(k)->v == int(k)); // not moved from
+}
+
+void test_copy_keeps_hash()
+{
+  bool armed = false;
+  markable_flat_set<id_policy, armed_hash> s(0, armed_hash{&armed});
+  markable_flat_map<id_policy, int, armed_hash> m(0, armed_hash{&armed});
+  for (std::uint64_t k = 1; k <= 100; ++k)
+  {
+    s.insert(k);
+    m.insert(k, int(k));
+  }
+
+  markable_flat_set<id_policy, armed_hash> s2 = s; // a default-constructed armed_hash would crash
+  markable_flat_map<id_policy, int, armed_hash> m2 = m;
+  assert (has_keys_1_to_100(s2) && has_keys_1_to_100(m2));
+  assert (*m2.find(13) == 13);
+}
+
+int main()
+{
+  test_set_basics();
+  test_against_reference<std::hash<std::uint64_t>>(1000, 20000);
+  test_against_reference<std::hash<std::uint64_t>>(100000, 20000);
+  test_against_reference<bad_hash>(200, 3000);
+  test_map_access();
+  test_tombstones_do_not_accumulate();
+  test_rehash_is_exception_safe();
+  test_copy_keeps_hash();
+}
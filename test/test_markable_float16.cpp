@@ -0,0 +1,144 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_float16.hpp"
+#include "test_support.hpp"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace ak_toolkit;
+namespace detail_ = ak_toolkit::markable_ns::detail_;
+
+typedef markable<mark_half_nan> opt_half;
+typedef markable<mark_bf16_nan> opt_bf16;
+
+std::vector<detail_::float16_isa> testable_float16_isas()
+{
+  std::vector<detail_::float16_isa> ans;
+  for (detail_::float16_isa isa : {detail_::float16_isa::scalar, detail_::float16_isa::avx2,
+                                   detail_::float16_isa::avx512, detail_::float16_isa::avx512bf16})
+    if (isa <= detail_::supported_float16_isa())
+      ans.push_back(isa);
+  return ans;
+}
+
+bool same_bits(float a, float b) { return std::bit_cast<std::uint32_t>(a) == std::bit_cast<std::uint32_t>(b); }
+
+void test_policies()
+{
+  static_assert(sizeof(opt_half) == 2 && sizeof(opt_bf16) == 2, "");
+  static_assert(!opt_half().has_value() && !opt_bf16().has_value(), "");
+  static_assert(opt_half(1.5f).value() == 1.5f, "");
+  static_assert(!detail_::is_radix_sortable<mark_half_nan>(), "");
+
+  assert (opt_half(-2.0f).value() == -2.0f);
+  assert (opt_half(65504.0f).value() == 65504.0f);
+  assert (opt_half(65520.0f).value() == std::numeric_limits<float>::infinity()); // the tie rounds to even
+  assert (opt_half(1.0f + 1.0f / 2048).value() == 1.0f);                         // the tie rounds to even
+  assert (opt_half(1.0f + 3.0f / 2048).value() == 1.0f + 1.0f / 512);
+  assert (opt_half(std::ldexp(1.0f, -24)).value() == std::ldexp(1.0f, -24));      // the smallest subnormal
+  assert (opt_half(std::ldexp(1.0f, -25)).value() == 0.0f);
+  assert (std::signbit(opt_half(-0.0f).value()));
+  assert (opt_half(0.1f).value() == 0.0999755859375f);
+  assert (!opt_half(std::numeric_limits<float>::quiet_NaN()).has_value());
+  assert (!opt_half(-std::numeric_limits<float>::signaling_NaN()).has_value());
+  assert (opt_half().storage_value() == 0x7E00 && std::isnan(detail_::half_bits_to_float(0x7E00)));
+
+  assert (opt_bf16(1.0f).value() == 1.0f);
+  assert (opt_bf16(3.14159265f).value() == 3.140625f);
+  assert (opt_bf16(1.0f + 1.0f / 256).value() == 1.0f);                      // the tie rounds to even
+  assert (opt_bf16(std::numeric_limits<float>::max()).value() == std::numeric_limits<float>::infinity());
+  assert (opt_bf16(std::numeric_limits<float>::denorm_min()).value() == 0.0f); // subnormals become zero
+  assert (!opt_bf16(std::numeric_limits<float>::quiet_NaN()).has_value());
+}
+
+// Every finite half converts to float and back exactly; NaNs convert to NaN.
+void test_half_exhaustive()
+{
+  for (std::uint32_t h = 0; h != 0x10000; ++h)
+  {
+    [[maybe_unused]] float f = detail_::half_bits_to_float(std::uint16_t(h));
+    if ((h & 0x7C00) == 0x7C00 && (h & 0x3FF))
+      assert (std::isnan(f) && detail_::float_to_half_bits(f) == 0x7E00);
+    else
+      assert (detail_::float_to_half_bits(f) == h);
+  }
+  for (std::uint32_t b = 0; b != 0x10000; ++b)
+  {
+    [[maybe_unused]] float f = detail_::bf16_bits_to_float(std::uint16_t(b));
+    if ((b & 0x7F80) == 0x7F80 && (b & 0x7F))
+      assert (std::isnan(f) && detail_::float_to_bf16_bits(f) == 0x7FC0);
+    else if ((b & 0x7F80) != 0)
+      assert (detail_::float_to_bf16_bits(f) == b);
+  }
+}
+
+// All instruction sets agree bit for bit, on random bit patterns and on values near the rounding points.
+template <typename MP>
+void test_conversions_for()
+{
+  for (std::size_t n : {0, 1, 7, 8, 15, 16, 17, 31, 32, 33, 100, 4099})
+  {
+    std::vector<float> in(n);
+    for (float& f : in)
+      switch (rng() % 3)
+      {
+        case 0: f = std::bit_cast<float>(std::uint32_t(rng())); break;
+        case 1: f = std::bit_cast<float>(std::uint32_t(std::bit_cast<std::uint32_t>(float(rng() % 70000)) + rng() % 0x4000)); break;
+        default: f = detail_::half_bits_to_float(std::uint16_t(rng())) * (rng() % 2 ? 1.0f : 1.0f / 3); break;
+      }
+
+    std::vector<markable<MP>> ref(n);
+    for (std::size_t i = 0; i != n; ++i)
+      ref[i] = markable<MP>(in[i]);
+
+    for (detail_::float16_isa isa : testable_float16_isas())
+    {
+      std::vector<std::uint16_t> bits(n + 1, 0xABCD);
+      detail_::floats_to_bits<MP>(isa, in.data(), n, bits.data());
+      for (std::size_t i = 0; i != n; ++i)
+        assert (bits[i] == ref[i].storage_value());
+      assert (bits[n] == 0xABCD); // no write past the end
+
+      std::vector<float> out(n + 1, 7.0f);
+      detail_::bits_to_floats<MP>(isa, bits.data(), n, out.data());
+      for (std::size_t i = 0; i != n; ++i)
+        assert (ref[i].has_value() ? same_bits(out[i], ref[i].value()) : std::isnan(out[i]));
+      assert (out[n] == 7.0f);
+
+      // foreign NaN patterns too
+      std::vector<std::uint16_t> raw(n);
+      for (std::uint16_t& r : raw)
+        r = std::uint16_t(rng());
+      std::vector<float> expected(n), got(n);
+      detail_::bits_to_floats<MP>(detail_::float16_isa::scalar, raw.data(), n, expected.data());
+      detail_::bits_to_floats<MP>(isa, raw.data(), n, got.data());
+      for (std::size_t i = 0; i != n; ++i)
+        assert (same_bits(got[i], expected[i]));
+    }
+
+    std::vector<markable<MP>> column(n);
+    from_floats(in, column);
+    assert (column == ref);
+    std::vector<float> back(n);
+    to_floats(column, back);
+    assert (count_present(column) == std::size_t(std::count_if(back.begin(), back.end(), [](float f) { return !std::isnan(f); })));
+  }
+}
+
+int main()
+{
+  test_policies();
+  test_half_exhaustive();
+  test_conversions_for<mark_half_nan>();
+  test_conversions_for<mark_bf16_nan>();
+}
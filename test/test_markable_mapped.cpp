@@ -0,0 +1,163 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_mapped.hpp"
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <string>
+
+using namespace ak_toolkit;
+
+std::string temp_file(const char* name)
+{
+  return (std::filesystem::temp_directory_path() / (std::string("markable_") + std::to_string(::getpid()) + "_" + name)).string();
+}
+
+template <typename MP>
+bool rejects(const std::string& path)
+{
+  try {
+    mapped_markable_array<MP> a(path);
+    return false;
+  }
+  catch (mapped_array_error const&) {
+    return true;
+  }
+}
+
+template <typename A>
+concept has_mutable_span = requires (A& a) { a.mutable_span(); };
+
+void test_create_and_reopen()
+{
+  typedef mark_int<std::int64_t, -1> policy;
+  static_assert(!has_mutable_span<const mapped_markable_array<policy>>, "no mutable access through a const array");
+  std::string path = temp_file("ints");
+  {
+    mapped_markable_array<policy> a = mapped_markable_array<policy>::create(path, 1000);
+    assert (a.size() == 1000);
+    assert (a.mode() == map_mode::read_write);
+    for ([[maybe_unused]] const markable<policy>& e : a)
+      assert (!e.has_value());
+
+    std::span<markable<policy>> s = a.mutable_span();
+    for (std::size_t i = 0; i < s.size(); i += 3)
+      s[i].assign(std::int64_t(i) * 10);
+    a.flush();
+  }
+  assert (std::filesystem::file_size(path) == 64 + 1000 * sizeof(std::int64_t));
+  {
+    const mapped_markable_array<policy> a(path);
+    assert (a.size() == 1000);
+    assert (reinterpret_cast<std::uintptr_t>(a.data()) % 64 == 0);
+    for (std::size_t i = 0; i != a.size(); ++i)
+    {
+      assert (a[i].has_value() == (i % 3 == 0));
+      if (a[i].has_value())
+        assert (a[i].value() == std::int64_t(i) * 10);
+    }
+  }
+  {
+    mapped_markable_array<policy> a(path, map_mode::read_write);
+    a.mutable_span()[1].assign(7);
+  }
+  {
+    mapped_markable_array<policy> a(path);
+    mapped_markable_array<policy> b = std::move(a);
+    assert (a.size() == 0);
+    assert (b[1].has_value() && b[1].value() == 7);
+
+    [[maybe_unused]] bool thrown = false;
+    try {
+      b.mutable_span();
+    }
+    catch (mapped_array_error const&) {
+      thrown = true;
+    }
+    assert (thrown); // mapped read-only
+  }
+  std::remove(path.c_str());
+}
+
+void test_policy_mismatch()
+{
+  std::string path = temp_file("mismatch");
+  mapped_markable_array<mark_int<std::int32_t, -1>>::create(path, 10);
+
+  [[maybe_unused]] typedef mark_int<std::int32_t, -1> same_policy;
+  [[maybe_unused]] typedef mark_int<std::uint32_t, 0xFFFFFFFF> same_bit_pattern;
+  [[maybe_unused]] typedef mark_int<std::int32_t, 0> other_marked_value;
+  [[maybe_unused]] typedef mark_int<std::int64_t, -1> other_size;
+
+  assert (!rejects<same_policy>(path));
+  assert (!rejects<same_bit_pattern>(path));
+  assert (rejects<other_marked_value>(path));
+  assert (rejects<other_size>(path));
+  assert (rejects<mark_fp_nan<float>>(path)); // other marking
+  assert (rejects<mark_bool>(path));
+  assert (rejects<mark_sign_bit<std::int32_t>>(path)); // same marked value, other marking
+  std::remove(path.c_str());
+
+  typedef mark_int_range<std::int32_t, -16, -1> range_policy;
+  [[maybe_unused]] typedef mark_int_range<std::int32_t, -16, -2> other_range;
+  mapped_markable_array<range_policy>::create(path, 10);
+  assert (!rejects<range_policy>(path));
+  assert (rejects<other_range>(path)); // other last marked value
+  std::remove(path.c_str());
+}
+
+void test_bad_files()
+{
+  typedef mark_fp_nan<double> policy;
+  std::string path = temp_file("bad");
+
+  mapped_markable_array<policy>::create(path, 100);
+  std::filesystem::resize_file(path, 64 + 99 * sizeof(double));
+  assert (rejects<policy>(path)); // truncated
+
+  {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f << "definitely not a markable array, but long enough to hold a header.";
+  }
+  assert (rejects<policy>(path));
+
+  {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f << "short";
+  }
+  assert (rejects<policy>(path));
+  std::remove(path.c_str());
+
+  [[maybe_unused]] bool thrown = false;
+  try {
+    mapped_markable_array<policy> a(path);
+  }
+  catch (std::system_error const&) {
+    thrown = true;
+  }
+  assert (thrown); // no such file
+
+  thrown = false;
+  try {
+    mapped_markable_array<policy>::create(path, std::size_t(-1) / sizeof(double));
+  }
+  catch (std::bad_array_new_length const&) {
+    thrown = true;
+  }
+  assert (thrown); // file size overflows
+  assert (!std::filesystem::exists(path));
+}
+
+int main()
+{
+  test_create_and_reopen();
+  test_policy_mismatch();
+  test_bad_files();
+}
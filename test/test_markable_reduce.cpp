@@ -0,0 +1,144 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_reduce.hpp"
+#include "test_support.hpp"
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace ak_toolkit;
+namespace detail_ = ak_toolkit::markable_ns::detail_;
+
+template <typename T>
+bool same_bits(const T& l, const T& r)
+{
+  return std::memcmp(&l, &r, sizeof(T)) == 0;
+}
+
+// Every instruction set must produce bit-identical lane states, and the result must agree
+// with a plain loop (exactly for integers, up to rounding for floating point).
+template <typename MP>
+void check_reductions(const std::vector<markable<MP>>& v)
+{
+  typedef typename MP::value_type T;
+  typedef detail_::reduce_lanes<T> lanes;
+
+  [[maybe_unused]] lanes ref = detail_::reduce_present(simd_isa::scalar, v.data(), v.size());
+  for (simd_isa isa : testable_isas())
+  {
+    [[maybe_unused]] lanes s = detail_::reduce_present(isa, v.data(), v.size());
+    assert (s.count == ref.count);
+    for (std::size_t l = 0; l != lanes::lanes; ++l)
+    {
+      assert (same_bits(s.sum[l], ref.sum[l]));
+      assert (same_bits(s.min[l], ref.min[l]));
+      assert (same_bits(s.max[l], ref.max[l]));
+    }
+  }
+
+  std::size_t count = 0;
+  long double sum = 0;
+  std::uint64_t int_sum = 0; // wraps around like the library
+  T mn = std::numeric_limits<T>::max(), mx = std::numeric_limits<T>::lowest();
+  for (const markable<MP>& e : v)
+    if (e.has_value())
+    {
+      ++count;
+      sum += e.value();
+      if constexpr (std::is_integral<T>::value)
+        int_sum += std::uint64_t(typename present_summary<MP>::sum_type(e.value()));
+      mn = std::min(mn, e.value());
+      mx = std::max(mx, e.value());
+    }
+
+  [[maybe_unused]] present_summary<MP> r = summarize_present(v);
+  assert (r.count == count && count_present(v) == count);
+  assert (r.min.has_value() == (count != 0) && r.max.has_value() == (count != 0));
+  if (count)
+  {
+    assert (r.min.value() == mn && r.max.value() == mx);
+    assert (min_present(v) == r.min && max_present(v) == r.max);
+    if (std::is_integral<T>::value)
+      assert (r.sum == typename present_summary<MP>::sum_type(int_sum));
+    else if (std::isnan(double(sum)))
+      assert (std::isnan(double(r.sum)));
+    else
+      assert (std::fabs(double(sum) - double(r.sum)) <= 1e-9 * std::fabs(double(sum)) + 1e-9);
+    assert (mean_present(v) == markable<mark_fp_nan<double>>(double(r.sum) / double(count))); // NaN for inf - inf
+  }
+  else
+  {
+    assert (r.sum == 0);
+    assert (!mean_present(v).has_value());
+  }
+  assert (same_bits(sum_present(v), r.sum));
+}
+
+template <typename MP, typename Gen>
+void test_reductions_for(Gen gen)
+{
+  for (std::size_t n : {0, 1, 7, 8, 15, 16, 17, 63, 64, 65, 1000, 4099})
+    for (double null_density : {0.0, 0.01, 0.5, 0.99, 1.0})
+      check_reductions(random_markables<MP>(rng, n, null_density, gen));
+}
+
+void test_reductions()
+{
+  std::uniform_real_distribution<double> real(-1e3, 1e3);
+  test_reductions_for<mark_fp_nan<double>>([&]{ return real(rng); });
+  test_reductions_for<mark_fp_nan<float>>([&]{ return float(real(rng)); });
+  test_reductions_for<mark_int<std::int32_t, INT_MIN>>([&]{ return std::int32_t(rng()); });
+  test_reductions_for<mark_int<std::int64_t, -1>>([&]{ return std::int64_t(rng() >> 8) - (std::int64_t(1) << 54); });
+  test_reductions_for<mark_int<std::int64_t, 0>>([&]{ return std::int64_t(rng() | 1); }); // sums wrap around
+  test_reductions_for<mark_int<std::int16_t, -1>>([&]{ return std::int16_t(rng() % 30000); });
+  test_reductions_for<mark_int<std::uint32_t, 0>>([&]{ return std::uint32_t(1 + rng() % 100000); });
+  test_reductions_for<mark_value_init<double>>([&]{ return real(rng) + 2e3; });
+  test_reductions_for<mark_fp_nan_payload<double, 1>>([&]{ return real(rng); });
+  test_reductions_for<mark_sign_bit<std::int32_t>>([&]{ return std::int32_t(rng()); }); // negative values are marked
+  test_reductions_for<mark_int_range<std::int64_t, -256, -1>>([&]{ return std::int64_t(rng() % 1000) - 500; });
+}
+
+void test_signed_zeros_and_infinities()
+{
+  typedef markable<mark_fp_nan<double>> opt;
+  std::vector<opt> v;
+  for (int i = 0; i != 100; ++i)
+    v.push_back(i % 3 ? opt(i % 2 ? 0.0 : -0.0) : opt());
+  check_reductions(v);
+
+  v.push_back(opt(std::numeric_limits<double>::infinity()));
+  v.push_back(opt(-std::numeric_limits<double>::infinity()));
+  check_reductions(v);
+  assert (std::isnan(summarize_present(v).sum));
+  assert (max_present(v).value() == std::numeric_limits<double>::infinity());
+}
+
+// with payload marking a computed NaN is a value, so it is counted and poisons the sum
+void test_computed_nan_is_counted()
+{
+  typedef markable<mark_fp_nan_payload<double, 1>> opt;
+  std::vector<opt> v(100, opt(1.0));
+  v[3] = opt();
+  v[70] = opt(std::numeric_limits<double>::quiet_NaN());
+  for ([[maybe_unused]] simd_isa isa : testable_isas())
+    assert (detail_::reduce_present(isa, v.data(), v.size()).count == 99);
+  [[maybe_unused]] present_summary<mark_fp_nan_payload<double, 1>> r = summarize_present(v);
+  assert (r.count == 99);
+  assert (std::isnan(r.sum));
+}
+
+int main()
+{
+  test_reductions();
+  test_signed_zeros_and_infinities();
+  test_computed_nan_is_counted();
+}
@@ -0,0 +1,236 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_stream.hpp"
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace ak_toolkit;
+namespace detail_ = ak_toolkit::markable_ns::detail_;
+
+std::string temp_file(const char* name)
+{
+  return (std::filesystem::temp_directory_path() / (std::string("markable_") + std::to_string(::getpid()) + "_" + name)).string();
+}
+
+// A temporary file, open for reading and writing.
+class temp_fd
+{
+  std::string _path;
+  int _fd;
+
+public:
+  explicit temp_fd(const char* name) : _path(temp_file(name)), _fd(::open(_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644))
+  {
+    assert (_fd >= 0);
+  }
+  ~temp_fd() { ::close(_fd); std::remove(_path.c_str()); }
+
+  int get() const { return _fd; }
+  std::size_t size() const { return std::filesystem::file_size(_path); }
+  void rewind() const { ::lseek(_fd, 0, SEEK_SET); }
+  void truncate(std::size_t n) const
+  {
+    [[maybe_unused]] int result = ::ftruncate(_fd, off_t(n));
+    assert (result == 0);
+  }
+};
+
+template <typename MP>
+bool same_elements(const std::vector<markable<MP>>& a, const std::vector<markable<MP>>& b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (std::size_t i = 0; i != a.size(); ++i)
+    if (std::memcmp(&a[i].storage_value(), &b[i].storage_value(), sizeof(typename MP::storage_type)) != 0)
+      return false;
+  return true;
+}
+
+// Element i has a value unless it falls in one of the null runs of various lengths.
+template <typename MP, typename F>
+std::vector<markable<MP>> make_elements(std::size_t n, F value)
+{
+  std::vector<markable<MP>> ans(n);
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    std::size_t run = i % 300;
+    bool null = run < 5 || (run >= 100 && run < 117) || (run >= 150 && run < 290) || i % 7 == 3;
+    if (!null)
+      ans[i] = markable<MP>(value(i));
+  }
+  return ans;
+}
+
+template <typename MP, typename F>
+void test_round_trip(F value)
+{
+  for (std::size_t n : {0u, 1u, 63u, 64u, 1000u, 10000u})
+  {
+    std::vector<markable<MP>> v = make_elements<MP>(n, value);
+    for (bool rle : {false, true})
+    {
+      temp_fd f("stream");
+      markable_stream_options options;
+      options.run_length_marked = rle;
+      write_markable_stream(f.get(), v, options);
+      if (!rle)
+        assert (f.size() == 64 + 16 + n * sizeof(markable<MP>) + 16 || (n == 0 && f.size() == 64 + 16));
+      else if (n >= 1000)
+        assert (f.size() < 64 + 16 + n * sizeof(markable<MP>) + 16);
+
+      f.rewind();
+      markable_stream_reader<MP> r(f.get());
+      assert (r.run_length_marked() == rle);
+      std::vector<markable<MP>> u = r.read_all();
+      assert (same_elements(u, v));
+      assert (r.done());
+    }
+  }
+}
+
+struct interval
+{
+  int first, last;
+};
+
+struct interval_representation
+{
+  int first, last;
+};
+
+struct mark_interval : markable_dual_storage_type<mark_interval, interval, interval_representation>
+{
+  static representation_type marked_value() AK_TOOLKIT_NOEXCEPT { return {0, -1}; }
+  static bool is_marked_value(const representation_type& v) { return v.first > v.last; }
+};
+
+enum class color { red, green, blue, none };
+
+void test_policies()
+{
+  test_round_trip<mark_int<std::int32_t, -1>>([](std::size_t i) { return std::int32_t(i); });
+  test_round_trip<mark_int<std::uint8_t, 0>>([](std::size_t i) { return std::uint8_t(i % 255 + 1); });
+  test_round_trip<mark_enum<color, int(color::none)>>([](std::size_t i) { return color(i % 3); });
+  test_round_trip<mark_bool>([](std::size_t i) { return i % 3 == 0; });
+  test_round_trip<mark_fp_nan<double>>([](std::size_t i) { return double(i) / 3; });
+  test_round_trip<mark_fp_nan<float>>([](std::size_t i) { return -float(i); });
+  test_round_trip<mark_interval>([](std::size_t i) { return interval{int(i), int(i) + 2}; });
+}
+
+void test_incremental()
+{
+  typedef mark_int<std::int64_t, -1> policy;
+  std::vector<markable<policy>> v = make_elements<policy>(5000, [](std::size_t i) { return std::int64_t(i) * 3; });
+
+  int fds[2];
+  [[maybe_unused]] int result = ::pipe(fds);
+  assert (result == 0);
+  {
+    markable_stream_options options;
+    options.run_length_marked = true;
+    options.min_marked_run = 4;
+    markable_stream_writer<policy> w(fds[1], options);
+    for (std::size_t i = 0; i < v.size(); i += 777)
+      w.write(v.data() + i, std::min<std::size_t>(777, v.size() - i));
+    w.finish();
+  }
+  [[maybe_unused]] ssize_t written = ::write(fds[1], "tail", 4); // data following the stream is not consumed
+  assert (written == 4);
+  ::close(fds[1]);
+
+  markable_stream_reader<policy> r(fds[0]);
+  std::vector<markable<policy>> u(v.size() + 10);
+  std::size_t got = 0;
+  while (std::size_t k = r.read(u.data() + got, std::min<std::size_t>(33, u.size() - got)))
+    got += k;
+  assert (got == v.size());
+  assert (r.done());
+  u.resize(got);
+  assert (same_elements(u, v));
+
+  char tail[8] = {};
+  [[maybe_unused]] ssize_t read = ::read(fds[0], tail, sizeof(tail));
+  assert (read == 4 && std::string(tail) == "tail");
+  ::close(fds[0]);
+}
+
+void test_all_marked()
+{
+  typedef mark_fp_nan<double> policy;
+  std::vector<markable<policy>> v(100000);
+  temp_fd f("marked");
+  write_markable_stream(f.get(), v, markable_stream_options{true, 16});
+  assert (f.size() == 64 + 16 + 16);
+  f.rewind();
+  std::vector<markable<policy>> u = read_markable_stream<policy>(f.get());
+  assert (same_elements(u, v));
+}
+
+template <typename MP>
+bool rejects(int fd)
+{
+  ::lseek(fd, 0, SEEK_SET);
+  try {
+    read_markable_stream<MP>(fd);
+    return false;
+  }
+  catch (markable_stream_error const&) {
+    return true;
+  }
+}
+
+void test_bad_streams()
+{
+  typedef mark_int<std::int32_t, -1> policy;
+  std::vector<markable<policy>> v = make_elements<policy>(1000, [](std::size_t i) { return std::int32_t(i); });
+  temp_fd f("bad");
+  write_markable_stream(f.get(), v);
+
+  assert (!rejects<policy>(f.get()));
+  assert ((!rejects<mark_int<std::uint32_t, 0xFFFFFFFF>>(f.get()))); // same bit pattern
+  assert ((rejects<mark_int<std::int32_t, 0>>(f.get())));
+  assert ((rejects<mark_int<std::int64_t, -1>>(f.get())));
+  assert (rejects<mark_fp_nan<float>>(f.get()));
+
+  f.truncate(f.size() - 1);
+  assert (rejects<policy>(f.get()));
+  f.truncate(10);
+  assert (rejects<policy>(f.get()));
+
+  f.truncate(0);
+  ::lseek(f.get(), 0, SEEK_SET);
+  [[maybe_unused]] ssize_t written = ::write(f.get(), "definitely not a markable stream, but long enough to hold a header.", 68);
+  assert (written == 68);
+  assert (rejects<policy>(f.get()));
+
+  // a values chunk claiming 2^40 elements, with none following
+  f.truncate(0);
+  ::lseek(f.get(), 0, SEEK_SET);
+  write_markable_stream(f.get(), std::vector<markable<policy>>());
+  f.truncate(f.size() - sizeof(detail_::stream_chunk));
+  detail_::stream_chunk huge {detail_::stream_chunk::values, 0, std::uint64_t(1) << 40};
+  ::lseek(f.get(), 0, SEEK_END);
+  written = ::write(f.get(), &huge, sizeof(huge));
+  assert (written == sizeof(huge));
+  assert (rejects<policy>(f.get()));
+}
+
+int main()
+{
+  test_policies();
+  test_incremental();
+  test_all_marked();
+  test_bad_streams();
+}
@@ -0,0 +1,189 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_text.hpp"
+#include <cassert>
+#include <cstdint>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace ak_toolkit;
+
+typedef mark_int<std::int32_t, std::numeric_limits<std::int32_t>::min()> int_policy;
+typedef markable<int_policy> opt_int;
+typedef markable<mark_fp_nan<double>> opt_double;
+
+// The fast paths must agree with std::from_chars on the value, the end and the error.
+template <typename T>
+void check_same_as_from_chars(const std::string& s)
+{
+  for (std::size_t pad : {0u, 1u, 30u})
+  {
+    std::string text = s + std::string(pad, '\n');
+    const char* last = text.data() + text.size();
+    T a = T(), b = T();
+    [[maybe_unused]] std::from_chars_result ra = ak_toolkit::markable_ns::detail_::parse_number(text.data(), last, a);
+    std::from_chars_result rb = std::from_chars(text.data(), last, b);
+    assert (ra.ec == rb.ec);
+    if (rb.ec == std::errc())
+    {
+      assert (ra.ptr == rb.ptr);
+      assert (std::memcmp(&a, &b, sizeof(T)) == 0);
+    }
+  }
+}
+
+void test_fast_paths()
+{
+  const char* samples[] = {"0", "-0", "7", "-", "", ".", "-.", "1.", ".5", "-.5", "00012", "1.25", "-3.0e5", "12345678",
+                           "123456789", "1234567890", "2147483647", "2147483648", "-2147483648", "99999999999999999999",
+                           "0.1", "0.30000000000000004", "9007199254740993", "9007199254740992.5", "1e3", "1x", "12345678.",
+                           "1234567.87654321", "0.0000000000000000000001", "inf", "nan", "+1", "18446744073709551615"};
+  for (const char* s : samples)
+  {
+    check_same_as_from_chars<std::int32_t>(s);
+    check_same_as_from_chars<std::int64_t>(s);
+    check_same_as_from_chars<std::uint8_t>(s);
+    check_same_as_from_chars<std::uint64_t>(s);
+    check_same_as_from_chars<double>(s);
+    check_same_as_from_chars<float>(s);
+  }
+
+  std::mt19937_64 rng(1);
+  const char alphabet[] = "0123456789012345678901234567890123456789.-e";
+  for (int i = 0; i != 100000; ++i)
+  {
+    std::string s(rng() % 24, ' ');
+    for (char& c : s)
+      c = alphabet[rng() % (sizeof(alphabet) - 1)];
+    check_same_as_from_chars<std::int32_t>(s);
+    check_same_as_from_chars<std::int64_t>(s);
+    check_same_as_from_chars<double>(s);
+    check_same_as_from_chars<float>(s);
+  }
+}
+
+void test_count_fields()
+{
+  assert (count_fields("") == 0);
+  assert (count_fields("1") == 1);
+  assert (count_fields("1\n") == 1);
+  assert (count_fields("1\n2") == 2);
+  assert (count_fields("\n") == 1);
+  assert (count_fields("\n\n") == 2);
+  assert (count_fields("1,2,,3", ',') == 4);
+}
+
+void test_parse_ints()
+{
+  std::string text = "12\n-7\n\nNA\nabc\n2147483648\n-2147483648\n 5\n0\n";
+  std::vector<opt_int> v(count_fields(text));
+  assert (v.size() == 9);
+  text_parse_result r = parse_markable_column(text, v);
+  assert (r.count == 9);
+  assert (r.consumed == text.size());
+  assert (v[0] == opt_int(12));
+  assert (v[1] == opt_int(-7));
+  assert (!v[2].has_value()); // empty
+  assert (!v[3].has_value()); // NA
+  assert (!v[4].has_value()); // malformed
+  assert (!v[5].has_value()); // out of range
+  assert (!v[6].has_value()); // the marked value
+  assert (!v[7].has_value()); // leading space
+  assert (v[8] == opt_int(0));
+  assert ((r.errors == std::vector<std::size_t>{4, 5, 6, 7}));
+}
+
+void test_parse_doubles()
+{
+  std::string text = "1.5\r\n-0.25\r\n\r\n1e300\r\nnan\r\ninf\r\n1.5x\r\n";
+  std::vector<opt_double> v(count_fields(text));
+  text_parse_result r = parse_markable_column(text, v);
+  assert (r.count == 7);
+  assert (v[0] == opt_double(1.5));
+  assert (v[1] == opt_double(-0.25));
+  assert (!v[2].has_value());
+  assert (v[3] == opt_double(1e300));
+  assert (!v[4].has_value());
+  assert (v[5] == opt_double(std::numeric_limits<double>::infinity()));
+  assert (!v[6].has_value());
+  assert ((r.errors == std::vector<std::size_t>{4, 6}));
+
+  text_parse_options options;
+  options.null_tokens = {"nan", "-"};
+  options.strip_cr = false;
+  std::string csv = "nan,-,3,4\r";
+  std::vector<opt_double> w(count_fields(csv, ','));
+  options.delimiter = ',';
+  r = parse_markable_column(csv, w, options);
+  assert (r.count == 4);
+  assert (!w[0].has_value() && !w[1].has_value() && w[2] == opt_double(3) && !w[3].has_value());
+  assert ((r.errors == std::vector<std::size_t>{3})); // "4\r" with strip_cr off
+}
+
+void test_parse_partial()
+{
+  std::string text = "1\n2\n3\n4\n5";
+  std::vector<opt_int> v(3);
+  text_parse_result r = parse_markable_column(text, v);
+  assert (r.count == 3);
+  assert (r.consumed == 6);
+  r = parse_markable_column(std::string_view(text).substr(r.consumed), v);
+  assert (r.count == 2);
+  assert (r.consumed == 3);
+  assert (v[0] == opt_int(4) && v[1] == opt_int(5));
+}
+
+template <typename MP>
+void test_round_trip(const std::vector<markable<MP>>& v)
+{
+  std::string text = "header\n";
+  format_markable_column(v, text);
+  std::string_view body = std::string_view(text).substr(7);
+  assert (count_fields(body) == v.size());
+
+  std::vector<markable<MP>> u(v.size());
+  text_parse_result r = parse_markable_column(body, u);
+  assert (r.count == v.size() && r.consumed == body.size() && r.errors.empty());
+  assert (u == v);
+}
+
+void test_format()
+{
+  std::string text;
+  std::vector<opt_int> v = {opt_int(1), opt_int(), opt_int(-30)};
+  format_markable_column(v, text);
+  assert (text == "1\n\n-30\n");
+
+  text_format_options options;
+  options.delimiter = '\t';
+  options.null_token = "NULL";
+  text.clear();
+  format_markable_column(v, text, options);
+  assert (text == "1\tNULL\t-30\t");
+
+  test_round_trip(std::vector<opt_int>{opt_int(std::numeric_limits<std::int32_t>::max()), opt_int(),
+                                       opt_int(std::numeric_limits<std::int32_t>::min() + 1), opt_int(0)});
+  test_round_trip(std::vector<opt_double>{opt_double(0.1), opt_double(), opt_double(-1.7976931348623157e308),
+                                          opt_double(4.9406564584124654e-324), opt_double(-0.0), opt_double(1.0 / 3)});
+  test_round_trip(std::vector<markable<mark_fp_nan<float>>>{markable<mark_fp_nan<float>>(-3.4028235e38f),
+                                                            markable<mark_fp_nan<float>>()});
+  test_round_trip(std::vector<markable<mark_int<std::uint64_t, 0>>>{markable<mark_int<std::uint64_t, 0>>(std::uint64_t(-1))});
+}
+
+int main()
+{
+  test_fast_paths();
+  test_count_fields();
+  test_parse_ints();
+  test_parse_doubles();
+  test_parse_partial();
+  test_format();
+}
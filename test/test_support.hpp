@@ -0,0 +1,46 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_TEST_SUPPORT_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_TEST_SUPPORT_HEADER_GUARD_
+
+// Helpers shared by the tests: a seeded random engine, the instruction sets the CPU running
+// the test supports, and random arrays of markable objects.
+
+#include "../include/ak_toolkit/markable_algorithm.hpp"
+#include <cstddef>
+#include <random>
+#include <vector>
+
+// The engine of each test program; a fixed seed keeps failures reproducible.
+inline std::mt19937_64 rng(20210101);
+
+// The instruction sets the bulk algorithms can be tested with on this CPU.
+inline std::vector<ak_toolkit::simd_isa> testable_isas()
+{
+  using ak_toolkit::simd_isa;
+  std::vector<simd_isa> ans {simd_isa::scalar};
+  for (simd_isa isa : {simd_isa::sse2, simd_isa::avx2, simd_isa::avx512})
+    if (isa <= ak_toolkit::supported_simd_isa())
+      ans.push_back(isa);
+  return ans;
+}
+
+// n elements, each marked with probability null_density (drawn from `engine`) or holding gen().
+template <typename MP, typename Engine, typename Gen>
+std::vector<ak_toolkit::markable<MP>> random_markables(Engine& engine, std::size_t n, double null_density, Gen gen)
+{
+  std::bernoulli_distribution is_null(null_density);
+  std::vector<ak_toolkit::markable<MP>> ans;
+  for (std::size_t i = 0; i != n; ++i)
+    if (is_null(engine))
+      ans.emplace_back();
+    else
+      ans.emplace_back(gen());
+  return ans;
+}
+
+#endif // AK_TOOLBOX_MARKABLE_TEST_SUPPORT_HEADER_GUARD_